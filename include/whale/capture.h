@@ -0,0 +1,33 @@
+
+#ifndef _WHALE_CAPTURE_H
+#define _WHALE_CAPTURE_H
+
+typedef struct WhaleCompositor WhaleCompositor;
+typedef struct WhaleClient WhaleClient;
+
+/**
+ * Expose wlr-screencopy and ext-image-copy-capture for outputs and
+ * toplevels. Captures copy what the outputs already rendered (or only the
+ * captured toplevel, for toplevel captures) and only the damaged regions,
+ * into dmabufs when the capturing client supports them.
+ *
+ * @returns 0 on success or a negative value on failure.
+ */
+int wh_capture_init(WhaleCompositor* comp);
+
+/**
+ * Advertise the client to capture tools, call it when the client maps.
+ */
+void wh_capture_client_map(WhaleClient* client);
+
+/**
+ * Withdraw the client, call it when it unmaps or is destroyed.
+ */
+void wh_capture_client_unmap(WhaleClient* client);
+
+/**
+ * Update the title/app id capture tools see.
+ */
+void wh_capture_client_update(WhaleClient* client);
+
+#endif // !_WHALE_CAPTURE_H
@@ -4,19 +4,85 @@
 
 #include <wayland-server-core.h>
 #include <whale/compositor.h>
+#include <whale/decoration.h>
+#include <whale/memory.h>
 #include <wlr/types/wlr_scene.h>
 #include <wlr/types/wlr_xdg_decoration_v1.h>
 
 typedef double wh_coord_t;
 
-typedef struct
+typedef enum
+{
+    WH_CLIENT_XDG = 0,
+    /* Only with XWayland support (WH_XWAYLAND) */
+    WH_CLIENT_X11,
+} WhaleClientType;
+
+typedef struct WhaleClient
 {
     WhaleCompositor* comp;
 
+    /* Stable id handed out over IPC, never 0 */
+    u32 id;
+
+    WhaleClientType type;
+
+    /* WH_CLIENT_XDG only */
     struct wlr_xdg_toplevel* xdg_toplevel;
     struct wlr_xdg_toplevel_decoration_v1* xdg_decoration;
 
+#ifdef WH_XWAYLAND
+    /* WH_CLIENT_X11 only */
+    struct wlr_xwayland_surface* xwayland_surface;
+#endif
+
+    /* Places itself and is never resized or decorated, like X11 menus */
+    bool unmanaged;
+
+    /* Holds the decoration and the surfaces, positioned at the top left
+    corner of the decoration */
     struct wlr_scene_tree* scene_tree;
+    /* The toplevel's surfaces, its popups and subsurfaces. NULL for X11
+    windows without a surface yet. */
+    struct wlr_scene_tree* surface_tree;
+
+    bool server_side_decorations;
+    WhaleDecoration decoration;
+
+    /* Every surface mapped to this client, see client.c */
+    struct wl_list surfaces;
+
+    /* Handle capture tools see while mapped, NULL otherwise */
+    struct wlr_ext_foreign_toplevel_handle_v1* foreign_toplevel;
+    /* Created on the first capture of this client, destroyed along with
+    the scene tree */
+    struct wlr_ext_image_capture_source_v1* capture_source;
+
+    /* Buffers attached to any of the surfaces */
+    WhaleBufferStats buffer_stats;
+
+    /* Geometry last reported over IPC */
+    struct wlr_box ipc_box;
+
+    /* Seats whose keyboard focus is on the client */
+    u32 focus_count;
+
+    /* Placed by the user instead of filling its output. The box has the
+    position of scene_tree and the size of the content. */
+    bool floating;
+    struct wlr_box float_box;
+    /* enum wlr_edges of the last resize, the opposite ones are kept in place
+    until the client caught up with it */
+    u32 resize_edges;
+    /* A seat is moving or resizing it */
+    bool grabbed;
+
+    /* At most one size configure is in flight, see client.c */
+    u32 configure_serial;
+    bool configure_pending;
+    bool resize_queued;
+    int queued_width;
+    int queued_height;
 
     struct
     {
@@ -26,16 +92,136 @@ typedef struct
 
         struct wl_listener destroy;
         struct wl_listener set_title;
+        /* set_app_id, set_class for X11 clients */
+        struct wl_listener set_app_id;
+        struct wl_listener request_move;
+        struct wl_listener request_resize;
 
         struct wl_listener decoration_request_mode;
         struct wl_listener decoration_destroy;
+
+#ifdef WH_XWAYLAND
+        struct wl_listener associate;
+        struct wl_listener dissociate;
+        struct wl_listener request_configure;
+        struct wl_listener set_geometry;
+        struct wl_listener set_override_redirect;
+#endif
     } listeners;
+
+    /* WhaleCompositor::clients */
+    struct wl_list link;
 } WhaleClient;
 
 void wh_client_on_new_client(struct wl_listener* listener, void* data);
 
+/* The parts of a client's life shared by every type, called by the type's
+own listeners (xdg-shell in client.c, X11 in xwayland.c). */
+
+/**
+ * Create a client with an empty, disabled scene tree. The caller adds its
+ * surfaces to it.
+ *
+ * @returns The new client or NULL on failure.
+ */
+WhaleClient* wh_client_create(WhaleCompositor* comp, WhaleClientType type);
+
+/**
+ * Let hits on the surface, and on all of its subsurfaces, resolve to the
+ * client without walking the scene.
+ */
+void wh_client_track_surface(WhaleClient* client, struct wlr_surface* surface);
+
+void wh_client_mapped(WhaleClient* client);
+
+void wh_client_unmapped(WhaleClient* client);
+
+/**
+ * Lay the client out after it committed, requesting a new size if it
+ * doesn't fit its place.
+ */
+void wh_client_committed(WhaleClient* client);
+
+void wh_client_title_changed(WhaleClient* client);
+
+void wh_client_app_id_changed(WhaleClient* client);
+
+/**
+ * Free the client, its type specific listeners must be gone.
+ */
+void wh_client_destroy(WhaleClient* client);
+
+/**
+ * The client's main surface, NULL for X11 windows without one yet.
+ */
+struct wlr_surface* wh_client_surface(const WhaleClient* client);
+
+/**
+ * @returns The client's title, an empty string if it has none.
+ */
+const char* wh_client_title(const WhaleClient* client);
+
+/**
+ * @returns The client's app id (the class of X11 windows), may be NULL.
+ */
+const char* wh_client_app_id(const WhaleClient* client);
+
+/**
+ * The part of the client's surface that is the window, relative to the
+ * surface. Anything outside of it, like CSD shadows, isn't.
+ */
+struct wlr_box wh_client_get_geometry(const WhaleClient* client);
+
+/**
+ * Politely ask the client to close.
+ */
+void wh_client_close(WhaleClient* client);
+
+/**
+ * @returns Whether a single pointer button of the seat is held with its
+ * pointer on the client, which is when clients may start moving or resizing
+ * themselves.
+ */
+bool wh_client_has_pointer_button(
+    const WhaleClient* client, const struct wlr_seat* seat
+);
+
+void wh_client_on_new_popup(struct wl_listener* listener, void* data);
+
 void wh_client_on_new_xdg_decoration(struct wl_listener* listener, void* data);
 
+/**
+ * Get the client owning the given surface, this may be the surface of a
+ * toplevel, of a popup or any of their subsurfaces.
+ *
+ * @returns The owning client or NULL if the surface isn't one of a client.
+ */
+WhaleClient* wh_client_from_surface(const struct wlr_surface* surface);
+
+/**
+ * Get the client and the exact surface at the given (output layout) coords.
+ *
+ * @param x X coordinate
+ * @param y Y coordinate
+ * @param comp The whale compositor
+ * @param surface Set to the surface under the point, may be NULL.
+ * @param sx Set to the point's X coordinate relative to `surface`, may be
+ * NULL.
+ * @param sy Set to the point's Y coordinate relative to `surface`, may be
+ * NULL.
+ *
+ * @returns Pointer to the client at the given coords.
+ * @returns NULL if there is no client at the given coords.
+ */
+WhaleClient* wh_client_surface_at(
+    wh_coord_t x,
+    wh_coord_t y,
+    const WhaleCompositor* comp,
+    struct wlr_surface** surface,
+    double* sx,
+    double* sy
+);
+
 /**
  * Get the client at the given (output layout (resolution)) coords. The
  * client is considered if the point at x, y can receive input focus.
@@ -51,4 +237,26 @@ WhaleClient* wh_client_get_at_coords(
     wh_coord_t x, wh_coord_t y, const WhaleCompositor* comp
 );
 
+/**
+ * Let the user place the client, its current position and size are kept.
+ */
+void wh_client_float(WhaleClient* client);
+
+/**
+ * Move a floating client's decoration corner to the given layout coords.
+ */
+void wh_client_move(WhaleClient* client, int x, int y);
+
+/**
+ * Resize a floating client. The client is asked for the new size, the
+ * position follows once it draws it so the edges opposite to `edges` stay
+ * put.
+ *
+ * @param box Position of the decoration corner and size of the content.
+ * @param edges enum wlr_edges being dragged.
+ */
+void wh_client_resize(
+    WhaleClient* client, const struct wlr_box* box, u32 edges
+);
+
 #endif // !_WHALE_CLIENT_H
@@ -14,23 +14,39 @@
 #include <wlr/types/wlr_xdg_decoration_v1.h>
 #include <wlr/types/wlr_xdg_shell.h>
 
-typedef struct
-{
-    struct wlr_keyboard_group* wlr_keyboard_group;
-    struct wl_event_source* key_repeat_source;
-} KeyboardGroup;
-
-typedef struct
+#include <whale/config.h>
+#include <whale/decoration.h>
+#include <whale/dump.h>
+#include <whale/grab.h>
+#include <whale/idle.h>
+#include <whale/ipc.h>
+#include <whale/keybind.h>
+#include <whale/keymap.h>
+#include <whale/memory.h>
+#include <whale/pacing.h>
+#include <whale/seat.h>
+#include <whale/throttle.h>
+#ifdef WH_XWAYLAND
+#include <whale/xwayland.h>
+#endif
+
+typedef struct WhaleCompositor
 {
     struct wl_display* display;
     struct wlr_backend* backend;
+    /* Child of `backend` virtual outputs are made on */
+    struct wlr_backend* headless_backend;
     struct wlr_session* session;
     struct wlr_renderer* renderer;
 
+    /* The config file and what was last loaded from it */
+    WhaleConfigFile config;
+
     struct wlr_scene* root_scene;
     struct wlr_scene_rect* root_bg_rect;
 
     struct wlr_allocator* allocator;
+    struct wlr_compositor* compositor;
 
     /* List of attached outputs */
     struct wl_list outputs;
@@ -39,17 +55,64 @@ typedef struct
 
     /* List of clients */
     struct wl_list clients;
+    u32 next_client_id;
 
     struct wlr_xdg_decoration_manager_v1* xdg_decoration_manager;
+    WhaleDecorations decorations;
+
+    /* Toplevels advertised to capture tools */
+    struct wlr_ext_foreign_toplevel_list_v1* foreign_toplevel_list;
 
     /* Order of focused clients */
     // struct wl_list focus_order;
 
-    struct wlr_cursor* cursor;
+    /* Every seat, the default one first */
+    struct wl_list seats;
+    WhaleSeat* default_seat;
+    /* Seat that saw input last */
+    WhaleSeat* active_seat;
+
+    /* Shared by every seat's cursor */
     struct wlr_xcursor_manager* cursor_manager;
+    struct wlr_pointer_gestures_v1* pointer_gestures;
+    struct wlr_tablet_manager_v2* tablet_manager;
+
+    /* Bumped whenever what is under a point may have changed, the seats'
+    hit caches are only valid for the serial they were made with. */
+    u32 scene_serial;
+
+    WhaleKeymapCache keymap_cache;
+    /* Wakes the loop when a keymap prefetch is done */
+    struct wl_event_source* keymap_source;
+    /* Keyboards wait for their new keymaps to compile, see
+    wh_input_keymaps_changed() */
+    bool keymaps_pending;
+    u32 keymaps_next;
+
+    /* Spawned processes not reaped yet, see spawn.c */
+    struct wl_list children;
+    /* Only used if the kernel can't give us pidfds */
+    struct wl_event_source* sigchld_source;
 
-    struct wlr_seat* seat;
-    KeyboardGroup keyboard_group;
+    WhaleIpc ipc;
+
+    /* Per-client accounting and throttling */
+    WhaleThrottle throttle;
+    WhaleMemoryConfig memory;
+    WhaleDumper dumper;
+
+    WhaleIdle idle;
+
+    /* fifo and commit-timing, commits held until their refresh */
+    WhalePacing pacing;
+
+#ifdef WH_XWAYLAND
+    WhaleXwayland xwayland;
+#endif
+
+    /* Compiled compositor keybindings and the active binding mode */
+    WhaleKeybindTable keybinds;
+    u32 keybind_mode;
 
     /* Listeners */
     struct
@@ -58,19 +121,10 @@ typedef struct
         struct wl_listener output_layout_change;
 
         struct wl_listener xdg_new_toplevel;
+        struct wl_listener xdg_new_popup;
         struct wl_listener xdg_new_decoration;
 
-        struct wl_listener cursor_motion;
-        struct wl_listener cursor_motion_absolute;
-        struct wl_listener cursor_button;
-        struct wl_listener cursor_axis;
-        struct wl_listener cursor_frame;
-
-        struct wl_listener seat_request_set_cursor;
-        struct wl_listener seat_request_set_selection;
-
-        struct wl_listener keyboard_key;
-        struct wl_listener keyboard_modifier;
+        struct wl_listener toplevel_capture_request;
 
         struct wl_listener new_input;
     } listeners;
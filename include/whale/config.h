@@ -0,0 +1,146 @@
+#ifndef _WHALE_CONFIG_H
+#define _WHALE_CONFIG_H
+
+#include <stddef.h>
+#include <wayland-server-core.h>
+#include <whale/decoration.h>
+#include <whale/idle.h>
+#include <whale/keybind.h>
+#include <whale/keymap.h>
+#include <whale/memory.h>
+#include <whale/seat.h>
+#include <whale/throttle.h>
+#include <whale/types.h>
+
+typedef struct WhaleCompositor WhaleCompositor;
+
+/*
+ * Config file
+ *
+ * Read from $WHALE_CONFIG, $XDG_CONFIG_HOME/whale/config or
+ * ~/.config/whale/config, and reloaded whenever it is written. A file that
+ * doesn't parse is ignored as a whole and the current config stays. One
+ * command per line, lines starting with `#` are comments and arguments with
+ * spaces are quoted:
+ *
+ *   background <rrggbb[aa]>
+ *   keyboard ["<device>"] rules|model|layout|variant|options <value>
+ *   repeat <rate> <delay ms>
+ *   cursor theme <name> | cursor size <px>
+ *   output <name> mode <width>x<height>[@<hz>] | output <name> scale <scale>
+ *   mode <name>                     following binds are in that mode
+ *   bind [--repeat] <mods+key> spawn <command line> | close | quit | reload
+ *   bind [--repeat] <mods+key> mode <name> | chvt <n>
+ *   bind [--repeat] <mods+key> add-output <width>x<height>[@<hz>]
+ *   bind [--repeat] <mods+key> remove-output <name>
+ *   idle <seconds, 0 never>          WHALE_DPMS_TIMEOUT sets the default
+ *   throttle commits|buffers|requests|fps <n>
+ *   memory limit <MiB> | memory kill yes|no
+ *   decoration border|title <px> | decoration font <pango font>
+ *   decoration focused|unfocused border|title|text <rrggbb[aa]>
+ *   exec <command line>              run through /bin/sh once at startup
+ *   seat "<device>" <seat name>
+ *
+ * Without any bind the default keybindings are used. A held key runs its
+ * binding once, unless it was bound with --repeat. Devices without a seat
+ * are on seat_0, a device only changes seats when it is plugged in again.
+ */
+
+/* Mode and scale of the output named `name`. */
+typedef struct
+{
+    const char* name;
+    /* 0 for the preferred mode */
+    s32 width;
+    s32 height;
+    /* mHz, 0 for any */
+    s32 refresh;
+    /* 0 for 1 */
+    float scale;
+} WhaleOutputConfig;
+
+typedef struct
+{
+    float background[4];
+
+    /* Keyboard keymaps, the last entry matches every device */
+    WhaleDeviceKeymap* keymaps;
+    size_t num_keymaps;
+    s32 repeat_rate;
+    s32 repeat_delay;
+
+    /* NULL for the default theme */
+    const char* cursor_theme;
+    u32 cursor_size;
+
+    WhaleOutputConfig* outputs;
+    size_t num_outputs;
+
+    WhaleKeybind* binds;
+    size_t num_binds;
+
+    WhaleDeviceSeat* seats;
+    size_t num_seats;
+
+    /* Command lines of `exec`, reloads don't run them again */
+    const char** autostart;
+    size_t num_autostart;
+
+    WhaleIdleConfig idle;
+    WhaleThrottleConfig throttle;
+    WhaleMemoryConfig memory;
+    WhaleDecorationStyle decoration;
+
+    /* Every string above points into this */
+    char* text;
+} WhaleConfig;
+
+/* The file and its inotify watch. */
+typedef struct
+{
+    WhaleConfig current;
+
+    char* path;
+    int inotify_fd;
+    struct wl_event_source* inotify_source;
+    /* Editors write a file in several steps, a reload waits for them */
+    struct wl_event_source* reload_timer;
+} WhaleConfigFile;
+
+/**
+ * Load the config file, or the defaults if there is none or it doesn't
+ * parse, and start watching it. Must be called before any other module is
+ * initialized, they take their settings from it.
+ *
+ * @returns 0 on success or a negative value if out of memory.
+ */
+int wh_config_init(WhaleCompositor* comp);
+
+void wh_config_finish(WhaleCompositor* comp);
+
+/**
+ * Read the config file again and apply what changed, everything else is
+ * left untouched.
+ *
+ * @returns 0 on success or a negative value if the file doesn't parse.
+ */
+int wh_config_reload(WhaleCompositor* comp);
+
+/**
+ * Get the config entry of the named output.
+ *
+ * @returns The entry or NULL if the output isn't configured.
+ */
+const WhaleOutputConfig*
+wh_config_output(const WhaleConfig* config, const char* name);
+
+/**
+ * Parse a mode written as `<width>x<height>[@<hz>]`.
+ *
+ * @returns true if it parsed, `refresh` is in mHz and 0 without a rate.
+ */
+bool wh_config_parse_mode(
+    const char* str, s32* width, s32* height, s32* refresh
+);
+
+#endif // !_WHALE_CONFIG_H
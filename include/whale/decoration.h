@@ -0,0 +1,98 @@
+
+#ifndef _WHALE_DECORATION_H
+#define _WHALE_DECORATION_H
+
+#include <wayland-server-core.h>
+#include <whale/types.h>
+
+typedef struct WhaleCompositor WhaleCompositor;
+typedef struct WhaleClient WhaleClient;
+
+typedef struct
+{
+    float border[4];
+    float title[4];
+    float text[4];
+} WhaleDecorationColors;
+
+typedef struct
+{
+    int border_width;
+    int title_height;
+    /* Pango font description */
+    const char* font;
+
+    WhaleDecorationColors focused;
+    WhaleDecorationColors unfocused;
+} WhaleDecorationStyle;
+
+/* Server-side decoration of a client, a frame of scene rects around it and
+a pre-rendered title bar. */
+typedef struct
+{
+    /* NULL until the client first gets server-side decorations */
+    struct wlr_scene_tree* tree;
+    /* Top, bottom, left, right */
+    struct wlr_scene_rect* borders[4];
+    struct wlr_scene_buffer* title;
+
+    /* What is drawn, nothing is redone while it stays the same */
+    char* drawn_title;
+    int drawn_width;
+    int drawn_height;
+    bool drawn_focused;
+} WhaleDecoration;
+
+typedef struct
+{
+    WhaleDecorationStyle style;
+
+    /* Rendered title bars, most recently used first, see decoration.c */
+    struct wl_list titles;
+    u32 num_titles;
+} WhaleDecorations;
+
+/**
+ * Init the title cache, with the style from the config.
+ */
+void wh_decoration_init(WhaleCompositor* comp);
+
+void wh_decoration_finish(WhaleCompositor* comp);
+
+/**
+ * Switch to another style, decorations are only redrawn if it differs from
+ * the current one.
+ */
+void wh_decoration_set_style(
+    WhaleCompositor* comp, const WhaleDecorationStyle* style
+);
+
+/**
+ * Space the decoration takes on each side of the client's content, all 0
+ * when the client draws its own decorations.
+ */
+void wh_decoration_insets(
+    const WhaleClient* client, int* left, int* right, int* top, int* bottom
+);
+
+/**
+ * Bring the client's decoration in line with its title, content size and
+ * focus. Does nothing if none of them changed since the last call.
+ */
+void wh_decoration_update(WhaleClient* client);
+
+void wh_decoration_destroy(WhaleClient* client);
+
+/**
+ * Get the client whose decoration is at the given layout coords.
+ *
+ * @param edges Set to the enum wlr_edges of the border at the point, 0 on
+ * the title bar.
+ *
+ * @returns The client or NULL if there is no decoration at the point.
+ */
+WhaleClient* wh_decoration_at(
+    const WhaleCompositor* comp, double x, double y, u32* edges
+);
+
+#endif // !_WHALE_DECORATION_H
@@ -0,0 +1,82 @@
+
+#ifndef _WHALE_DUMP_H
+#define _WHALE_DUMP_H
+
+#include <pthread.h>
+#include <wayland-util.h>
+#include <whale/types.h>
+
+typedef struct WhaleCompositor WhaleCompositor;
+typedef struct WhaleOutput WhaleOutput;
+
+typedef enum
+{
+    WH_DUMP_OFF = 0,
+    /* Dump the next frame, then turn off */
+    WH_DUMP_ONCE,
+    WH_DUMP_EVERY_FRAME,
+} WhaleDumpMode;
+
+typedef enum
+{
+    WH_DUMP_PNG = 0,
+    WH_DUMP_QOI,
+    /* Tightly packed RGBA, the size is in the file name */
+    WH_DUMP_RAW,
+} WhaleDumpFormat;
+
+/* Writes output contents to files from a background thread. */
+typedef struct
+{
+    /* Directory the files go to */
+    const char* dir;
+
+    /* Mode and format new outputs start with, set by WHALE_DUMP */
+    WhaleDumpMode default_mode;
+    WhaleDumpFormat default_format;
+
+    /* Started on the first dump */
+    pthread_t thread;
+    bool running;
+
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    /* Frames waiting to be encoded, see dump.c */
+    struct wl_list queue;
+    u32 queued;
+    /* Encoded frames kept around so their pixels can be reused */
+    struct wl_list free;
+
+    /* Frames dropped because the encoder fell behind */
+    u64 dropped;
+} WhaleDumper;
+
+/**
+ * Init the dumper. WHALE_DUMP=png|qoi|raw dumps every frame of every output
+ * from the start, into WHALE_DUMP_DIR (or the working directory).
+ */
+void wh_dump_init(WhaleCompositor* comp);
+
+/**
+ * Stop the encoder thread, frames still queued are written first.
+ */
+void wh_dump_finish(WhaleCompositor* comp);
+
+/**
+ * Change how an output is dumped. A WH_DUMP_ONCE request renders a frame
+ * even if nothing changed.
+ */
+void wh_dump_output_set(
+    WhaleOutput* output, WhaleDumpMode mode, WhaleDumpFormat format
+);
+
+/**
+ * Commit the output's next frame and queue its contents for encoding.
+ * Used instead of wlr_scene_output_commit() while the output is dumped, it
+ * only copies the frame and never waits for the encoder, frames are dropped
+ * if it falls behind. Dumping stops on outputs whose buffers the CPU can't
+ * read, as with GPU renderers.
+ */
+void wh_dump_output_commit(WhaleOutput* output);
+
+#endif // !_WHALE_DUMP_H
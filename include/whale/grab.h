@@ -0,0 +1,65 @@
+
+#ifndef _WHALE_GRAB_H
+#define _WHALE_GRAB_H
+
+#include <whale/types.h>
+#include <wlr/util/box.h>
+
+typedef struct WhaleCompositor WhaleCompositor;
+typedef struct WhaleClient WhaleClient;
+typedef struct WhaleSeat WhaleSeat;
+
+typedef enum
+{
+    WH_GRAB_NONE = 0,
+    WH_GRAB_MOVE,
+    WH_GRAB_RESIZE,
+} WhaleGrabMode;
+
+/* An interactive move or resize, driven by a seat's pointer until its
+buttons are released. */
+typedef struct
+{
+    WhaleGrabMode mode;
+    WhaleClient* client;
+    /* enum wlr_edges being dragged, resizes only */
+    u32 edges;
+
+    /* Cursor position and client box when the grab started */
+    double start_x;
+    double start_y;
+    struct wlr_box start_box;
+
+    /* The cursor moved since the grab was last applied */
+    bool pending;
+} WhaleGrab;
+
+/**
+ * Start moving or resizing the client with the seat's pointer. The seat's
+ * pointer events stop going to clients until the grab ends, a client is
+ * only grabbed by one seat at a time.
+ */
+void wh_grab_begin(
+    WhaleSeat* seat, WhaleClient* client, WhaleGrabMode mode, u32 edges
+);
+
+/**
+ * Note that the cursor moved. Nothing is moved or resized until the next
+ * output frame, however many motion events come in before it.
+ */
+void wh_grab_motion(WhaleSeat* seat);
+
+/**
+ * Apply every seat's cursor motion since the last frame, called before
+ * outputs render.
+ */
+void wh_grab_apply(WhaleCompositor* comp);
+
+void wh_grab_end(WhaleSeat* seat);
+
+/**
+ * End the grab holding the client, if any, it is going away.
+ */
+void wh_grab_client_gone(WhaleClient* client);
+
+#endif // !_WHALE_GRAB_H
@@ -0,0 +1,67 @@
+
+#ifndef _WHALE_IDLE_H
+#define _WHALE_IDLE_H
+
+#include <wayland-server-core.h>
+#include <whale/types.h>
+
+typedef struct WhaleCompositor WhaleCompositor;
+struct wlr_seat;
+
+typedef struct
+{
+    /* Outputs are turned off after this long without input, 0 never */
+    u32 dpms_timeout_ms;
+} WhaleIdleConfig;
+
+/* Idle tracking: ext-idle-notify, idle-inhibit and turning outputs off. */
+typedef struct
+{
+    WhaleIdleConfig config;
+
+    struct wlr_idle_notifier_v1* notifier;
+    struct wlr_idle_inhibit_manager_v1* inhibit_manager;
+    struct wlr_output_power_manager_v1* power_manager;
+
+    /* Live inhibitors, see idle.c */
+    struct wl_list inhibitors;
+
+    /* Only armed while outputs are on, it checks the time of the last input
+    when it fires instead of being re-armed by every event. */
+    struct wl_event_source* dpms_timer;
+    bool timer_armed;
+    /* CLOCK_MONOTONIC ms of the last input */
+    u64 last_activity_ms;
+
+    /* Some outputs were turned off by the timeout */
+    bool blanked;
+
+    struct
+    {
+        struct wl_listener new_inhibitor;
+        struct wl_listener power_set_mode;
+    } listeners;
+} WhaleIdle;
+
+/**
+ * Create the idle and power management globals, with the timeout from the
+ * config.
+ *
+ * @returns 0 on success or a negative value on failure.
+ */
+int wh_idle_init(WhaleCompositor* comp);
+
+void wh_idle_finish(WhaleCompositor* comp);
+
+/**
+ * Change the timeout, counted from the last input as before.
+ */
+void wh_idle_set_config(WhaleCompositor* comp, const WhaleIdleConfig* config);
+
+/**
+ * Note user input on the seat, see wh_seat_activity(). Outputs turned off
+ * by the timeout come back on right away, whichever seat woke them.
+ */
+void wh_idle_activity(WhaleCompositor* comp, struct wlr_seat* seat);
+
+#endif // !_WHALE_IDLE_H
@@ -4,6 +4,71 @@
 
 #include <whale/compositor.h>
 
+/**
+ * Set up the keymap cache and start compiling the default keymap in the
+ * background. The cursor theme is exported to the environment first, as
+ * nothing may call setenv() while the keymap compiles. Must be called before
+ * wh_input_init().
+ *
+ * @returns 0 on success or a negative value on failure.
+ */
+int wh_input_keymap_prefetch(WhaleCompositor* comp);
+
+/**
+ * Create the shared cursor theme and the default seat, then start taking
+ * input devices.
+ *
+ * @returns 0 on success or a negative value on failure.
+ */
 int wh_input_init(WhaleCompositor* comp);
 
+/**
+ * Give a new seat its cursor and default keyboard group, called by
+ * wh_seat_create().
+ *
+ * @returns 0 on success or a negative value on failure.
+ */
+int wh_input_seat_init(WhaleSeat* seat);
+
+/**
+ * The seat's cursor moved to where it is now, update pointer focus or the grab.
+ *
+ * @param time_msec Time of the input event, as given by the device.
+ */
+void wh_input_cursor_motion(WhaleSeat* seat, u32 time_msec);
+
+/**
+ * A pointer button, or a tablet tool emulating one, changed state. Starts
+ * the decoration drags and ends grabs with the last button released.
+ */
+void wh_input_pointer_button(
+    WhaleSeat* seat,
+    u32 time_msec,
+    u32 button,
+    enum wl_pointer_button_state state
+);
+
+/**
+ * The configured keymaps changed, move every keyboard whose keymap differs
+ * now to the group of its new one. Keymaps missing from the cache are
+ * compiled in the background first, the keyboards move once all are ready.
+ */
+void wh_input_keymaps_changed(WhaleCompositor* comp);
+
+/**
+ * The configured key repeat rate or delay changed.
+ */
+void wh_input_repeat_changed(WhaleCompositor* comp);
+
+/**
+ * The configured cursor theme or size changed, load it for every seat.
+ */
+void wh_input_cursor_theme_changed(WhaleCompositor* comp);
+
+/**
+ * Stop repeating held keybindings on every seat, the bindings they point to
+ * are about to go away.
+ */
+void wh_input_key_repeat_cancel(WhaleCompositor* comp);
+
 #endif // !_WHALE_INPUT_H
@@ -0,0 +1,130 @@
+
+#ifndef _WHALE_IPC_H
+#define _WHALE_IPC_H
+
+#include <wayland-server-core.h>
+#include <whale/types.h>
+
+typedef struct WhaleCompositor WhaleCompositor;
+typedef struct WhaleClient WhaleClient;
+typedef struct WhaleOutput WhaleOutput;
+
+/*
+ * Wire format
+ *
+ * The socket is a SOCK_STREAM unix socket whose path is exported to spawned
+ * programs as WHALE_IPC_SOCKET. Every message, in both directions, is a
+ * WhaleIpcHeader followed by `length` bytes of payload. All integers are in
+ * host byte order, strings are a u16 length followed by that many bytes
+ * (no terminator).
+ *
+ * Requests and their replies share a type:
+ *   WH_IPC_GET_OUTPUTS  -> u32 count, `count` output records
+ *   WH_IPC_GET_CLIENTS  -> u32 count, `count` client records
+ *   WH_IPC_SUBSCRIBE    u32 WH_IPC_EVENT_* mask -> u32 mask
+ *   WH_IPC_COMMAND      u16 WhaleAction, string arg -> s32 status
+ *   WH_IPC_GET_STATS    -> u32 count, `count` connection records
+ *   WH_IPC_GET_MEMORY   -> u32 count, `count` memory records
+ *   WH_IPC_DUMP         u8 WhaleDumpMode, u8 WhaleDumpFormat, string output
+ *                       (empty for every output) -> s32 status
+ *
+ * Events are only sent to subscribers and are written once per event-loop
+ * iteration:
+ *   WH_IPC_EVENT_CLIENT_CHANGE  client record
+ *   WH_IPC_EVENT_CLIENT_CLOSE   u32 id
+ *   WH_IPC_EVENT_FOCUS          u32 id, 0 if nothing has focus (of the
+ *                               seat whose focus changed)
+ *   WH_IPC_EVENT_OUTPUT_CHANGE  output record
+ *   WH_IPC_EVENT_OUTPUT_REMOVE  string name
+ *
+ * Client record: u32 id, s32 x, s32 y, u32 width, u32 height, u8 mapped,
+ * u8 focused (by any seat), string title.
+ *
+ * Output record: string name, s32 x, s32 y, u32 width, u32 height,
+ * s32 refresh (mHz), u8 enabled.
+ *
+ * Connection record: s32 pid, u32 commits, u32 buffers, u32 requests,
+ * u8 throttled. Counters are per second, over the last complete second.
+ *
+ * Memory record: u32 client id, u32 buffers, u32 swapchain depth,
+ * u64 shm bytes, u64 dmabuf bytes, u64 peak bytes.
+ */
+
+/* Largest request payload whale accepts */
+#define WH_IPC_MAX_PAYLOAD 4096
+
+typedef struct
+{
+    u32 length;
+    u16 type;
+    u16 reserved;
+} WhaleIpcHeader;
+
+typedef enum
+{
+    WH_IPC_GET_OUTPUTS = 1,
+    WH_IPC_GET_CLIENTS,
+    WH_IPC_SUBSCRIBE,
+    WH_IPC_COMMAND,
+    WH_IPC_GET_STATS,
+    WH_IPC_GET_MEMORY,
+    WH_IPC_DUMP,
+
+    WH_IPC_EVENT_CLIENT_CHANGE = 0x100,
+    WH_IPC_EVENT_CLIENT_CLOSE,
+    WH_IPC_EVENT_FOCUS,
+    WH_IPC_EVENT_OUTPUT_CHANGE,
+    WH_IPC_EVENT_OUTPUT_REMOVE,
+} WhaleIpcType;
+
+/* Subscription mask bits */
+typedef enum
+{
+    WH_IPC_EVENTS_CLIENT = 1 << 0,
+    WH_IPC_EVENTS_FOCUS = 1 << 1,
+    WH_IPC_EVENTS_OUTPUT = 1 << 2,
+} WhaleIpcEvents;
+
+typedef struct
+{
+    WhaleCompositor* comp;
+
+    int fd;
+    char* path;
+    struct wl_event_source* source;
+
+    /* Idle source writing out the queues, NULL if none is scheduled */
+    struct wl_event_source* flush_idle;
+
+    /* Connected programs, see ipc.c */
+    struct wl_list connections;
+    /* Union of every connection's subscriptions */
+    u32 subscribed;
+} WhaleIpc;
+
+/**
+ * Create the IPC socket and export its path as WHALE_IPC_SOCKET.
+ *
+ * @param socket_name Name of the Wayland socket, the IPC socket is named
+ * after it.
+ *
+ * @returns 0 on success or a negative value on failure.
+ */
+int wh_ipc_init(WhaleCompositor* comp, const char* socket_name);
+
+void wh_ipc_finish(WhaleCompositor* comp);
+
+/* Event sources, these are no-ops while nobody subscribed to them. */
+
+void wh_ipc_client_changed(WhaleCompositor* comp, const WhaleClient* client);
+
+void wh_ipc_client_closed(WhaleCompositor* comp, const WhaleClient* client);
+
+/* A seat's keyboard focus moved to the client, NULL if to nothing */
+void wh_ipc_focus_changed(WhaleCompositor* comp, const WhaleClient* client);
+
+void wh_ipc_output_changed(WhaleCompositor* comp, const WhaleOutput* output);
+
+void wh_ipc_output_removed(WhaleCompositor* comp, const WhaleOutput* output);
+
+#endif // !_WHALE_IPC_H
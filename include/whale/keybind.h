@@ -0,0 +1,133 @@
+
+#ifndef _WHALE_KEYBIND_H
+#define _WHALE_KEYBIND_H
+
+#include <stddef.h>
+#include <whale/types.h>
+#include <xkbcommon/xkbcommon.h>
+
+typedef struct WhaleCompositor WhaleCompositor;
+
+typedef enum
+{
+    WH_ACTION_NONE = 0,
+    /* Run `arg` as a program */
+    WH_ACTION_SPAWN,
+    /* Ask the focused client to close */
+    WH_ACTION_CLOSE,
+    /* Switch to the binding mode named `arg` */
+    WH_ACTION_MODE,
+    /* Switch to the virtual terminal number `arg` */
+    WH_ACTION_CHVT,
+    /* Terminate the compositor */
+    WH_ACTION_QUIT,
+    /* Read the config file again */
+    WH_ACTION_RELOAD,
+    /* Create a virtual output of the mode `arg`, see wh_output_add_virtual() */
+    WH_ACTION_OUTPUT_ADD,
+    /* Destroy the virtual output named `arg` */
+    WH_ACTION_OUTPUT_REMOVE,
+} WhaleAction;
+
+/* A keybinding as it is written in the configuration. */
+typedef struct
+{
+    /* Binding mode this binding is active in, NULL for "default" */
+    const char* mode;
+    /* Mask of WLR_MODIFIER_* */
+    u32 mods;
+    /* Level-0 keysym (i.e. `q`, never `Q`) */
+    xkb_keysym_t keysym;
+
+    WhaleAction action;
+    const char* arg;
+
+    /* Run again while the key is held, off unless asked for */
+    bool repeat;
+} WhaleKeybind;
+
+/* A keybinding resolved for the key path. */
+typedef struct
+{
+    /* Packed (mode, mods, keysym), 0 marks an empty slot */
+    u64 key;
+
+    WhaleAction action;
+    /* Target mode index for WH_ACTION_MODE */
+    u32 target_mode;
+    const char* arg;
+    bool repeat;
+} WhaleCompiledKeybind;
+
+typedef struct
+{
+    /* Open-addressed table, its size is always a power of two */
+    WhaleCompiledKeybind* slots;
+    u32 mask;
+
+    /* Mode names, index 0 is always "default" */
+    char** modes;
+    u32 num_modes;
+
+    /* Single allocation holding every `arg` string */
+    char* strings;
+} WhaleKeybindTable;
+
+/**
+ * Compile a list of keybindings into a lookup table. Later duplicates of the
+ * same (mode, mods, keysym) override earlier ones.
+ *
+ * @param table The table to fill, must be zeroed or finished.
+ * @param binds Bindings to compile.
+ * @param num_binds Number of bindings.
+ *
+ * @returns 0 on success or a negative value on failure.
+ */
+int wh_keybind_table_compile(
+    WhaleKeybindTable* table, const WhaleKeybind* binds, size_t num_binds
+);
+
+void wh_keybind_table_finish(WhaleKeybindTable* table);
+
+/**
+ * Find the binding for the given key combination. Does not allocate.
+ *
+ * @returns The binding or NULL if the combination is not bound.
+ */
+const WhaleCompiledKeybind* wh_keybind_lookup(
+    const WhaleKeybindTable* table, u32 mode, u32 mods, xkb_keysym_t keysym
+);
+
+/**
+ * Compile the configured keybindings, or the default ones if there are none,
+ * into the compositor's table.
+ *
+ * @returns 0 on success or a negative value on failure.
+ */
+int wh_keybind_init(WhaleCompositor* comp);
+
+/**
+ * Recompile the keybindings after the config changed. The binding mode stays
+ * the same if it still exists. The previous table is kept on failure.
+ *
+ * @returns 0 on success or a negative value on failure.
+ */
+int wh_keybind_reload(WhaleCompositor* comp);
+
+/**
+ * Run an action outside of any binding, MODE actions take the mode's name
+ * as `arg`.
+ *
+ * @returns 0 on success or a negative value if the action failed or `arg`
+ * doesn't fit it.
+ */
+int wh_keybind_run_action(
+    WhaleCompositor* comp, WhaleAction action, const char* arg
+);
+
+/**
+ * Run the action of a binding.
+ */
+void wh_keybind_run(WhaleCompositor* comp, const WhaleCompiledKeybind* bind);
+
+#endif // !_WHALE_KEYBIND_H
@@ -0,0 +1,98 @@
+
+#ifndef _WHALE_KEYMAP_H
+#define _WHALE_KEYMAP_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <wayland-util.h>
+#include <whale/types.h>
+#include <xkbcommon/xkbcommon.h>
+
+/* Keymap of the keyboards whose name matches `device`. */
+typedef struct
+{
+    /* Matched against wlr_input_device::name, NULL matches every device */
+    const char* device;
+    struct xkb_rule_names names;
+} WhaleDeviceKeymap;
+
+typedef struct
+{
+    struct xkb_context* xkb_context;
+
+    /* Compiled keymaps, see keymap.c */
+    struct wl_list entries;
+
+    /* Directory holding serialized keymaps, NULL if there is none */
+    char* dir;
+    /* Changes whenever the installed xkb data does */
+    u64 data_stamp;
+
+    /* Background compile started by wh_keymap_cache_prefetch(), the names
+    are resolved copies owned by the cache and hashed on the main thread */
+    pthread_t prefetch_thread;
+    struct xkb_rule_names prefetch_names;
+    u64 prefetch_hash;
+    bool prefetching;
+    /* Set by the thread once it is done, it also makes prefetch_fd
+    readable then. -1 if there is no eventfd. */
+    atomic_bool prefetch_done;
+    int prefetch_fd;
+} WhaleKeymapCache;
+
+/**
+ * Init the keymap cache. Failing to set up the on-disk cache is not fatal,
+ * keymaps will only be cached in memory.
+ *
+ * @returns 0 on success or a negative value on failure.
+ */
+int wh_keymap_cache_init(WhaleKeymapCache* cache);
+
+void wh_keymap_cache_finish(WhaleKeymapCache* cache);
+
+/**
+ * Start getting the keymap for the given rule names on a background thread,
+ * so compiling it overlaps with the rest of startup or with the event loop.
+ * The next call touching the cache waits for it to finish, poll prefetch_fd
+ * to know when that won't block.
+ *
+ * @returns 0 on success or a negative value if no thread could be started.
+ */
+int wh_keymap_cache_prefetch(
+    WhaleKeymapCache* cache, const struct xkb_rule_names* names
+);
+
+/**
+ * Wait for a running prefetch to finish. Nothing may call setenv() while
+ * one runs, xkbcommon can still read the environment on its thread.
+ */
+void wh_keymap_cache_wait(WhaleKeymapCache* cache);
+
+/**
+ * @returns true if a prefetch is still running, touching the cache would
+ * block until it is done.
+ */
+bool wh_keymap_cache_busy(WhaleKeymapCache* cache);
+
+/**
+ * Whether the keymap for the given rule names is in memory already, getting
+ * it then doesn't compile or read anything.
+ */
+bool wh_keymap_cache_contains(
+    WhaleKeymapCache* cache, const struct xkb_rule_names* names
+);
+
+/**
+ * Get the keymap for the given rule names, compiling it only if neither the
+ * memory nor the disk cache have it. Rule names that end up producing the
+ * same keymap share the same `xkb_keymap`, so comparing pointers is enough to
+ * tell whether two keymaps are identical.
+ *
+ * @returns A keymap owned by the cache, valid until the cache is finished.
+ * @returns NULL if the keymap failed to compile.
+ */
+struct xkb_keymap* wh_keymap_cache_get(
+    WhaleKeymapCache* cache, const struct xkb_rule_names* names
+);
+
+#endif // !_WHALE_KEYMAP_H
@@ -0,0 +1,66 @@
+
+#ifndef _WHALE_MEMORY_H
+#define _WHALE_MEMORY_H
+
+#include <wayland-server-core.h>
+#include <whale/types.h>
+
+typedef struct WhaleCompositor WhaleCompositor;
+typedef struct WhaleClient WhaleClient;
+struct wlr_surface;
+
+typedef struct
+{
+    /* Bytes of buffers a client may hold before it is reported, 0 disables
+    the limit */
+    u64 soft_limit;
+    /* Disconnect clients going over the limit instead of only logging */
+    bool kill;
+} WhaleMemoryConfig;
+
+/* Buffers a client attached to its surfaces and didn't destroy yet. */
+typedef struct
+{
+    /* Live buffers, see memory.c */
+    struct wl_list buffers;
+    u32 count;
+
+    u64 shm_bytes;
+    u64 dmabuf_bytes;
+    /* Highest shm_bytes + dmabuf_bytes ever reached */
+    u64 peak_bytes;
+
+    /* Set while over WhaleMemoryConfig::soft_limit */
+    bool over_limit;
+} WhaleBufferStats;
+
+/**
+ * Dump every client's buffer usage to the log on SIGUSR1. Must be called
+ * before any thread is started, so the signal stays blocked in all of them.
+ *
+ * @returns 0 on success or a negative value on failure.
+ */
+int wh_memory_init(WhaleCompositor* comp);
+
+void wh_memory_stats_init(WhaleBufferStats* stats);
+
+void wh_memory_stats_finish(WhaleBufferStats* stats);
+
+/**
+ * Account the buffer attached by a commit the client just made, call it
+ * before the commit is applied.
+ */
+void wh_memory_account_commit(WhaleClient* client, struct wlr_surface* surface);
+
+/**
+ * Get the highest number of live buffers a single surface of the client
+ * has, i.e. its swapchain depth.
+ */
+u32 wh_memory_swapchain_depth(const WhaleBufferStats* stats);
+
+/**
+ * Log the buffer usage of every client.
+ */
+void wh_memory_dump(WhaleCompositor* comp);
+
+#endif // !_WHALE_MEMORY_H
@@ -4,13 +4,34 @@
 
 #include <wayland-server-core.h>
 #define WLR_USE_UNSTABLE
+#include <whale/dump.h>
+#include <whale/types.h>
 #include <wlr/types/wlr_scene.h>
 
-typedef struct
+typedef struct WhaleCompositor WhaleCompositor;
+
+typedef struct WhaleOutput
 {
+    WhaleCompositor* comp;
+
     struct wlr_output* wlr_output;
     struct wlr_scene_output* scene_output;
 
+    /* Frame dumping, see dump.c */
+    WhaleDumpMode dump_mode;
+    WhaleDumpFormat dump_format;
+    u32 dump_seq;
+
+    /* Turned off by the idle timeout, input turns it back on */
+    bool idle_off;
+
+    /* Made by wh_output_add_virtual(), with the mode it was asked for */
+    bool is_virtual;
+    s32 virtual_width;
+    s32 virtual_height;
+    /* mHz, 0 for the backend's default */
+    s32 virtual_refresh;
+
     struct wl_listener listener_frame;
     struct wl_listener listener_destroy;
     struct wl_listener listener_request_state;
@@ -20,6 +41,40 @@ typedef struct
 
 void wh_output_on_new_output(struct wl_listener* listener, void* data);
 
+/**
+ * Set the output's mode and scale from the config, its preferred mode if it
+ * isn't configured.
+ */
+void wh_output_configure(WhaleOutput* output);
+
 void wh_output_layout_on_change(struct wl_listener* listener, void* data);
 
+/**
+ * Make sure the backend has a headless backend for virtual outputs, reusing
+ * the one asked for with WLR_BACKENDS. Call it before the backend is
+ * started. Nothing of it needs a GPU, with WLR_RENDERER=pixman whale runs
+ * as a headless render server.
+ *
+ * @returns 0 on success or a negative value on failure.
+ */
+int wh_output_virtual_init(WhaleCompositor* comp);
+
+/**
+ * Create an output that exists only in whale, of any size and refresh rate.
+ * It is paced by a timer at its refresh rate (60 Hz for 0, mHz otherwise)
+ * and can be captured like any other output.
+ *
+ * @returns The output or NULL on failure.
+ */
+WhaleOutput* wh_output_add_virtual(
+    WhaleCompositor* comp, s32 width, s32 height, s32 refresh
+);
+
+/**
+ * Destroy the named virtual output, or any other headless output.
+ *
+ * @returns 0 on success or a negative value if there is no such output.
+ */
+int wh_output_remove_virtual(WhaleCompositor* comp, const char* name);
+
 #endif // _WHALE_OUTPUT_H
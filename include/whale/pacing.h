@@ -0,0 +1,60 @@
+#ifndef _WHALE_PACING_H
+#define _WHALE_PACING_H
+
+#include <time.h>
+#include <wayland-server-core.h>
+#include <whale/types.h>
+
+typedef struct WhaleCompositor WhaleCompositor;
+struct wlr_scene_output;
+
+/* Presentation pacing: wp_fifo_v1 and wp_commit_timing_v1. */
+typedef struct
+{
+    struct wl_global* fifo_manager;
+    struct wl_global* commit_timing_manager;
+
+    /* Every surface that got a fifo or a commit timer, see pacing.c */
+    struct wl_list surfaces;
+    /* Commits held back and barriers set, the frame passes are skipped
+    while both are 0 */
+    u32 held;
+    u32 barriers;
+
+    /* Releases commits whose target time came and those of surfaces on no
+    output, which get no frames */
+    struct wl_event_source* timer;
+    bool timer_armed;
+    /* CLOCK_MONOTONIC ns it is armed for */
+    u64 timer_deadline_ns;
+} WhalePacing;
+
+/**
+ * Create the fifo and commit-timing globals, and wp_presentation so clients
+ * know the clock their target times are in.
+ *
+ * @returns 0 on success or a negative value on failure.
+ */
+int wh_pacing_init(WhaleCompositor* comp);
+
+void wh_pacing_finish(WhaleCompositor* comp);
+
+/**
+ * Apply the held commits of surfaces shown on the output that are due for
+ * the frame about to be rendered. Call it before committing the scene.
+ */
+void wh_pacing_output_frame(
+    WhaleCompositor* comp,
+    struct wlr_scene_output* scene_output,
+    const struct timespec* now
+);
+
+/**
+ * The surfaces shown on the output were latched, clear their barriers. Call
+ * it after committing the scene.
+ */
+void wh_pacing_output_latched(
+    WhaleCompositor* comp, struct wlr_scene_output* scene_output
+);
+
+#endif // !_WHALE_PACING_H
@@ -0,0 +1,196 @@
+#ifndef _WHALE_SEAT_H
+#define _WHALE_SEAT_H
+
+#define WLR_USE_UNSTABLE
+#include <wayland-server-core.h>
+#include <whale/grab.h>
+#include <whale/keybind.h>
+#include <whale/types.h>
+
+typedef struct WhaleCompositor WhaleCompositor;
+typedef struct WhaleClient WhaleClient;
+typedef struct WhaleSeat WhaleSeat;
+struct wlr_input_device;
+struct wlr_keyboard;
+struct wlr_seat;
+struct wlr_surface;
+
+/* Seat of every device the config gives no other seat */
+#define WH_SEAT_DEFAULT "seat_0"
+
+#define WH_TOUCH_MAX_POINTS 10
+
+/* Keycodes past it (KEY_MAX) never trigger bindings */
+#define WH_KEYCODE_COUNT 768
+
+/* Input devices whose name matches `device` belong to `seat`, see the
+`seat` config command. */
+typedef struct
+{
+    /* Matched against wlr_input_device::name */
+    const char* device;
+    const char* seat;
+} WhaleDeviceSeat;
+
+/* Keyboards of one seat sharing one keymap. */
+typedef struct
+{
+    WhaleSeat* seat;
+
+    struct wlr_keyboard_group* wlr_keyboard_group;
+
+    /* timerfd driving compositor-side repeat of held keybindings */
+    int key_repeat_fd;
+    struct wl_event_source* key_repeat_source;
+
+    /* Binding being repeated, NULL when no bound key is held */
+    const WhaleCompiledKeybind* repeat_bind;
+    u32 repeat_keycode;
+
+    /* Keys whose press ran a binding, their release isn't forwarded
+    either */
+    u64 bound_keys[WH_KEYCODE_COUNT / 64];
+
+    struct
+    {
+        struct wl_listener key;
+        struct wl_listener modifiers;
+    } listeners;
+
+    struct wl_list link;
+} KeyboardGroup;
+
+/* A physical keyboard, a member of the group of its keymap. */
+typedef struct
+{
+    WhaleSeat* seat;
+    struct wlr_keyboard* wlr_keyboard;
+
+    struct wl_listener destroy;
+
+    /* WhaleSeat::keyboards */
+    struct wl_list link;
+} WhaleKeyboard;
+
+/* A finger that is down on a surface. */
+typedef struct
+{
+    s32 id;
+    bool down;
+    /* Layout coords of the surface it went down on */
+    double origin_x;
+    double origin_y;
+} WhaleTouchPoint;
+
+/* Last scene lookup of a seat's cursor. Results only change at pixel
+boundaries, so events landing on the same pixel reuse it until the scene
+changes. */
+typedef struct
+{
+    bool valid;
+    /* WhaleCompositor::scene_serial when it was looked up */
+    u32 scene_serial;
+    int x;
+    int y;
+
+    /* NULL if no client is there */
+    WhaleClient* client;
+    struct wlr_surface* surface;
+    /* Layout coords of the surface's origin */
+    double surface_x;
+    double surface_y;
+} WhaleHitCache;
+
+/* A set of input devices with their own cursor, keyboard focus and grab.
+Devices are attached to the cursor and keyboard groups of their seat, so
+an event never touches any other seat. */
+typedef struct WhaleSeat
+{
+    WhaleCompositor* comp;
+    struct wlr_seat* wlr_seat;
+    struct wlr_cursor* cursor;
+
+    /* One KeyboardGroup per distinct keymap, the first is the default */
+    struct wl_list keyboard_groups;
+    /* Every WhaleKeyboard of the seat */
+    struct wl_list keyboards;
+
+    /* Interactive move or resize in progress */
+    WhaleGrab grab;
+
+    WhaleTouchPoint touch_points[WH_TOUCH_MAX_POINTS];
+    WhaleHitCache hit;
+
+    struct
+    {
+        struct wl_listener cursor_motion;
+        struct wl_listener cursor_motion_absolute;
+        struct wl_listener cursor_button;
+        struct wl_listener cursor_axis;
+        struct wl_listener cursor_frame;
+
+        struct wl_listener touch_down;
+        struct wl_listener touch_motion;
+        struct wl_listener touch_up;
+        struct wl_listener touch_cancel;
+        struct wl_listener touch_frame;
+
+        struct wl_listener swipe_begin;
+        struct wl_listener swipe_update;
+        struct wl_listener swipe_end;
+        struct wl_listener pinch_begin;
+        struct wl_listener pinch_update;
+        struct wl_listener pinch_end;
+        struct wl_listener hold_begin;
+        struct wl_listener hold_end;
+
+        struct wl_listener tablet_tool_axis;
+        struct wl_listener tablet_tool_proximity;
+        struct wl_listener tablet_tool_tip;
+        struct wl_listener tablet_tool_button;
+
+        struct wl_listener request_set_cursor;
+        struct wl_listener focus_change;
+    } listeners;
+
+    /* WhaleCompositor::seats */
+    struct wl_list link;
+} WhaleSeat;
+
+/**
+ * Create a seat with its own cursor and default keyboard group.
+ *
+ * @returns The new seat or NULL on failure.
+ */
+WhaleSeat* wh_seat_create(WhaleCompositor* comp, const char* name);
+
+/**
+ * Get the seat the device belongs to, creating it for its first device.
+ *
+ * @returns The seat or NULL if it couldn't be created.
+ */
+WhaleSeat*
+wh_seat_for_device(WhaleCompositor* comp, const struct wlr_input_device* dev);
+
+WhaleSeat* wh_seat_from_wlr_seat(const struct wlr_seat* wlr_seat);
+
+/**
+ * Note input on the seat, called by every input handler. Keybindings run
+ * on behalf of the last seat that saw input.
+ */
+void wh_seat_activity(WhaleSeat* seat);
+
+/**
+ * wh_client_surface_at() for the seat's cursor, cached per pixel until the
+ * scene changes.
+ */
+WhaleClient* wh_seat_client_at(
+    WhaleSeat* seat,
+    double x,
+    double y,
+    struct wlr_surface** surface,
+    double* sx,
+    double* sy
+);
+
+#endif // !_WHALE_SEAT_H
@@ -0,0 +1,44 @@
+
+#ifndef _WHALE_SPAWN_H
+#define _WHALE_SPAWN_H
+
+#include <sys/types.h>
+#include <wayland-util.h>
+
+typedef struct WhaleCompositor WhaleCompositor;
+
+/**
+ * Start reaping spawned children from the compositor's event loop.
+ *
+ * @returns 0 on success or a negative value on failure.
+ */
+int wh_spawn_init(WhaleCompositor* comp);
+
+/**
+ * Start a program. The child gets its own session, default signal
+ * dispositions, /dev/null as stdio and none of the compositor's other file
+ * descriptors. It is reaped from the event loop once it exits.
+ *
+ * @param argv NULL terminated argument vector, argv[0] is looked up in PATH.
+ * @param env NULL terminated list of "NAME=value" entries added to (or
+ * overriding) the compositor's environment, may be NULL.
+ *
+ * @returns The child's pid or a negative value on failure.
+ */
+pid_t wh_spawn(
+    WhaleCompositor* comp, const char* const* argv, const char* const* env
+);
+
+/**
+ * Start `command` through `/bin/sh -c`.
+ *
+ * @returns The child's pid or a negative value on failure.
+ */
+pid_t wh_spawn_command(WhaleCompositor* comp, const char* command);
+
+/**
+ * Start every `exec` command of the config.
+ */
+void wh_spawn_autostart(WhaleCompositor* comp);
+
+#endif // !_WHALE_SPAWN_H
@@ -0,0 +1,20 @@
+
+#ifndef _WHALE_STARTUP_H
+#define _WHALE_STARTUP_H
+
+/**
+ * Timestamp the end of a startup phase. Only the first mark of a phase counts
+ * and nothing is done once startup is finished, so it is cheap enough for hot
+ * paths like the output frame.
+ *
+ * @param phase Static string naming the phase.
+ */
+void wh_startup_mark(const char* phase);
+
+/**
+ * Mark the final phase and log how long every phase took, both relative to
+ * the compositor's start and to boot. Only the first call has any effect.
+ */
+void wh_startup_finish(const char* phase);
+
+#endif // !_WHALE_STARTUP_H
@@ -0,0 +1,30 @@
+
+#ifndef _WHALE_TABLET_H
+#define _WHALE_TABLET_H
+
+typedef struct WhaleCompositor WhaleCompositor;
+typedef struct WhaleSeat WhaleSeat;
+struct wlr_input_device;
+
+/**
+ * Create the tablet-v2 global, shared by all seats.
+ *
+ * @returns 0 on success or a negative value on failure.
+ */
+int wh_tablet_init(WhaleCompositor* comp);
+
+/**
+ * Start handling tablet tool events of the seat, its cursor must exist.
+ *
+ * @returns 0 on success or a negative value on failure.
+ */
+int wh_tablet_seat_init(WhaleSeat* seat);
+
+/**
+ * Attach a tablet to the seat's cursor and advertise it to clients.
+ *
+ * @returns 0 on success or a negative value on failure.
+ */
+int wh_tablet_add(WhaleSeat* seat, struct wlr_input_device* dev);
+
+#endif // !_WHALE_TABLET_H
@@ -0,0 +1,113 @@
+
+#ifndef _WHALE_THROTTLE_H
+#define _WHALE_THROTTLE_H
+
+#include <sys/types.h>
+#include <time.h>
+#include <wayland-server-core.h>
+#include <whale/types.h>
+
+typedef struct WhaleCompositor WhaleCompositor;
+struct wlr_scene_output;
+struct wlr_surface;
+
+/* Per second limits past which a client is throttled, 0 disables a limit. */
+typedef struct
+{
+    u32 max_commits;
+    u32 max_buffers;
+    u32 max_requests;
+
+    /* Frame callbacks per second a throttled client still gets */
+    u32 throttled_fps;
+} WhaleThrottleConfig;
+
+/* Counters of one accounting window */
+typedef struct
+{
+    u32 commits;
+    /* Commits attaching a new buffer */
+    u32 buffers;
+    u32 requests;
+} WhaleClientCounters;
+
+/* Accounting of a single Wayland connection, so every toplevel, popup and
+surface of a process is counted together. */
+typedef struct
+{
+    WhaleCompositor* comp;
+    struct wl_client* wl_client;
+    pid_t pid;
+
+    /* Window being counted and the last complete one */
+    WhaleClientCounters current;
+    WhaleClientCounters rates;
+
+    bool throttled;
+    /* Seats whose keyboard focus is on one of its surfaces */
+    u32 focus_count;
+    /* CLOCK_MONOTONIC ms of the last frame callbacks sent while throttled */
+    u64 last_frame_ms;
+
+    struct wl_listener destroy;
+    /* WhaleThrottle::conns */
+    struct wl_list link;
+} WhaleClientConn;
+
+typedef struct
+{
+    WhaleThrottleConfig config;
+
+    /* Every WhaleClientConn */
+    struct wl_list conns;
+
+    struct wl_protocol_logger* logger;
+    /* Closes an accounting window every second, left disarmed while no
+    client talks to us so an idle session doesn't wake up for it */
+    struct wl_event_source* window_timer;
+    bool window_armed;
+
+    /* Last connection looked up, requests come in bursts */
+    WhaleClientConn* last_conn;
+} WhaleThrottle;
+
+/**
+ * Start counting every client's requests. Must be called before any client
+ * connects.
+ *
+ * @returns 0 on success or a negative value on failure.
+ */
+int wh_throttle_init(WhaleCompositor* comp);
+
+void wh_throttle_finish(WhaleCompositor* comp);
+
+/**
+ * Get the accounting of a connection, creating it if needed.
+ *
+ * @returns The accounting or NULL if out of memory.
+ */
+WhaleClientConn*
+wh_throttle_conn_get(WhaleCompositor* comp, struct wl_client* wl_client);
+
+/**
+ * A seat's keyboard focus moved between the surfaces, either may be NULL.
+ * Connections are never throttled while any seat has them focused.
+ */
+void wh_throttle_focus_changed(
+    WhaleCompositor* comp,
+    struct wlr_surface* old_surface,
+    struct wlr_surface* new_surface
+);
+
+/**
+ * Send frame callbacks to every surface shown on the output. Surfaces of
+ * throttled clients only get theirs `throttled_fps` times per second, the
+ * callbacks stay queued in between.
+ */
+void wh_throttle_send_frame_done(
+    WhaleCompositor* comp,
+    struct wlr_scene_output* scene_output,
+    const struct timespec* now
+);
+
+#endif // !_WHALE_THROTTLE_H
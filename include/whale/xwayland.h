@@ -0,0 +1,54 @@
+
+#ifndef _WHALE_XWAYLAND_H
+#define _WHALE_XWAYLAND_H
+
+#include <wayland-server-core.h>
+#include <whale/types.h>
+
+typedef struct WhaleCompositor WhaleCompositor;
+typedef struct WhaleClient WhaleClient;
+
+/* X11 support, only built with `make XWAYLAND=1` (WH_XWAYLAND). The X
+server is started by the first X11 client, not with the compositor. */
+typedef struct
+{
+    /* Seconds the X server keeps running once its last client is gone, 0
+    keeps it running */
+    int idle_timeout;
+
+    struct wlr_xwayland_server* server;
+    struct wlr_xwayland* wlr_xwayland;
+
+    struct
+    {
+        struct wl_listener ready;
+        struct wl_listener new_surface;
+    } listeners;
+} WhaleXwayland;
+
+/**
+ * Reserve an X11 display and export it as DISPLAY. Must be called before
+ * any child is spawned, WHALE_XWAYLAND_IDLE (in seconds) overrides the idle
+ * timeout.
+ *
+ * @returns 0 on success or a negative value on failure.
+ */
+int wh_xwayland_reserve(WhaleCompositor* comp);
+
+/**
+ * Start managing X11 windows on the reserved display, the wlr_compositor
+ * must exist.
+ *
+ * @returns 0 on success or a negative value on failure.
+ */
+int wh_xwayland_init(WhaleCompositor* comp);
+
+/**
+ * Activate X11 windows as they get keyboard focus of any seat, and
+ * deactivate them once no seat has them focused. Either may be NULL.
+ */
+void wh_xwayland_focus_changed(WhaleClient* old, WhaleClient* new);
+
+void wh_xwayland_finish(WhaleCompositor* comp);
+
+#endif // !_WHALE_XWAYLAND_H
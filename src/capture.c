@@ -0,0 +1,118 @@
+#define WLR_USE_UNSTABLE
+#include <whale/capture.h>
+#include <whale/client.h>
+#include <whale/compositor.h>
+#include <whale/log.h>
+#include <whale/types.h>
+#include <wlr/types/wlr_ext_foreign_toplevel_list_v1.h>
+#include <wlr/types/wlr_ext_image_capture_source_v1.h>
+#include <wlr/types/wlr_ext_image_copy_capture_v1.h>
+#include <wlr/types/wlr_screencopy_v1.h>
+
+static void on_toplevel_capture_request(struct wl_listener*, void* data)
+{
+    struct wlr_ext_foreign_toplevel_image_capture_source_manager_v1_request*
+        request = data;
+    WhaleClient* client = request->toplevel_handle->data;
+
+    /* One source per client, shared by every capture of it. It renders the
+    client's scene node on its own, only when a frame is requested and only
+    where the client was damaged. */
+    if (!client->capture_source)
+    {
+        WhaleCompositor* comp = client->comp;
+        client->capture_source =
+            wlr_ext_image_capture_source_v1_create_with_scene_node(
+                &client->scene_tree->node,
+                wl_display_get_event_loop(comp->display),
+                comp->allocator,
+                comp->renderer
+            );
+        if (!client->capture_source)
+        {
+            wh_log(ERR, "capture: Failed to create toplevel source");
+            return;
+        }
+    }
+
+    wlr_ext_foreign_toplevel_image_capture_source_manager_v1_request_accept(
+        request, client->capture_source
+    );
+}
+
+int wh_capture_init(WhaleCompositor* comp)
+{
+    /* Output captures copy from the buffer the output just committed, they
+    never render the scene again. Both protocols only copy damage and prefer
+    dmabufs, that is handled by wlroots. */
+    if (!wlr_screencopy_manager_v1_create(comp->display) ||
+        !wlr_ext_image_copy_capture_manager_v1_create(comp->display, 1) ||
+        !wlr_ext_output_image_capture_source_manager_v1_create(
+            comp->display, 1
+        ))
+    {
+        wh_log(ERR, "capture: Failed to create output capture globals");
+        return -1;
+    }
+
+    comp->foreign_toplevel_list =
+        wlr_ext_foreign_toplevel_list_v1_create(comp->display, 1);
+    struct wlr_ext_foreign_toplevel_image_capture_source_manager_v1*
+        toplevel_sources =
+            wlr_ext_foreign_toplevel_image_capture_source_manager_v1_create(
+                comp->display, 1
+            );
+    if (!comp->foreign_toplevel_list || !toplevel_sources)
+    {
+        wh_log(ERR, "capture: Failed to create toplevel capture globals");
+        return -1;
+    }
+
+    LISTEN(
+        &toplevel_sources->events.new_request,
+        &comp->listeners.toplevel_capture_request,
+        on_toplevel_capture_request
+    );
+
+    return 0;
+}
+
+void wh_capture_client_map(WhaleClient* client)
+{
+    if (client->foreign_toplevel || !client->comp->foreign_toplevel_list)
+        return;
+
+    const struct wlr_ext_foreign_toplevel_handle_v1_state state = {
+        .title = wh_client_title(client),
+        .app_id = wh_client_app_id(client),
+    };
+
+    client->foreign_toplevel = wlr_ext_foreign_toplevel_handle_v1_create(
+        client->comp->foreign_toplevel_list, &state
+    );
+    if (client->foreign_toplevel)
+        client->foreign_toplevel->data = client;
+}
+
+void wh_capture_client_unmap(WhaleClient* client)
+{
+    if (!client->foreign_toplevel)
+        return;
+
+    wlr_ext_foreign_toplevel_handle_v1_destroy(client->foreign_toplevel);
+    client->foreign_toplevel = NULL;
+}
+
+void wh_capture_client_update(WhaleClient* client)
+{
+    if (!client->foreign_toplevel)
+        return;
+
+    const struct wlr_ext_foreign_toplevel_handle_v1_state state = {
+        .title = wh_client_title(client),
+        .app_id = wh_client_app_id(client),
+    };
+    wlr_ext_foreign_toplevel_handle_v1_update_state(
+        client->foreign_toplevel, &state
+    );
+}
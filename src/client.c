@@ -1,15 +1,82 @@
 
 #define WLR_USE_UNSTABLE
 #include <stdlib.h>
+#include <whale/capture.h>
 #include <whale/client.h>
 #include <whale/compositor.h>
+#include <whale/decoration.h>
+#include <whale/grab.h>
+#include <whale/ipc.h>
 #include <whale/log.h>
+#include <whale/memory.h>
+#include <whale/startup.h>
 #include <whale/types.h>
+#include <wlr/types/wlr_output_layout.h>
+#include <wlr/types/wlr_subcompositor.h>
 #include <wlr/types/wlr_xdg_shell.h>
+#include <wlr/util/edges.h>
+#ifdef WH_XWAYLAND
+#include <wlr/xwayland.h>
+#endif
 
-static struct wlr_box* wh_client_get_geometry(WhaleClient* client)
+struct wlr_surface* wh_client_surface(const WhaleClient* client)
 {
-    return &client->xdg_toplevel->base->geometry;
+#ifdef WH_XWAYLAND
+    if (client->type == WH_CLIENT_X11)
+        return client->xwayland_surface->surface;
+#endif
+
+    return client->xdg_toplevel->base->surface;
+}
+
+const char* wh_client_title(const WhaleClient* client)
+{
+    const char* title = NULL;
+#ifdef WH_XWAYLAND
+    if (client->type == WH_CLIENT_X11)
+        title = client->xwayland_surface->title;
+#endif
+    if (client->type == WH_CLIENT_XDG)
+        title = client->xdg_toplevel->title;
+
+    return title ? title : "";
+}
+
+const char* wh_client_app_id(const WhaleClient* client)
+{
+#ifdef WH_XWAYLAND
+    if (client->type == WH_CLIENT_X11)
+        return client->xwayland_surface->class;
+#endif
+
+    return client->xdg_toplevel->app_id;
+}
+
+struct wlr_box wh_client_get_geometry(const WhaleClient* client)
+{
+#ifdef WH_XWAYLAND
+    /* X11 windows have no shadows or such outside of their geometry */
+    if (client->type == WH_CLIENT_X11)
+    {
+        const struct wlr_xwayland_surface* xsurface = client->xwayland_surface;
+        return (struct wlr_box){0, 0, xsurface->width, xsurface->height};
+    }
+#endif
+
+    return client->xdg_toplevel->base->geometry;
+}
+
+void wh_client_close(WhaleClient* client)
+{
+#ifdef WH_XWAYLAND
+    if (client->type == WH_CLIENT_X11)
+    {
+        wlr_xwayland_surface_close(client->xwayland_surface);
+        return;
+    }
+#endif
+
+    wlr_xdg_toplevel_send_close(client->xdg_toplevel);
 }
 
 static WhaleClient*
@@ -18,9 +85,145 @@ wh_client_from_xdg_toplevel(struct wlr_xdg_toplevel* toplevel)
     return toplevel->base->data;
 }
 
-static WhaleClient* wh_client_from_scene_node(const struct wlr_scene_node* node)
+/* Ties a wlr_surface (the toplevel's, a popup's or any of their subsurfaces)
+to the client owning it, through wlr_surface::data. */
+typedef struct
+{
+    /* NULL once the client is gone */
+    WhaleClient* client;
+    struct wlr_surface* surface;
+
+    struct wl_listener new_subsurface;
+    struct wl_listener client_commit;
+    struct wl_listener destroy;
+
+    /* WhaleClient::surfaces */
+    struct wl_list link;
+} WhaleSurfaceLink;
+
+typedef struct
+{
+    WhaleClient* client;
+    struct wlr_xdg_popup* xdg_popup;
+    struct wlr_scene_tree* scene_tree;
+
+    struct
+    {
+        struct wl_listener commit;
+        struct wl_listener destroy;
+    } listeners;
+} WhalePopup;
+
+WhaleClient* wh_client_from_surface(const struct wlr_surface* surface)
+{
+    const WhaleSurfaceLink* link = surface->data;
+    return link ? link->client : NULL;
+}
+
+static void
+on_tracked_surface_new_subsurface(struct wl_listener* listener, void* data)
+{
+    WhaleSurfaceLink* link = wl_container_of(listener, link, new_subsurface);
+    struct wlr_subsurface* subsurface = data;
+
+    if (link->client)
+        wh_client_track_surface(link->client, subsurface->surface);
+}
+
+static void
+on_tracked_surface_client_commit(struct wl_listener* listener, void*)
+{
+    WhaleSurfaceLink* link = wl_container_of(listener, link, client_commit);
+    if (!link->client)
+        return;
+
+    wh_memory_account_commit(link->client, link->surface);
+
+    /* Size, input region or stacking of the surface may change */
+    link->client->comp->scene_serial++;
+}
+
+static void on_tracked_surface_destroy(struct wl_listener* listener, void*)
 {
-    return node->data;
+    WhaleSurfaceLink* link = wl_container_of(listener, link, destroy);
+
+    /* Hit caches may still point to it */
+    if (link->client)
+        link->client->comp->scene_serial++;
+
+    link->surface->data = NULL;
+    UNLISTEN(&link->new_subsurface);
+    UNLISTEN(&link->client_commit);
+    UNLISTEN(&link->destroy);
+    wl_list_remove(&link->link);
+    free(link);
+}
+
+static WhaleSurfaceLink*
+wh_client_surface_link_create(struct wlr_surface* surface)
+{
+    WhaleSurfaceLink* link = calloc(1, sizeof(WhaleSurfaceLink));
+    if (!link)
+    {
+        wh_log(ERR, "client: Failed to allocate surface link");
+        return NULL;
+    }
+
+    link->surface = surface;
+    surface->data = link;
+    wl_list_init(&link->link);
+
+    LISTEN(
+        &surface->events.new_subsurface,
+        &link->new_subsurface,
+        on_tracked_surface_new_subsurface
+    );
+    LISTEN(
+        &surface->events.client_commit,
+        &link->client_commit,
+        on_tracked_surface_client_commit
+    );
+    LISTEN(
+        &surface->events.destroy, &link->destroy, on_tracked_surface_destroy
+    );
+
+    return link;
+}
+
+void wh_client_track_surface(WhaleClient* client, struct wlr_surface* surface)
+{
+    /* A surface keeps its link after its client is gone, it may get a new
+    xdg_surface and client later. */
+    WhaleSurfaceLink* link = surface->data;
+    if (!link)
+        link = wh_client_surface_link_create(surface);
+    if (!link || link->client)
+        return;
+
+    link->client = client;
+    wl_list_remove(&link->link);
+    wl_list_insert(&client->surfaces, &link->link);
+    client->comp->scene_serial++;
+
+    /* Subsurfaces that existed before we started tracking this one. */
+    struct wlr_subsurface* sub;
+    wl_list_for_each(sub, &surface->current.subsurfaces_below, current.link)
+        wh_client_track_surface(client, sub->surface);
+    wl_list_for_each(sub, &surface->current.subsurfaces_above, current.link)
+        wh_client_track_surface(client, sub->surface);
+}
+
+/* Surfaces can outlive their toplevel, they must not point to it anymore. */
+static void wh_client_untrack_surfaces(WhaleClient* client)
+{
+    WhaleSurfaceLink* link;
+    WhaleSurfaceLink* tmp;
+    wl_list_for_each_safe(link, tmp, &client->surfaces, link)
+    {
+        link->client = NULL;
+        wl_list_remove(&link->link);
+        wl_list_init(&link->link);
+    }
 }
 
 static void wh_client_set_decorations_server_side(WhaleClient* client)
@@ -31,20 +234,202 @@ static void wh_client_set_decorations_server_side(WhaleClient* client)
     wlr_xdg_toplevel_decoration_v1_set_mode(
         client->xdg_decoration, WLR_XDG_TOPLEVEL_DECORATION_V1_MODE_SERVER_SIDE
     );
+    client->server_side_decorations = true;
+}
+
+void wh_client_mapped(WhaleClient* client)
+{
+    wlr_scene_node_set_enabled(&client->scene_tree->node, 1);
+    client->comp->scene_serial++;
+    wh_capture_client_map(client);
+    wh_ipc_client_changed(client->comp, client);
+
+    wh_startup_finish("first client map");
+}
+
+void wh_client_unmapped(WhaleClient* client)
+{
+    wlr_scene_node_set_enabled(&client->scene_tree->node, 0);
+    client->comp->scene_serial++;
+    wh_capture_client_unmap(client);
+    wh_grab_client_gone(client);
+    wh_ipc_client_changed(client->comp, client);
+
+    /* Configures sent to the old mapping won't be acked */
+    client->configure_pending = false;
+    client->resize_queued = false;
 }
 
 static void wh_client_on_surface_map(struct wl_listener* listener, void*)
 {
     WhaleClient* client = wl_container_of(listener, client, listeners.map);
-
-    wlr_scene_node_set_enabled(&client->scene_tree->node, 1);
+    wh_client_mapped(client);
 }
 
 static void wh_client_on_surface_unmap(struct wl_listener* listener, void*)
 {
     WhaleClient* client = wl_container_of(listener, client, listeners.unmap);
+    wh_client_unmapped(client);
+}
 
-    wlr_scene_node_set_enabled(&client->scene_tree->node, 0);
+/* Tell IPC subscribers about geometry changes, most commits don't have any. */
+static void wh_client_report_geometry(WhaleClient* client)
+{
+    struct wlr_box geom = wh_client_get_geometry(client);
+    struct wlr_box box = {
+        .x = client->scene_tree->node.x,
+        .y = client->scene_tree->node.y,
+        .width = geom.width,
+        .height = geom.height,
+    };
+
+    if (wlr_box_equal(&box, &client->ipc_box))
+        return;
+
+    client->ipc_box = box;
+    wh_ipc_client_changed(client->comp, client);
+}
+
+/**
+ * Ask the client for a new content size. While it hasn't acked and committed
+ * the previous one the size is only remembered, it gets the latest once it
+ * catches up. A client slow to redraw is never sent more configures than it
+ * can keep up with and skips the sizes it would have drawn too late.
+ */
+static void wh_client_request_size(WhaleClient* client, int width, int height)
+{
+    if (client->configure_pending)
+    {
+        client->resize_queued = true;
+        client->queued_width = width;
+        client->queued_height = height;
+        return;
+    }
+
+    client->resize_queued = false;
+
+#ifdef WH_XWAYLAND
+    /* X11 has no configure acks, and wants to know where the window is */
+    if (client->type == WH_CLIENT_X11)
+    {
+        int left, right, top, bottom;
+        wh_decoration_insets(client, &left, &right, &top, &bottom);
+        wlr_xwayland_surface_configure(
+            client->xwayland_surface,
+            client->scene_tree->node.x + left,
+            client->scene_tree->node.y + top,
+            width,
+            height
+        );
+        return;
+    }
+#endif
+
+    client->configure_serial =
+        wlr_xdg_toplevel_set_size(client->xdg_toplevel, width, height);
+    client->configure_pending = true;
+}
+
+/* Called on commits, sends the queued size once the configure in flight
+has been acked and committed. */
+static void wh_client_configure_check(WhaleClient* client)
+{
+    if (!client->configure_pending)
+        return;
+
+    /* Serials wrap */
+    u32 committed = client->xdg_toplevel->base->current.configure_serial;
+    if ((s32)(committed - client->configure_serial) < 0)
+        return;
+
+    client->configure_pending = false;
+    if (client->resize_queued)
+        wh_client_request_size(
+            client, client->queued_width, client->queued_height
+        );
+}
+
+/* Position a floating client for the size it committed. */
+static void wh_client_place_floating(WhaleClient* client)
+{
+    struct wlr_box geom = wh_client_get_geometry(client);
+    struct wlr_box* box = &client->float_box;
+
+    int x = box->x;
+    int y = box->y;
+    if (client->resize_edges & WLR_EDGE_LEFT)
+        x += box->width - geom.width;
+    if (client->resize_edges & WLR_EDGE_TOP)
+        y += box->height - geom.height;
+
+    wlr_scene_node_set_position(&client->scene_tree->node, x, y);
+
+#ifdef WH_XWAYLAND
+    /* X11 windows place their own menus, they must know where they are */
+    if (client->type == WH_CLIENT_X11)
+    {
+        struct wlr_xwayland_surface* xsurface = client->xwayland_surface;
+        int left, right, top, bottom;
+        wh_decoration_insets(client, &left, &right, &top, &bottom);
+        if (xsurface->x != x + left || xsurface->y != y + top)
+            wh_client_request_size(client, geom.width, geom.height);
+    }
+#endif
+
+    /* Once the resize settled, whatever the client draws is where it is */
+    if (!client->configure_pending && !client->resize_queued &&
+        !client->grabbed)
+    {
+        client->resize_edges = 0;
+        *box = (struct wlr_box){x, y, geom.width, geom.height};
+    }
+}
+
+void wh_client_committed(WhaleClient* client)
+{
+    /* Windows placing themselves, like X11 menus, are shown as they are */
+    if (client->unmanaged)
+    {
+#ifdef WH_XWAYLAND
+        wlr_scene_node_set_position(
+            &client->scene_tree->node,
+            client->xwayland_surface->x,
+            client->xwayland_surface->y
+        );
+#endif
+        wh_client_report_geometry(client);
+        return;
+    }
+
+    struct wlr_box geom = wh_client_get_geometry(client);
+    int left, right, top, bottom;
+    wh_decoration_insets(client, &left, &right, &top, &bottom);
+
+    /* Line the client's geometry up with the area inside the decoration,
+    anything it draws outside of it (like CSD shadows) hangs over. */
+    wlr_scene_node_set_position(
+        &client->surface_tree->node, left - geom.x, top - geom.y
+    );
+
+    wh_client_configure_check(client);
+
+    struct wlr_scene_node* node = &client->scene_tree->node;
+    struct wlr_output* output = wlr_output_layout_output_at(
+        client->comp->output_layout, node->x, node->y
+    );
+
+    if (client->floating)
+        wh_client_place_floating(client);
+    else if (output)
+    {
+        int width = output->width - left - right;
+        int height = output->height - top - bottom;
+        if (geom.width != width || geom.height != height)
+            wh_client_request_size(client, width, height);
+    }
+
+    wh_decoration_update(client);
+    wh_client_report_geometry(client);
 }
 
 static void wh_client_on_surface_commit(struct wl_listener* listener, void*)
@@ -61,61 +446,180 @@ static void wh_client_on_surface_commit(struct wl_listener* listener, void*)
         return;
     }
 
-    struct wlr_box* geom = wh_client_get_geometry(client);
-    /* the client's geometry includes whatever decorations the client has.
-    We turn decorations off, but clients still position themselves as if they
-    had decorations. */
-    wlr_scene_node_set_position(&client->scene_tree->node, geom->x, geom->y);
-
-    struct wlr_output* output = wlr_output_layout_output_at(
-        client->comp->output_layout, geom->x, geom->y
-    );
+    wh_client_committed(client);
+}
 
-    if (geom->width != output->width || geom->height != output->height)
+WhaleClient* wh_client_create(WhaleCompositor* comp, WhaleClientType type)
+{
+    WhaleClient* client = calloc(1, sizeof(WhaleClient));
+    if (!client)
     {
-        wlr_xdg_toplevel_set_size(
-            client->xdg_toplevel, output->width, output->height
-        );
+        wh_log(ERR, "client: Failed to allocate memory for client");
+        return NULL;
     }
+
+    client->id = ++comp->next_client_id;
+    client->type = type;
+    /* The client can point back to the compositor */
+    client->comp = comp;
+
+    /* Create a new scene-tree for this client containing its decoration,
+    its surface and sub-surfaces and add it to the root scene. */
+    client->scene_tree = wlr_scene_tree_create(&comp->root_scene->tree);
+    wlr_scene_node_set_enabled(&client->scene_tree->node, 0);
+
+    wh_memory_stats_init(&client->buffer_stats);
+    wl_list_init(&client->surfaces);
+
+    wl_list_insert(&comp->clients, &client->link);
+    return client;
 }
 
-static void wh_client_on_destroy(struct wl_listener* listener, void*)
+void wh_client_destroy(WhaleClient* client)
 {
-    WhaleClient* client = wl_container_of(listener, client, listeners.destroy);
+    wh_ipc_client_closed(client->comp, client);
+    wh_capture_client_unmap(client);
+    wh_grab_client_gone(client);
+    wl_list_remove(&client->link);
 
     wlr_scene_node_destroy(&client->scene_tree->node);
+    wh_decoration_destroy(client);
+    wh_client_untrack_surfaces(client);
+    wh_memory_stats_finish(&client->buffer_stats);
+
+    /* Hit caches may still point to it */
+    client->comp->scene_serial++;
+    free(client);
+}
+
+static void wh_client_on_destroy(struct wl_listener* listener, void*)
+{
+    WhaleClient* client = wl_container_of(listener, client, listeners.destroy);
 
     UNLISTEN(&client->listeners.map);
     UNLISTEN(&client->listeners.unmap);
     UNLISTEN(&client->listeners.commit);
     UNLISTEN(&client->listeners.destroy);
     UNLISTEN(&client->listeners.set_title);
+    UNLISTEN(&client->listeners.set_app_id);
+    UNLISTEN(&client->listeners.request_move);
+    UNLISTEN(&client->listeners.request_resize);
 
-    free(client);
+    /* The decoration may outlive the toplevel */
+    if (client->xdg_decoration)
+    {
+        UNLISTEN(&client->listeners.decoration_request_mode);
+        UNLISTEN(&client->listeners.decoration_destroy);
+    }
+
+    wh_client_destroy(client);
+}
+
+void wh_client_title_changed(WhaleClient* client)
+{
+    wh_log(DEBUG, "client: title \"%s\"", wh_client_title(client));
+    wh_capture_client_update(client);
+    wh_decoration_update(client);
+    wh_ipc_client_changed(client->comp, client);
 }
 
 static void wh_client_on_set_title(struct wl_listener* listener, void*)
 {
     WhaleClient* client =
         wl_container_of(listener, client, listeners.set_title);
+    wh_client_title_changed(client);
+}
 
-    wh_log(DEBUG, "client: title \"%s\"", client->xdg_toplevel->title);
+void wh_client_app_id_changed(WhaleClient* client)
+{
+    wh_log(DEBUG, "client: app id \"%s\"", wh_client_app_id(client));
+    wh_capture_client_update(client);
 }
 
-static void wh_tree_walk_and_set_client_data(struct wlr_scene_tree* tree, WhaleClient* client)
+static void wh_client_on_set_app_id(struct wl_listener* listener, void*)
 {
-    tree->node.data = client;
+    WhaleClient* client =
+        wl_container_of(listener, client, listeners.set_app_id);
+    wh_client_app_id_changed(client);
+}
 
-    struct wlr_scene_node* node;
-    wl_list_for_each(node, &tree->children, link)
-    {
-        if (!node)
-            continue;
+bool wh_client_has_pointer_button(
+    const WhaleClient* client, const struct wlr_seat* seat
+)
+{
+    struct wlr_surface* focused = seat->pointer_state.focused_surface;
 
-        node->data = client;
-        if (node->type == WLR_SCENE_NODE_TREE)
-            wh_tree_walk_and_set_client_data(wlr_scene_tree_from_node(node), client);
-    }
+    return focused && wh_client_from_surface(focused) == client &&
+           seat->pointer_state.button_count == 1;
+}
+
+/* Only honoured while a button of the requesting seat is held on the
+client, the serial must be the one of that button press. */
+static bool wh_client_validate_grab(
+    WhaleClient* client, struct wlr_seat* seat, u32 serial
+)
+{
+    return wh_client_has_pointer_button(client, seat) &&
+           wlr_seat_validate_pointer_grab_serial(seat, NULL, serial);
+}
+
+static void wh_client_on_request_move(struct wl_listener* listener, void* data)
+{
+    WhaleClient* client =
+        wl_container_of(listener, client, listeners.request_move);
+    struct wlr_xdg_toplevel_move_event* ev = data;
+    struct wlr_seat* seat = ev->seat->seat;
+
+    if (wh_client_validate_grab(client, seat, ev->serial))
+        wh_grab_begin(wh_seat_from_wlr_seat(seat), client, WH_GRAB_MOVE, 0);
+}
+
+static void
+wh_client_on_request_resize(struct wl_listener* listener, void* data)
+{
+    WhaleClient* client =
+        wl_container_of(listener, client, listeners.request_resize);
+    struct wlr_xdg_toplevel_resize_event* ev = data;
+    struct wlr_seat* seat = ev->seat->seat;
+
+    if (wh_client_validate_grab(client, seat, ev->serial))
+        wh_grab_begin(
+            wh_seat_from_wlr_seat(seat), client, WH_GRAB_RESIZE, ev->edges
+        );
+}
+
+void wh_client_float(WhaleClient* client)
+{
+    if (client->floating)
+        return;
+
+    struct wlr_box geom = wh_client_get_geometry(client);
+    client->floating = true;
+    client->float_box = (struct wlr_box){
+        .x = client->scene_tree->node.x,
+        .y = client->scene_tree->node.y,
+        .width = geom.width,
+        .height = geom.height,
+    };
+}
+
+void wh_client_move(WhaleClient* client, int x, int y)
+{
+    client->float_box.x = x;
+    client->float_box.y = y;
+
+    wh_client_place_floating(client);
+    client->comp->scene_serial++;
+    wh_client_report_geometry(client);
+}
+
+void wh_client_resize(WhaleClient* client, const struct wlr_box* box, u32 edges)
+{
+    client->float_box = *box;
+    client->resize_edges = edges;
+
+    /* Moved along on the commit with the new size */
+    wh_client_request_size(client, box->width, box->height);
 }
 
 void wh_client_on_new_client(struct wl_listener* listener, void* data)
@@ -125,19 +629,17 @@ void wh_client_on_new_client(struct wl_listener* listener, void* data)
 
     struct wlr_xdg_toplevel* toplevel = data;
 
-    WhaleClient* client = calloc(1, sizeof(WhaleClient));
+    WhaleClient* client = wh_client_create(comp, WH_CLIENT_XDG);
+    if (!client)
+        return;
+
     client->xdg_toplevel = toplevel;
-    /* The client can point back to the compositor */
-    client->comp = comp;
     /* The xdg surface can point back to the client */
     client->xdg_toplevel->base->data = client;
 
-    /* Create a new scene-tree for this client containing it and it's
-    sub-surfaces and add it to the root scene. */
-    client->scene_tree =
-        wlr_scene_xdg_surface_create(&comp->root_scene->tree, toplevel->base);
-
-    wh_tree_walk_and_set_client_data(client->scene_tree, client);
+    client->surface_tree =
+        wlr_scene_xdg_surface_create(client->scene_tree, toplevel->base);
+    wh_client_track_surface(client, toplevel->base->surface);
 
     LISTEN(
         &toplevel->base->surface->events.map,
@@ -169,6 +671,24 @@ void wh_client_on_new_client(struct wl_listener* listener, void* data)
         wh_client_on_set_title
     );
 
+    LISTEN(
+        &toplevel->events.set_app_id,
+        &client->listeners.set_app_id,
+        wh_client_on_set_app_id
+    );
+
+    LISTEN(
+        &toplevel->events.request_move,
+        &client->listeners.request_move,
+        wh_client_on_request_move
+    );
+
+    LISTEN(
+        &toplevel->events.request_resize,
+        &client->listeners.request_resize,
+        wh_client_on_request_resize
+    );
+
     wh_log(DEBUG, "client: new");
 }
 
@@ -189,6 +709,10 @@ static void on_decoration_destroy(struct wl_listener* listener, void*)
     wl_list_remove(&client->listeners.decoration_destroy.link);
     wl_list_remove(&client->listeners.decoration_request_mode.link);
     client->xdg_decoration = NULL;
+
+    /* The client draws its own from now on */
+    client->server_side_decorations = false;
+    wh_decoration_update(client);
 }
 
 void wh_client_on_new_xdg_decoration(struct wl_listener*, void* data)
@@ -211,15 +735,135 @@ void wh_client_on_new_xdg_decoration(struct wl_listener*, void* data)
     );
 }
 
-WhaleClient*
-wh_client_get_at_coords(wh_coord_t x, wh_coord_t y, const WhaleCompositor* comp)
+static void wh_client_on_popup_commit(struct wl_listener* listener, void*)
+{
+    WhalePopup* popup = wl_container_of(listener, popup, listeners.commit);
+
+    if (!popup->xdg_popup->base->initial_commit)
+        return;
+
+    /* Keep the popup on the output its toplevel is on. The box is relative
+    to the toplevel's surface. */
+    WhaleClient* client = popup->client;
+    int x, y;
+    wlr_scene_node_coords(&client->surface_tree->node, &x, &y);
+    struct wlr_output* output =
+        wlr_output_layout_output_at(client->comp->output_layout, x, y);
+
+    if (output)
+    {
+        struct wlr_box box;
+        wlr_output_layout_get_box(client->comp->output_layout, output, &box);
+        box.x -= x;
+        box.y -= y;
+        wlr_xdg_popup_unconstrain_from_box(popup->xdg_popup, &box);
+    }
+
+    wlr_xdg_surface_schedule_configure(popup->xdg_popup->base);
+}
+
+static void wh_client_on_popup_destroy(struct wl_listener* listener, void*)
+{
+    WhalePopup* popup = wl_container_of(listener, popup, listeners.destroy);
+
+    UNLISTEN(&popup->listeners.commit);
+    UNLISTEN(&popup->listeners.destroy);
+
+    free(popup);
+}
+
+void wh_client_on_new_popup(struct wl_listener*, void* data)
 {
-    struct wlr_scene_node* node =
-        wlr_scene_node_at(&comp->root_scene->tree.node, x, y, NULL, NULL);
+    struct wlr_xdg_popup* xdg_popup = data;
+
+    /* xdg_surface::data is the WhaleClient of toplevels and the WhalePopup
+    of popups. */
+    struct wlr_xdg_surface* parent =
+        wlr_xdg_surface_try_from_wlr_surface(xdg_popup->parent);
+    if (!parent || !parent->data)
+        return;
+
+    WhaleClient* client;
+    struct wlr_scene_tree* parent_tree;
+    if (parent->role == WLR_XDG_SURFACE_ROLE_TOPLEVEL)
+    {
+        client = parent->data;
+        parent_tree = client->surface_tree;
+    }
+    else
+    {
+        WhalePopup* parent_popup = parent->data;
+        client = parent_popup->client;
+        parent_tree = parent_popup->scene_tree;
+    }
+
+    WhalePopup* popup = calloc(1, sizeof(WhalePopup));
+    if (!popup)
+    {
+        wh_log(ERR, "client: Failed to allocate popup");
+        return;
+    }
+
+    popup->client = client;
+    popup->xdg_popup = xdg_popup;
+    popup->scene_tree =
+        wlr_scene_xdg_surface_create(parent_tree, xdg_popup->base);
+    xdg_popup->base->data = popup;
+
+    wh_client_track_surface(client, xdg_popup->base->surface);
+
+    LISTEN(
+        &xdg_popup->base->surface->events.commit,
+        &popup->listeners.commit,
+        wh_client_on_popup_commit
+    );
+    LISTEN(
+        &xdg_popup->events.destroy,
+        &popup->listeners.destroy,
+        wh_client_on_popup_destroy
+    );
+}
+
+WhaleClient* wh_client_surface_at(
+    wh_coord_t x,
+    wh_coord_t y,
+    const WhaleCompositor* comp,
+    struct wlr_surface** surface,
+    double* sx,
+    double* sy
+)
+{
+    double node_x;
+    double node_y;
+    struct wlr_scene_node* node = wlr_scene_node_at(
+        &comp->root_scene->tree.node, x, y, &node_x, &node_y
+    );
 
     /* Not a client */
     if (!node || node->type != WLR_SCENE_NODE_BUFFER)
         return NULL;
 
-    return wh_client_from_scene_node(node);
+    struct wlr_scene_surface* scene_surface =
+        wlr_scene_surface_try_from_buffer(wlr_scene_buffer_from_node(node));
+    if (!scene_surface)
+        return NULL;
+
+    WhaleClient* client = wh_client_from_surface(scene_surface->surface);
+    if (!client)
+        return NULL;
+
+    if (surface)
+        *surface = scene_surface->surface;
+    if (sx)
+        *sx = node_x;
+    if (sy)
+        *sy = node_y;
+
+    return client;
+}
+
+WhaleClient*
+wh_client_get_at_coords(wh_coord_t x, wh_coord_t y, const WhaleCompositor* comp)
+{
+    return wh_client_surface_at(x, y, comp, NULL, NULL, NULL);
 }
@@ -0,0 +1,1003 @@
+#define _POSIX_C_SOURCE 200809L
+#define WLR_USE_UNSTABLE
+#include <errno.h>
+#include <fcntl.h>
+#include <libgen.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <whale/compositor.h>
+#include <whale/config.h>
+#include <whale/decoration.h>
+#include <whale/idle.h>
+#include <whale/input.h>
+#include <whale/ipc.h>
+#include <whale/keybind.h>
+#include <whale/log.h>
+#include <whale/output.h>
+#include <whale/types.h>
+#include <wlr/types/wlr_keyboard.h>
+#include <wlr/types/wlr_output.h>
+#include <wlr/types/wlr_scene.h>
+
+/* Quiet time after the last write before the file is read again */
+#define WH_CONFIG_RELOAD_DELAY_MS 50
+
+#define RGBA(hex)                                                              \
+    {((hex) >> 24 & 0xff) / 255.f,                                             \
+     ((hex) >> 16 & 0xff) / 255.f,                                             \
+     ((hex) >> 8 & 0xff) / 255.f,                                              \
+     ((hex) & 0xff) / 255.f}
+
+static const WhaleConfig default_config = {
+    .background = RGBA(0x121212ff),
+    .repeat_rate = 25,
+    .repeat_delay = 400,
+    .cursor_size = 24,
+    .idle =
+        {
+            .dpms_timeout_ms = 10 * 60 * 1000,
+        },
+    .throttle =
+        {
+            .max_commits = 1000,
+            .max_buffers = 1000,
+            .max_requests = 20000,
+            .throttled_fps = 30,
+        },
+    .decoration =
+        {
+            .border_width = 2,
+            .title_height = 22,
+            .font = "sans 10",
+            .focused =
+                {
+                    .border = RGBA(0x4c7899ff),
+                    .title = RGBA(0x285577ff),
+                    .text = RGBA(0xffffffff),
+                },
+            .unfocused =
+                {
+                    .border = RGBA(0x333333ff),
+                    .title = RGBA(0x222222ff),
+                    .text = RGBA(0x888888ff),
+                },
+        },
+};
+
+typedef struct
+{
+    WhaleConfig* config;
+    /* Keymap of every keyboard not listed by device */
+    struct xkb_rule_names names;
+    /* Mode of the following binds, NULL for "default" */
+    const char* mode;
+} WhaleConfigParser;
+
+/* Cut the next argument out of the line, NULL once there is none left. */
+static char* wh_config_next(char** cursor)
+{
+    char* p = *cursor;
+    while (*p == ' ' || *p == '\t')
+        p++;
+    if (!*p)
+    {
+        *cursor = p;
+        return NULL;
+    }
+
+    char* start = p;
+    if (*p == '"')
+    {
+        start = ++p;
+        while (*p && *p != '"')
+            p++;
+    }
+    else
+    {
+        while (*p && *p != ' ' && *p != '\t')
+            p++;
+    }
+
+    if (*p)
+        *p++ = '\0';
+
+    *cursor = p;
+    return start;
+}
+
+/* The rest of the line as it is written, NULL if it is empty. */
+static char* wh_config_rest(char** cursor)
+{
+    char* p = *cursor;
+    while (*p == ' ' || *p == '\t')
+        p++;
+    if (!*p)
+        return NULL;
+
+    char* end = p + strlen(p);
+    while (end[-1] == ' ' || end[-1] == '\t')
+        end--;
+    *end = '\0';
+
+    *cursor = end;
+    return p;
+}
+
+/* Append a zeroed item to a growing array. */
+static void* wh_config_append(void** items, size_t* count, size_t size)
+{
+    void* grown = realloc(*items, (*count + 1) * size);
+    if (!grown)
+        return NULL;
+
+    *items = grown;
+    void* item = (char*)grown + *count * size;
+    memset(item, 0, size);
+    (*count)++;
+
+    return item;
+}
+
+static bool wh_config_u32(const char* arg, u32* out)
+{
+    if (!arg || !*arg)
+        return false;
+
+    char* end;
+    errno = 0;
+    unsigned long value = strtoul(arg, &end, 10);
+    if (*end || errno || value > UINT32_MAX)
+        return false;
+
+    *out = value;
+    return true;
+}
+
+static bool wh_config_color(const char* arg, float color[4])
+{
+    if (!arg)
+        return false;
+    if (*arg == '#')
+        arg++;
+
+    size_t len = strlen(arg);
+    char* end;
+    u32 hex = strtoul(arg, &end, 16);
+    if (*end || (len != 6 && len != 8))
+        return false;
+    if (len == 6)
+        hex = hex << 8 | 0xff;
+
+    for (int i = 0; i < 4; i++)
+        color[i] = (hex >> (24 - 8 * i) & 0xff) / 255.f;
+
+    return true;
+}
+
+static const char* wh_config_keyboard(WhaleConfigParser* parser, char* args)
+{
+    static const char* const fields[] = {
+        "rules", "model", "layout", "variant", "options"
+    };
+
+    char* field = wh_config_next(&args);
+    struct xkb_rule_names* names = &parser->names;
+
+    bool known = false;
+    for (size_t i = 0; field && i < 5; i++)
+        known |= strcmp(field, fields[i]) == 0;
+
+    /* Anything that isn't a field names a device */
+    if (field && !known)
+    {
+        WhaleConfig* config = parser->config;
+        WhaleDeviceKeymap* keymap = NULL;
+        for (size_t i = 0; i < config->num_keymaps; i++)
+        {
+            if (strcmp(config->keymaps[i].device, field) == 0)
+                keymap = &config->keymaps[i];
+        }
+
+        if (!keymap)
+        {
+            keymap = wh_config_append(
+                (void**)&config->keymaps,
+                &config->num_keymaps,
+                sizeof(WhaleDeviceKeymap)
+            );
+            if (!keymap)
+                return "out of memory";
+            keymap->device = field;
+        }
+
+        names = &keymap->names;
+        field = wh_config_next(&args);
+    }
+
+    const char* value = wh_config_next(&args);
+    if (!field || !value)
+        return "expected keyboard [device] <field> <value>";
+
+    const char** slots[] = {
+        &names->rules,
+        &names->model,
+        &names->layout,
+        &names->variant,
+        &names->options,
+    };
+    for (size_t i = 0; i < 5; i++)
+    {
+        if (strcmp(field, fields[i]) == 0)
+        {
+            *slots[i] = value;
+            return NULL;
+        }
+    }
+
+    return "unknown keyboard field";
+}
+
+static const char* wh_config_seat(WhaleConfig* config, char* args)
+{
+    const char* device = wh_config_next(&args);
+    const char* name = wh_config_next(&args);
+    if (!device || !name)
+        return "expected seat <device> <seat name>";
+
+    WhaleDeviceSeat* seat = NULL;
+    for (size_t i = 0; i < config->num_seats; i++)
+    {
+        if (strcmp(config->seats[i].device, device) == 0)
+            seat = &config->seats[i];
+    }
+
+    if (!seat)
+    {
+        seat = wh_config_append(
+            (void**)&config->seats, &config->num_seats, sizeof(WhaleDeviceSeat)
+        );
+        if (!seat)
+            return "out of memory";
+        seat->device = device;
+    }
+
+    seat->seat = name;
+    return NULL;
+}
+
+static const char* wh_config_output_cmd(WhaleConfigParser* parser, char* args)
+{
+    WhaleConfig* config = parser->config;
+    const char* name = wh_config_next(&args);
+    const char* what = wh_config_next(&args);
+    const char* value = wh_config_next(&args);
+    if (!name || !what || !value)
+        return "expected output <name> mode|scale <value>";
+
+    WhaleOutputConfig* output = NULL;
+    for (size_t i = 0; i < config->num_outputs; i++)
+    {
+        if (strcmp(config->outputs[i].name, name) == 0)
+            output = &config->outputs[i];
+    }
+
+    if (!output)
+    {
+        output = wh_config_append(
+            (void**)&config->outputs,
+            &config->num_outputs,
+            sizeof(WhaleOutputConfig)
+        );
+        if (!output)
+            return "out of memory";
+        output->name = name;
+    }
+
+    if (strcmp(what, "scale") == 0)
+    {
+        char* end;
+        output->scale = strtof(value, &end);
+        if (*end || output->scale <= 0)
+            return "invalid scale";
+        return NULL;
+    }
+
+    if (strcmp(what, "mode") != 0)
+        return "expected mode or scale";
+
+    if (!wh_config_parse_mode(
+            value, &output->width, &output->height, &output->refresh
+        ))
+        return "expected <width>x<height>[@<hz>]";
+
+    return NULL;
+}
+
+static bool wh_config_keysym(char* combo, u32* mods, xkb_keysym_t* keysym)
+{
+    static const struct
+    {
+        const char* name;
+        u32 mask;
+    } modifiers[] = {
+        {"super", WLR_MODIFIER_LOGO},
+        {"logo", WLR_MODIFIER_LOGO},
+        {"mod4", WLR_MODIFIER_LOGO},
+        {"shift", WLR_MODIFIER_SHIFT},
+        {"ctrl", WLR_MODIFIER_CTRL},
+        {"control", WLR_MODIFIER_CTRL},
+        {"alt", WLR_MODIFIER_ALT},
+        {"mod1", WLR_MODIFIER_ALT},
+    };
+
+    *mods = 0;
+    char* key = combo;
+    for (char* plus; (plus = strchr(key, '+')); key = plus + 1)
+    {
+        *plus = '\0';
+
+        u32 mask = 0;
+        for (size_t i = 0; i < sizeof(modifiers) / sizeof(modifiers[0]); i++)
+        {
+            if (strcasecmp(key, modifiers[i].name) == 0)
+                mask = modifiers[i].mask;
+        }
+        if (!mask)
+            return false;
+
+        *mods |= mask;
+    }
+
+    *keysym = xkb_keysym_from_name(key, XKB_KEYSYM_NO_FLAGS);
+    if (*keysym == XKB_KEY_NoSymbol)
+        *keysym = xkb_keysym_from_name(key, XKB_KEYSYM_CASE_INSENSITIVE);
+
+    /* Bindings match the level-0 keysym, `Q` is written as Shift+q */
+    *keysym = xkb_keysym_to_lower(*keysym);
+    return *keysym != XKB_KEY_NoSymbol;
+}
+
+static const char* wh_config_bind(WhaleConfigParser* parser, char* args)
+{
+    static const struct
+    {
+        const char* name;
+        WhaleAction action;
+    } actions[] = {
+        {"spawn", WH_ACTION_SPAWN},
+        {"close", WH_ACTION_CLOSE},
+        {"mode", WH_ACTION_MODE},
+        {"chvt", WH_ACTION_CHVT},
+        {"quit", WH_ACTION_QUIT},
+        {"reload", WH_ACTION_RELOAD},
+        {"add-output", WH_ACTION_OUTPUT_ADD},
+        {"remove-output", WH_ACTION_OUTPUT_REMOVE},
+    };
+
+    WhaleKeybind bind = {.mode = parser->mode};
+    char* combo = wh_config_next(&args);
+    if (combo && strcmp(combo, "--repeat") == 0)
+    {
+        bind.repeat = true;
+        combo = wh_config_next(&args);
+    }
+
+    const char* name = wh_config_next(&args);
+    if (!combo || !name)
+        return "expected bind [--repeat] <mods+key> <action> [arg]";
+
+    if (!wh_config_keysym(combo, &bind.mods, &bind.keysym))
+        return "unknown modifier or key";
+
+    for (size_t i = 0; i < sizeof(actions) / sizeof(actions[0]); i++)
+    {
+        if (strcmp(name, actions[i].name) == 0)
+            bind.action = actions[i].action;
+    }
+
+    switch (bind.action)
+    {
+    case WH_ACTION_SPAWN:
+        /* The command line is passed on as it is written */
+        bind.arg = wh_config_rest(&args);
+        break;
+    case WH_ACTION_MODE:
+    case WH_ACTION_CHVT:
+    case WH_ACTION_OUTPUT_ADD:
+    case WH_ACTION_OUTPUT_REMOVE:
+        bind.arg = wh_config_next(&args);
+        break;
+    case WH_ACTION_NONE:
+        return "unknown action";
+    default:
+        break;
+    }
+
+    if (!bind.arg && bind.action != WH_ACTION_CLOSE &&
+        bind.action != WH_ACTION_QUIT && bind.action != WH_ACTION_RELOAD)
+        return "missing action argument";
+
+    WhaleConfig* config = parser->config;
+    WhaleKeybind* slot = wh_config_append(
+        (void**)&config->binds, &config->num_binds, sizeof(WhaleKeybind)
+    );
+    if (!slot)
+        return "out of memory";
+
+    *slot = bind;
+    return NULL;
+}
+
+static const char* wh_config_throttle(WhaleConfig* config, char* args)
+{
+    const char* what = wh_config_next(&args);
+    const char* value = wh_config_next(&args);
+    WhaleThrottleConfig* throttle = &config->throttle;
+
+    u32* limit = NULL;
+    if (what && strcmp(what, "commits") == 0)
+        limit = &throttle->max_commits;
+    else if (what && strcmp(what, "buffers") == 0)
+        limit = &throttle->max_buffers;
+    else if (what && strcmp(what, "requests") == 0)
+        limit = &throttle->max_requests;
+    else if (what && strcmp(what, "fps") == 0)
+        limit = &throttle->throttled_fps;
+
+    if (!limit || !wh_config_u32(value, limit))
+        return "expected throttle commits|buffers|requests|fps <n>";
+
+    return NULL;
+}
+
+static const char* wh_config_memory(WhaleConfig* config, char* args)
+{
+    const char* what = wh_config_next(&args);
+    const char* value = wh_config_next(&args);
+
+    u32 mib;
+    if (what && strcmp(what, "limit") == 0 && wh_config_u32(value, &mib))
+    {
+        config->memory.soft_limit = (u64)mib * 1024 * 1024;
+        return NULL;
+    }
+
+    if (what && strcmp(what, "kill") == 0 && value)
+    {
+        config->memory.kill = strcmp(value, "yes") == 0;
+        return NULL;
+    }
+
+    return "expected memory limit <MiB> or memory kill yes|no";
+}
+
+static const char* wh_config_decoration(WhaleConfig* config, char* args)
+{
+    WhaleDecorationStyle* style = &config->decoration;
+    const char* what = wh_config_next(&args);
+    if (!what)
+        return "expected a decoration setting";
+
+    if (strcmp(what, "font") == 0)
+    {
+        style->font = wh_config_rest(&args);
+        return style->font ? NULL : "expected decoration font <font>";
+    }
+
+    u32 px;
+    if (strcmp(what, "border") == 0 || strcmp(what, "title") == 0)
+    {
+        if (!wh_config_u32(wh_config_next(&args), &px))
+            return "expected a size in pixels";
+
+        if (what[0] == 'b')
+            style->border_width = px;
+        else
+            style->title_height = px;
+        return NULL;
+    }
+
+    WhaleDecorationColors* colors = NULL;
+    if (strcmp(what, "focused") == 0)
+        colors = &style->focused;
+    else if (strcmp(what, "unfocused") == 0)
+        colors = &style->unfocused;
+    if (!colors)
+        return "unknown decoration setting";
+
+    const char* part = wh_config_next(&args);
+    float* color = NULL;
+    if (part && strcmp(part, "border") == 0)
+        color = colors->border;
+    else if (part && strcmp(part, "title") == 0)
+        color = colors->title;
+    else if (part && strcmp(part, "text") == 0)
+        color = colors->text;
+
+    if (!color || !wh_config_color(wh_config_next(&args), color))
+        return "expected border|title|text <rrggbb[aa]>";
+
+    return NULL;
+}
+
+static const char* wh_config_line(WhaleConfigParser* parser, char* line)
+{
+    WhaleConfig* config = parser->config;
+    char* cmd = wh_config_next(&line);
+    if (!cmd)
+        return NULL;
+
+    if (strcmp(cmd, "background") == 0)
+    {
+        if (!wh_config_color(wh_config_next(&line), config->background))
+            return "expected background <rrggbb[aa]>";
+    }
+    else if (strcmp(cmd, "keyboard") == 0)
+        return wh_config_keyboard(parser, line);
+    else if (strcmp(cmd, "repeat") == 0)
+    {
+        u32 rate, delay;
+        if (!wh_config_u32(wh_config_next(&line), &rate) ||
+            !wh_config_u32(wh_config_next(&line), &delay))
+            return "expected repeat <rate> <delay>";
+
+        config->repeat_rate = rate;
+        config->repeat_delay = delay;
+    }
+    else if (strcmp(cmd, "cursor") == 0)
+    {
+        const char* what = wh_config_next(&line);
+        const char* value = wh_config_next(&line);
+        if (what && value && strcmp(what, "theme") == 0)
+            config->cursor_theme = value;
+        else if (!what || strcmp(what, "size") != 0 ||
+                 !wh_config_u32(value, &config->cursor_size))
+            return "expected cursor theme <name> or cursor size <px>";
+    }
+    else if (strcmp(cmd, "output") == 0)
+        return wh_config_output_cmd(parser, line);
+    else if (strcmp(cmd, "mode") == 0)
+    {
+        const char* mode = wh_config_next(&line);
+        if (!mode)
+            return "expected mode <name>";
+
+        parser->mode = strcmp(mode, "default") == 0 ? NULL : mode;
+    }
+    else if (strcmp(cmd, "bind") == 0)
+        return wh_config_bind(parser, line);
+    else if (strcmp(cmd, "idle") == 0)
+    {
+        u32 seconds;
+        if (!wh_config_u32(wh_config_next(&line), &seconds))
+            return "expected idle <seconds>";
+
+        config->idle.dpms_timeout_ms = seconds * 1000;
+    }
+    else if (strcmp(cmd, "throttle") == 0)
+        return wh_config_throttle(config, line);
+    else if (strcmp(cmd, "memory") == 0)
+        return wh_config_memory(config, line);
+    else if (strcmp(cmd, "decoration") == 0)
+        return wh_config_decoration(config, line);
+    else if (strcmp(cmd, "seat") == 0)
+        return wh_config_seat(config, line);
+    else if (strcmp(cmd, "exec") == 0)
+    {
+        /* The command line is passed on as it is written */
+        const char* command = wh_config_rest(&line);
+        if (!command)
+            return "expected exec <command line>";
+
+        const char** slot = wh_config_append(
+            (void**)&config->autostart,
+            &config->num_autostart,
+            sizeof(const char*)
+        );
+        if (!slot)
+            return "out of memory";
+
+        *slot = command;
+    }
+    else
+        return "unknown command";
+
+    return NULL;
+}
+
+static void wh_config_free(WhaleConfig* config)
+{
+    free(config->keymaps);
+    free(config->outputs);
+    free(config->binds);
+    free(config->seats);
+    free(config->autostart);
+    free(config->text);
+    *config = (WhaleConfig){0};
+}
+
+/* The defaults and environment overrides, before the file is applied. */
+static void wh_config_defaults(WhaleConfig* config)
+{
+    *config = default_config;
+
+    const char* timeout = getenv("WHALE_DPMS_TIMEOUT");
+    if (timeout)
+        config->idle.dpms_timeout_ms = strtoul(timeout, NULL, 10) * 1000;
+}
+
+/* A missing file is read as an empty one. */
+static char* wh_config_read(const char* path)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return errno == ENOENT ? strdup("") : NULL;
+
+    struct stat st;
+    char* text = NULL;
+    if (fstat(fd, &st) == 0)
+        text = malloc(st.st_size + 1);
+
+    ssize_t len = text ? read(fd, text, st.st_size) : -1;
+    close(fd);
+
+    if (len < 0)
+    {
+        free(text);
+        return NULL;
+    }
+
+    text[len] = '\0';
+    return text;
+}
+
+/**
+ * Parse the file into `config`, which is left zeroed on failure.
+ *
+ * @returns 0 on success or a negative value on failure.
+ */
+static int wh_config_load(WhaleConfig* config, const char* path)
+{
+    wh_config_defaults(config);
+    config->text = wh_config_read(path);
+    if (!config->text)
+    {
+        wh_log(ERR, "config: Failed to read %s", path);
+        *config = (WhaleConfig){0};
+        return -1;
+    }
+
+    WhaleConfigParser parser = {.config = config};
+    int errors = 0;
+    int line_no = 0;
+
+    char* next = config->text;
+    while (next)
+    {
+        char* line = next;
+        line_no++;
+
+        next = strchr(line, '\n');
+        if (next)
+            *next++ = '\0';
+
+        const char* skip = line + strspn(line, " \t");
+        if (*skip == '#')
+            continue;
+
+        const char* error = wh_config_line(&parser, line);
+        if (error)
+        {
+            wh_log(ERR, "config: %s:%d: %s", path, line_no, error);
+            errors++;
+        }
+    }
+
+    /* Every other keyboard */
+    WhaleDeviceKeymap* fallback = wh_config_append(
+        (void**)&config->keymaps,
+        &config->num_keymaps,
+        sizeof(WhaleDeviceKeymap)
+    );
+    if (fallback)
+        fallback->names = parser.names;
+
+    if (errors || !fallback)
+    {
+        wh_config_free(config);
+        return -1;
+    }
+
+    return 0;
+}
+
+static bool wh_config_str_eq(const char* a, const char* b)
+{
+    if (!a || !b)
+        return a == b;
+    return strcmp(a, b) == 0;
+}
+
+static bool wh_config_keymaps_eq(const WhaleConfig* a, const WhaleConfig* b)
+{
+    if (a->num_keymaps != b->num_keymaps)
+        return false;
+
+    for (size_t i = 0; i < a->num_keymaps; i++)
+    {
+        const WhaleDeviceKeymap* x = &a->keymaps[i];
+        const WhaleDeviceKeymap* y = &b->keymaps[i];
+        if (!wh_config_str_eq(x->device, y->device) ||
+            !wh_config_str_eq(x->names.rules, y->names.rules) ||
+            !wh_config_str_eq(x->names.model, y->names.model) ||
+            !wh_config_str_eq(x->names.layout, y->names.layout) ||
+            !wh_config_str_eq(x->names.variant, y->names.variant) ||
+            !wh_config_str_eq(x->names.options, y->names.options))
+            return false;
+    }
+
+    return true;
+}
+
+static bool wh_config_binds_eq(const WhaleConfig* a, const WhaleConfig* b)
+{
+    if (a->num_binds != b->num_binds)
+        return false;
+
+    for (size_t i = 0; i < a->num_binds; i++)
+    {
+        const WhaleKeybind* x = &a->binds[i];
+        const WhaleKeybind* y = &b->binds[i];
+        if (x->mods != y->mods || x->keysym != y->keysym ||
+            x->action != y->action || x->repeat != y->repeat ||
+            !wh_config_str_eq(x->mode, y->mode) ||
+            !wh_config_str_eq(x->arg, y->arg))
+            return false;
+    }
+
+    return true;
+}
+
+static bool
+wh_config_output_eq(const WhaleOutputConfig* a, const WhaleOutputConfig* b)
+{
+    if (!a || !b)
+        return a == b;
+
+    return a->width == b->width && a->height == b->height &&
+           a->refresh == b->refresh && a->scale == b->scale;
+}
+
+/* Re-apply only what differs between the old and the current config. */
+static void wh_config_apply(WhaleCompositor* comp, const WhaleConfig* old)
+{
+    const WhaleConfig* config = &comp->config.current;
+
+    if (memcmp(old->background, config->background, sizeof(float[4])))
+        wlr_scene_rect_set_color(comp->root_bg_rect, config->background);
+
+    /* Before the keymaps, it exports the theme to the environment and
+    would have to wait for their prefetch otherwise. */
+    if (old->cursor_size != config->cursor_size ||
+        !wh_config_str_eq(old->cursor_theme, config->cursor_theme))
+        wh_input_cursor_theme_changed(comp);
+
+    /* The keymap cache compiles only keymaps it never saw, and keyboards
+    whose keymap stays the same are left alone. */
+    if (!wh_config_keymaps_eq(old, config))
+        wh_input_keymaps_changed(comp);
+
+    if (old->repeat_rate != config->repeat_rate ||
+        old->repeat_delay != config->repeat_delay)
+        wh_input_repeat_changed(comp);
+
+    if (!wh_config_binds_eq(old, config) && wh_keybind_reload(comp) < 0)
+        wh_log(ERR, "config: Keeping the previous keybindings");
+
+    WhaleOutput* output;
+    wl_list_for_each(output, &comp->outputs, link)
+    {
+        const char* name = output->wlr_output->name;
+        if (!wh_config_output_eq(
+                wh_config_output(old, name), wh_config_output(config, name)
+            ))
+        {
+            wh_output_configure(output);
+            wh_ipc_output_changed(comp, output);
+        }
+    }
+
+    wh_idle_set_config(comp, &config->idle);
+    comp->throttle.config = config->throttle;
+    comp->memory = config->memory;
+    wh_decoration_set_style(comp, &config->decoration);
+}
+
+int wh_config_reload(WhaleCompositor* comp)
+{
+    WhaleConfigFile* file = &comp->config;
+    if (!file->path)
+        return -1;
+
+    WhaleConfig config;
+    if (wh_config_load(&config, file->path) < 0)
+    {
+        wh_log(ERR, "config: Keeping the current config");
+        return -1;
+    }
+
+    /* Modules read the current config while applying it, the old one stays
+    alive until they no longer point into it. */
+    WhaleConfig old = file->current;
+    file->current = config;
+    wh_config_apply(comp, &old);
+    wh_config_free(&old);
+
+    wh_log(INFO, "config: Reloaded %s", file->path);
+    return 0;
+}
+
+static int on_reload_timer(void* data)
+{
+    wh_config_reload(data);
+    return 0;
+}
+
+static int on_inotify(int fd, u32, void* data)
+{
+    WhaleCompositor* comp = data;
+    WhaleConfigFile* file = &comp->config;
+
+    alignas(struct inotify_event) char buf[4096];
+    const char* base = strrchr(file->path, '/');
+    base = base ? base + 1 : file->path;
+    bool changed = false;
+
+    ssize_t len;
+    while ((len = read(fd, buf, sizeof(buf))) > 0)
+    {
+        for (char* p = buf; p < buf + len;)
+        {
+            struct inotify_event* ev = (struct inotify_event*)p;
+            if (ev->len && strcmp(ev->name, base) == 0)
+                changed = true;
+            p += sizeof(struct inotify_event) + ev->len;
+        }
+    }
+
+    if (changed)
+        wl_event_source_timer_update(
+            file->reload_timer, WH_CONFIG_RELOAD_DELAY_MS
+        );
+
+    return 0;
+}
+
+static char* wh_config_path(void)
+{
+    const char* path = getenv("WHALE_CONFIG");
+    if (path && *path)
+        return strdup(path);
+
+    char buf[512];
+    const char* config_home = getenv("XDG_CONFIG_HOME");
+    const char* home = getenv("HOME");
+    if (config_home && *config_home)
+        snprintf(buf, sizeof(buf), "%s/whale/config", config_home);
+    else if (home && *home)
+        snprintf(buf, sizeof(buf), "%s/.config/whale/config", home);
+    else
+        return NULL;
+
+    return strdup(buf);
+}
+
+/* The directory is watched rather than the file, editors save by writing
+a new file and renaming it over the old one. */
+static int wh_config_watch(WhaleCompositor* comp)
+{
+    WhaleConfigFile* file = &comp->config;
+    struct wl_event_loop* loop = wl_display_get_event_loop(comp->display);
+
+    char* dir = strdup(file->path);
+    if (!dir)
+        return -1;
+
+    file->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (file->inotify_fd < 0 ||
+        inotify_add_watch(
+            file->inotify_fd,
+            dirname(dir),
+            IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE | IN_MOVED_FROM
+        ) < 0)
+    {
+        free(dir);
+        return -1;
+    }
+    free(dir);
+
+    file->reload_timer = wl_event_loop_add_timer(loop, on_reload_timer, comp);
+    file->inotify_source = wl_event_loop_add_fd(
+        loop, file->inotify_fd, WL_EVENT_READABLE, on_inotify, comp
+    );
+    if (!file->reload_timer || !file->inotify_source)
+        return -1;
+
+    return 0;
+}
+
+int wh_config_init(WhaleCompositor* comp)
+{
+    WhaleConfigFile* file = &comp->config;
+    file->inotify_fd = -1;
+
+    file->path = wh_config_path();
+    if (!file->path || wh_config_load(&file->current, file->path) < 0)
+    {
+        /* Whale still comes up, the file is read again once it's fixed */
+        wh_log(WARN, "config: Using the default config");
+        wh_config_defaults(&file->current);
+
+        WhaleDeviceKeymap* fallback = wh_config_append(
+            (void**)&file->current.keymaps,
+            &file->current.num_keymaps,
+            sizeof(WhaleDeviceKeymap)
+        );
+        if (!fallback)
+            return -1;
+    }
+
+    if (file->path && wh_config_watch(comp) < 0)
+        wh_log(WARN, "config: Failed to watch %s", file->path);
+    else if (file->path)
+        wh_log(INFO, "config: %s", file->path);
+
+    return 0;
+}
+
+void wh_config_finish(WhaleCompositor* comp)
+{
+    WhaleConfigFile* file = &comp->config;
+
+    if (file->inotify_source)
+        wl_event_source_remove(file->inotify_source);
+    if (file->reload_timer)
+        wl_event_source_remove(file->reload_timer);
+    if (file->inotify_fd >= 0)
+        close(file->inotify_fd);
+
+    wh_config_free(&file->current);
+    free(file->path);
+    *file = (WhaleConfigFile){0};
+}
+
+const WhaleOutputConfig*
+wh_config_output(const WhaleConfig* config, const char* name)
+{
+    for (size_t i = 0; i < config->num_outputs; i++)
+    {
+        if (strcmp(config->outputs[i].name, name) == 0)
+            return &config->outputs[i];
+    }
+
+    return NULL;
+}
+
+bool wh_config_parse_mode(
+    const char* str, s32* width, s32* height, s32* refresh
+)
+{
+    double hz = 0;
+    int len = 0;
+    int matched = sscanf(str, "%dx%d%n@%lf%n", width, height, &len, &hz, &len);
+    if (matched < 2 || str[len] || *width <= 0 || *height <= 0 || hz < 0)
+        return false;
+
+    *refresh = (s32)(hz * 1000 + 0.5);
+    return true;
+}
@@ -0,0 +1,415 @@
+#define _POSIX_C_SOURCE 200809L
+#define WLR_USE_UNSTABLE
+#include <cairo.h>
+#include <drm_fourcc.h>
+#include <pango/pangocairo.h>
+#include <stdlib.h>
+#include <string.h>
+#include <whale/client.h>
+#include <whale/compositor.h>
+#include <whale/decoration.h>
+#include <whale/log.h>
+#include <whale/types.h>
+#include <wlr/interfaces/wlr_buffer.h>
+#include <wlr/types/wlr_scene.h>
+#include <wlr/util/edges.h>
+
+/* Title bars kept around, enough for every window of a busy session in
+both focus states */
+#define WH_DECORATION_MAX_TITLES 64
+
+/* A cairo image surface the scene can show. */
+typedef struct
+{
+    struct wlr_buffer base;
+    cairo_surface_t* surface;
+} WhaleCairoBuffer;
+
+/* A rendered title bar, shared by every client showing the same one. */
+typedef struct
+{
+    char* title;
+    int width;
+    bool focused;
+
+    /* The cache's reference, scene buffers showing it hold their own */
+    struct wlr_buffer* buffer;
+
+    /* WhaleDecorations::titles */
+    struct wl_list link;
+} WhaleTitleEntry;
+
+static void wh_cairo_buffer_destroy(struct wlr_buffer* wlr_buffer)
+{
+    WhaleCairoBuffer* buffer = wl_container_of(wlr_buffer, buffer, base);
+    cairo_surface_destroy(buffer->surface);
+    free(buffer);
+}
+
+static bool wh_cairo_buffer_begin_data_ptr_access(
+    struct wlr_buffer* wlr_buffer,
+    u32 flags,
+    void** data,
+    u32* format,
+    size_t* stride
+)
+{
+    WhaleCairoBuffer* buffer = wl_container_of(wlr_buffer, buffer, base);
+
+    /* Title bars never change once drawn */
+    if (flags & WLR_BUFFER_DATA_PTR_ACCESS_WRITE)
+        return false;
+
+    *data = cairo_image_surface_get_data(buffer->surface);
+    *format = DRM_FORMAT_ARGB8888;
+    *stride = cairo_image_surface_get_stride(buffer->surface);
+    return true;
+}
+
+static void wh_cairo_buffer_end_data_ptr_access(struct wlr_buffer*)
+{
+}
+
+static const struct wlr_buffer_impl cairo_buffer_impl = {
+    .destroy = wh_cairo_buffer_destroy,
+    .begin_data_ptr_access = wh_cairo_buffer_begin_data_ptr_access,
+    .end_data_ptr_access = wh_cairo_buffer_end_data_ptr_access,
+};
+
+static void wh_decoration_set_source(cairo_t* cr, const float color[4])
+{
+    cairo_set_source_rgba(cr, color[0], color[1], color[2], color[3]);
+}
+
+static struct wlr_buffer* wh_decoration_render_title(
+    const WhaleDecorationStyle* style,
+    const char* title,
+    int width,
+    bool focused
+)
+{
+    const WhaleDecorationColors* colors =
+        focused ? &style->focused : &style->unfocused;
+
+    WhaleCairoBuffer* buffer = calloc(1, sizeof(WhaleCairoBuffer));
+    if (!buffer)
+        return NULL;
+
+    buffer->surface = cairo_image_surface_create(
+        CAIRO_FORMAT_ARGB32, width, style->title_height
+    );
+    if (cairo_surface_status(buffer->surface) != CAIRO_STATUS_SUCCESS)
+    {
+        cairo_surface_destroy(buffer->surface);
+        free(buffer);
+        return NULL;
+    }
+
+    cairo_t* cr = cairo_create(buffer->surface);
+    wh_decoration_set_source(cr, colors->title);
+    cairo_paint(cr);
+
+    PangoLayout* layout = pango_cairo_create_layout(cr);
+    PangoFontDescription* font =
+        pango_font_description_from_string(style->font);
+    pango_layout_set_font_description(layout, font);
+    pango_font_description_free(font);
+
+    int padding = style->title_height / 4;
+    pango_layout_set_text(layout, title, -1);
+    pango_layout_set_width(layout, (width - 2 * padding) * PANGO_SCALE);
+    pango_layout_set_ellipsize(layout, PANGO_ELLIPSIZE_END);
+    pango_layout_set_single_paragraph_mode(layout, true);
+
+    int text_height;
+    pango_layout_get_pixel_size(layout, NULL, &text_height);
+
+    wh_decoration_set_source(cr, colors->text);
+    cairo_move_to(cr, padding, (style->title_height - text_height) / 2.);
+    pango_cairo_show_layout(cr, layout);
+
+    g_object_unref(layout);
+    cairo_destroy(cr);
+    cairo_surface_flush(buffer->surface);
+
+    wlr_buffer_init(
+        &buffer->base, &cairo_buffer_impl, width, style->title_height
+    );
+    return &buffer->base;
+}
+
+static void wh_decoration_entry_destroy(
+    WhaleDecorations* decorations, WhaleTitleEntry* entry
+)
+{
+    wlr_buffer_drop(entry->buffer);
+    wl_list_remove(&entry->link);
+    decorations->num_titles--;
+    free(entry->title);
+    free(entry);
+}
+
+/**
+ * Get the title bar for the given key, rendering it only if it isn't cached.
+ *
+ * @returns A buffer owned by the cache, lock it to keep it.
+ */
+static struct wlr_buffer* wh_decoration_get_title(
+    WhaleDecorations* decorations, const char* title, int width, bool focused
+)
+{
+    WhaleTitleEntry* entry;
+    wl_list_for_each(entry, &decorations->titles, link)
+    {
+        if (entry->width == width && entry->focused == focused &&
+            strcmp(entry->title, title) == 0)
+        {
+            wl_list_remove(&entry->link);
+            wl_list_insert(&decorations->titles, &entry->link);
+            return entry->buffer;
+        }
+    }
+
+    entry = calloc(1, sizeof(WhaleTitleEntry));
+    if (!entry)
+        return NULL;
+
+    entry->title = strdup(title);
+    entry->width = width;
+    entry->focused = focused;
+    entry->buffer = wh_decoration_render_title(
+        &decorations->style, title, width, focused
+    );
+    if (!entry->title || !entry->buffer)
+    {
+        if (entry->buffer)
+            wlr_buffer_drop(entry->buffer);
+        free(entry->title);
+        free(entry);
+        return NULL;
+    }
+
+    /* Evicting only drops the cache's reference, a title bar still shown
+    lives on until its scene buffer lets go of it. */
+    if (decorations->num_titles == WH_DECORATION_MAX_TITLES)
+    {
+        WhaleTitleEntry* lru =
+            wl_container_of(decorations->titles.prev, lru, link);
+        wh_decoration_entry_destroy(decorations, lru);
+    }
+
+    wl_list_insert(&decorations->titles, &entry->link);
+    decorations->num_titles++;
+
+    return entry->buffer;
+}
+
+void wh_decoration_insets(
+    const WhaleClient* client, int* left, int* right, int* top, int* bottom
+)
+{
+    if (!client->server_side_decorations)
+    {
+        *left = *right = *top = *bottom = 0;
+        return;
+    }
+
+    const WhaleDecorationStyle* style = &client->comp->decorations.style;
+    *left = *right = *bottom = style->border_width;
+    *top = style->border_width + style->title_height;
+}
+
+static bool wh_decoration_create(WhaleClient* client)
+{
+    WhaleDecoration* deco = &client->decoration;
+
+    deco->tree = wlr_scene_tree_create(client->scene_tree);
+    if (!deco->tree)
+        return false;
+
+    /* Below the client's surfaces */
+    wlr_scene_node_lower_to_bottom(&deco->tree->node);
+
+    static const float transparent[4] = {0};
+    for (int i = 0; i < 4; i++)
+        deco->borders[i] = wlr_scene_rect_create(deco->tree, 0, 0, transparent);
+    deco->title = wlr_scene_buffer_create(deco->tree, NULL);
+
+    return true;
+}
+
+void wh_decoration_update(WhaleClient* client)
+{
+    WhaleDecoration* deco = &client->decoration;
+
+    if (!client->server_side_decorations)
+    {
+        if (deco->tree)
+            wlr_scene_node_set_enabled(&deco->tree->node, false);
+        return;
+    }
+
+    if (!deco->tree && !wh_decoration_create(client))
+    {
+        wh_log(ERR, "decoration: Failed to create decoration");
+        return;
+    }
+
+    wlr_scene_node_set_enabled(&deco->tree->node, true);
+
+    const struct wlr_box geom = wh_client_get_geometry(client);
+    const char* title = wh_client_title(client);
+    bool focused = client->focus_count > 0;
+
+    if (deco->drawn_title && deco->drawn_width == geom.width &&
+        deco->drawn_height == geom.height && deco->drawn_focused == focused &&
+        strcmp(deco->drawn_title, title) == 0)
+        return;
+
+    WhaleDecorations* decorations = &client->comp->decorations;
+    const WhaleDecorationStyle* style = &decorations->style;
+    const WhaleDecorationColors* colors =
+        focused ? &style->focused : &style->unfocused;
+
+    int b = style->border_width;
+    int t = style->title_height;
+    int w = geom.width;
+    int h = geom.height;
+
+    /* Only redraw the title bar if what it shows changed, a focus change
+    on a cached title is just a buffer swap. */
+    if (!deco->drawn_title || deco->drawn_width != w ||
+        deco->drawn_focused != focused || strcmp(deco->drawn_title, title))
+    {
+        struct wlr_buffer* buffer =
+            w > 0 ? wh_decoration_get_title(decorations, title, w, focused)
+                  : NULL;
+        wlr_scene_buffer_set_buffer(deco->title, buffer);
+        wlr_scene_node_set_position(&deco->title->node, b, b);
+    }
+
+    const struct wlr_box boxes[4] = {
+        {0, 0, w + 2 * b, b},
+        {0, b + t + h, w + 2 * b, b},
+        {0, b, b, t + h},
+        {b + w, b, b, t + h},
+    };
+    for (int i = 0; i < 4; i++)
+    {
+        wlr_scene_node_set_position(
+            &deco->borders[i]->node, boxes[i].x, boxes[i].y
+        );
+        wlr_scene_rect_set_size(
+            deco->borders[i], boxes[i].width, boxes[i].height
+        );
+        wlr_scene_rect_set_color(deco->borders[i], colors->border);
+    }
+
+    free(deco->drawn_title);
+    deco->drawn_title = strdup(title);
+    deco->drawn_width = w;
+    deco->drawn_height = h;
+    deco->drawn_focused = focused;
+}
+
+void wh_decoration_destroy(WhaleClient* client)
+{
+    /* The scene nodes go with the client's tree */
+    free(client->decoration.drawn_title);
+    client->decoration = (WhaleDecoration){0};
+}
+
+WhaleClient* wh_decoration_at(
+    const WhaleCompositor* comp, double x, double y, u32* edges
+)
+{
+    double nx, ny;
+    struct wlr_scene_node* node =
+        wlr_scene_node_at(&comp->root_scene->tree.node, x, y, &nx, &ny);
+    if (!node || !node->parent)
+        return NULL;
+
+    static const u32 border_edges[4] = {
+        WLR_EDGE_TOP, WLR_EDGE_BOTTOM, WLR_EDGE_LEFT, WLR_EDGE_RIGHT
+    };
+
+    WhaleClient* client;
+    wl_list_for_each(client, &comp->clients, link)
+    {
+        WhaleDecoration* deco = &client->decoration;
+        if (!deco->tree || node->parent != deco->tree)
+            continue;
+
+        *edges = 0;
+        for (int i = 0; i < 4; i++)
+        {
+            if (node == &deco->borders[i]->node)
+                *edges = border_edges[i];
+        }
+
+        return client;
+    }
+
+    return NULL;
+}
+
+void wh_decoration_init(WhaleCompositor* comp)
+{
+    WhaleDecorations* decorations = &comp->decorations;
+    decorations->style = comp->config.current.decoration;
+    wl_list_init(&decorations->titles);
+}
+
+static bool wh_decoration_style_eq(
+    const WhaleDecorationStyle* a, const WhaleDecorationStyle* b
+)
+{
+    return a->border_width == b->border_width &&
+           a->title_height == b->title_height &&
+           strcmp(a->font, b->font) == 0 &&
+           memcmp(&a->focused, &b->focused, sizeof(a->focused)) == 0 &&
+           memcmp(&a->unfocused, &b->unfocused, sizeof(a->unfocused)) == 0;
+}
+
+void wh_decoration_set_style(
+    WhaleCompositor* comp, const WhaleDecorationStyle* style
+)
+{
+    WhaleDecorations* decorations = &comp->decorations;
+    bool changed = !wh_decoration_style_eq(&decorations->style, style);
+
+    /* Copied even if it's the same, the font string belongs to the config */
+    decorations->style = *style;
+    if (!changed)
+        return;
+
+    WhaleTitleEntry* entry;
+    WhaleTitleEntry* tmp;
+    wl_list_for_each_safe(entry, tmp, &decorations->titles, link)
+        wh_decoration_entry_destroy(decorations, entry);
+
+    /* The insets may have changed too, mapped clients are laid out again
+    as if they committed. */
+    WhaleClient* client;
+    wl_list_for_each(client, &comp->clients, link)
+    {
+        free(client->decoration.drawn_title);
+        client->decoration.drawn_title = NULL;
+
+        if (client->server_side_decorations && client->surface_tree &&
+            client->scene_tree->node.enabled)
+            wh_client_committed(client);
+    }
+
+    comp->scene_serial++;
+}
+
+void wh_decoration_finish(WhaleCompositor* comp)
+{
+    WhaleDecorations* decorations = &comp->decorations;
+
+    WhaleTitleEntry* entry;
+    WhaleTitleEntry* tmp;
+    wl_list_for_each_safe(entry, tmp, &decorations->titles, link)
+        wh_decoration_entry_destroy(decorations, entry);
+}
@@ -0,0 +1,786 @@
+#define _POSIX_C_SOURCE 200809L
+#define WLR_USE_UNSTABLE
+#include <drm_fourcc.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <whale/compositor.h>
+#include <whale/dump.h>
+#include <whale/log.h>
+#include <whale/output.h>
+#include <whale/types.h>
+#include <wlr/types/wlr_buffer.h>
+#include <wlr/types/wlr_output.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define WH_DUMP_X86
+#endif
+
+/* Frames the encoder may lag behind before new ones are dropped */
+#define WH_DUMP_MAX_QUEUED 3
+
+/* A copied frame waiting for (or done with) the encoder. */
+typedef struct
+{
+    char output[64];
+    u32 seq;
+    WhaleDumpFormat format;
+
+    u32 width;
+    u32 height;
+    /* DRM format of `pixels`, rows are tightly packed */
+    u32 drm_format;
+    u8* pixels;
+    size_t capacity;
+
+    /* WhaleDumper::queue or WhaleDumper::free */
+    struct wl_list link;
+} WhaleDumpFrame;
+
+/*
+ * Pixel conversion
+ *
+ * Everything is converted in place to straight-alpha RGBA bytes. The
+ * renderer's native formats are 32 bits per pixel, so this is a byte
+ * shuffle (plus forcing alpha for X formats), done 8 or 4 pixels at a time
+ * when the CPU can.
+ */
+
+/* Converts pixels from the start, returns how many it did. */
+typedef size_t (*WhaleSwizzleFn)(u8* px, size_t n, bool swap, bool opaque);
+
+static WhaleSwizzleFn swizzle_fn;
+
+static size_t wh_dump_swizzle_scalar(u8* px, size_t n, bool swap, bool opaque)
+{
+    for (size_t i = 0; i < n; i++, px += 4)
+    {
+        if (swap)
+        {
+            u8 tmp = px[0];
+            px[0] = px[2];
+            px[2] = tmp;
+        }
+
+        if (opaque)
+            px[3] = 0xff;
+    }
+
+    return n;
+}
+
+#ifdef WH_DUMP_X86
+__attribute__((target("ssse3"))) static size_t
+wh_dump_swizzle_ssse3(u8* px, size_t n, bool swap, bool opaque)
+{
+    const __m128i shuffle =
+        swap ? _mm_setr_epi8(
+                   2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15
+               )
+             : _mm_setr_epi8(
+                   0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15
+               );
+    const __m128i alpha =
+        opaque ? _mm_set1_epi32((int)0xff000000) : _mm_setzero_si128();
+
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        __m128i* p = (__m128i*)(px + i * 4);
+        __m128i v = _mm_loadu_si128(p);
+        v = _mm_or_si128(_mm_shuffle_epi8(v, shuffle), alpha);
+        _mm_storeu_si128(p, v);
+    }
+
+    return i;
+}
+
+__attribute__((target("avx2"))) static size_t
+wh_dump_swizzle_avx2(u8* px, size_t n, bool swap, bool opaque)
+{
+    /* vpshufb shuffles within each 128 bit lane, so both get the mask */
+    const __m256i shuffle =
+        swap ? _mm256_setr_epi8(
+                   2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15,
+                   2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15
+               )
+             : _mm256_setr_epi8(
+                   0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+                   0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15
+               );
+    const __m256i alpha =
+        opaque ? _mm256_set1_epi32((int)0xff000000) : _mm256_setzero_si256();
+
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256i* p = (__m256i*)(px + i * 4);
+        __m256i v = _mm256_loadu_si256(p);
+        v = _mm256_or_si256(_mm256_shuffle_epi8(v, shuffle), alpha);
+        _mm256_storeu_si256(p, v);
+    }
+
+    return i;
+}
+#endif
+
+/* Premultiplied to straight alpha, rare enough (outputs are normally
+opaque) that a scalar loop skipping opaque pixels is fine. */
+static void wh_dump_unpremultiply(u8* px, size_t n)
+{
+    for (size_t i = 0; i < n; i++, px += 4)
+    {
+        u32 a = px[3];
+        if (a == 0xff || a == 0)
+            continue;
+
+        for (int c = 0; c < 3; c++)
+            px[c] = (px[c] * 255 + a / 2) / a;
+    }
+}
+
+/* 32 bpp formats wh_dump_convert() handles. */
+static bool wh_dump_format_supported(u32 drm_format)
+{
+    return drm_format == DRM_FORMAT_XRGB8888 ||
+           drm_format == DRM_FORMAT_ARGB8888 ||
+           drm_format == DRM_FORMAT_XBGR8888 ||
+           drm_format == DRM_FORMAT_ABGR8888;
+}
+
+/**
+ * Convert a frame to RGBA in place.
+ *
+ * @returns false if the format isn't supported.
+ */
+static bool wh_dump_convert(WhaleDumpFrame* frame)
+{
+    bool swap;
+    bool opaque;
+    switch (frame->drm_format)
+    {
+    /* Little endian, so B G R A in memory */
+    case DRM_FORMAT_XRGB8888:
+        swap = opaque = true;
+        break;
+    case DRM_FORMAT_ARGB8888:
+        swap = true;
+        opaque = false;
+        break;
+    case DRM_FORMAT_XBGR8888:
+        swap = false;
+        opaque = true;
+        break;
+    case DRM_FORMAT_ABGR8888:
+        swap = opaque = false;
+        break;
+    default:
+        return false;
+    }
+
+    size_t n = (size_t)frame->width * frame->height;
+    size_t done = swizzle_fn(frame->pixels, n, swap, opaque);
+    wh_dump_swizzle_scalar(frame->pixels + done * 4, n - done, swap, opaque);
+
+    if (!opaque)
+        wh_dump_unpremultiply(frame->pixels, n);
+
+    return true;
+}
+
+/*
+ * Encoders
+ */
+
+static void wh_dump_put_be32(u8* dst, u32 v)
+{
+    dst[0] = v >> 24;
+    dst[1] = v >> 16;
+    dst[2] = v >> 8;
+    dst[3] = v;
+}
+
+static u32 crc_table[256];
+
+static void wh_dump_crc_init(void)
+{
+    for (u32 n = 0; n < 256; n++)
+    {
+        u32 c = n;
+        for (int k = 0; k < 8; k++)
+            c = c & 1 ? 0xedb88320 ^ (c >> 1) : c >> 1;
+        crc_table[n] = c;
+    }
+}
+
+static u32 wh_dump_crc(u32 crc, const u8* data, size_t len)
+{
+    crc = ~crc;
+    for (size_t i = 0; i < len; i++)
+        crc = crc_table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
+
+static void
+wh_dump_png_chunk(FILE* f, const char type[4], const u8* data, size_t len)
+{
+    u8 be[4];
+    wh_dump_put_be32(be, len);
+    fwrite(be, 1, 4, f);
+    fwrite(type, 1, 4, f);
+    if (len)
+        fwrite(data, 1, len, f);
+
+    u32 crc = wh_dump_crc(0, (const u8*)type, 4);
+    crc = wh_dump_crc(crc, data, len);
+    wh_dump_put_be32(be, crc);
+    fwrite(be, 1, 4, f);
+}
+
+/* Largest stored deflate block */
+#define WH_PNG_BLOCK 65535
+
+/* Streams the zlib data of the image as stored (uncompressed) deflate
+blocks, one IDAT chunk each. Dumps are for tests, speed matters more than
+size. */
+typedef struct
+{
+    FILE* f;
+    bool first;
+    u32 adler_a;
+    u32 adler_b;
+
+    size_t len;
+    /* zlib header, block header, block data, adler32 */
+    u8 chunk[2 + 5 + WH_PNG_BLOCK + 4];
+} WhalePngStream;
+
+static void wh_dump_png_flush(WhalePngStream* s, bool final)
+{
+    u8* p = s->chunk;
+    size_t header = 0;
+    if (s->first)
+    {
+        p[0] = 0x78;
+        p[1] = 0x01;
+        header = 2;
+        s->first = false;
+    }
+
+    /* The data was written after room for both headers, close the gap. */
+    if (!header)
+        memmove(p, p + 2, 5 + s->len);
+
+    u8* block = p + header;
+    block[0] = final;
+    block[1] = s->len;
+    block[2] = s->len >> 8;
+    block[3] = ~s->len;
+    block[4] = ~s->len >> 8;
+
+    size_t len = header + 5 + s->len;
+    if (final)
+    {
+        wh_dump_put_be32(p + len, s->adler_b << 16 | s->adler_a);
+        len += 4;
+    }
+
+    wh_dump_png_chunk(s->f, "IDAT", p, len);
+    s->len = 0;
+}
+
+static void wh_dump_png_write(WhalePngStream* s, const u8* data, size_t len)
+{
+    while (len)
+    {
+        if (s->len == WH_PNG_BLOCK)
+            wh_dump_png_flush(s, false);
+
+        size_t n = WH_PNG_BLOCK - s->len;
+        if (n > len)
+            n = len;
+
+        memcpy(s->chunk + 2 + 5 + s->len, data, n);
+
+        /* 5552 bytes is the most that can be summed before the sums could
+        overflow, see zlib's adler32.c */
+        for (size_t i = 0; i < n;)
+        {
+            size_t end = i + 5552 < n ? i + 5552 : n;
+            for (; i < end; i++)
+            {
+                s->adler_a += data[i];
+                s->adler_b += s->adler_a;
+            }
+            s->adler_a %= 65521;
+            s->adler_b %= 65521;
+        }
+
+        s->len += n;
+        data += n;
+        len -= n;
+    }
+}
+
+static bool wh_dump_write_png(FILE* f, const WhaleDumpFrame* frame)
+{
+    static const u8 signature[] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    fwrite(signature, 1, sizeof(signature), f);
+
+    u8 ihdr[13];
+    wh_dump_put_be32(ihdr, frame->width);
+    wh_dump_put_be32(ihdr + 4, frame->height);
+    ihdr[8] = 8;  /* bit depth */
+    ihdr[9] = 6;  /* RGBA */
+    ihdr[10] = 0; /* deflate */
+    ihdr[11] = 0; /* adaptive filtering */
+    ihdr[12] = 0; /* no interlace */
+    wh_dump_png_chunk(f, "IHDR", ihdr, sizeof(ihdr));
+
+    WhalePngStream* s = malloc(sizeof(WhalePngStream));
+    if (!s)
+        return false;
+
+    *s = (WhalePngStream){.f = f, .first = true, .adler_a = 1};
+
+    size_t stride = (size_t)frame->width * 4;
+    for (u32 y = 0; y < frame->height; y++)
+    {
+        static const u8 filter_none = 0;
+        wh_dump_png_write(s, &filter_none, 1);
+        wh_dump_png_write(s, frame->pixels + y * stride, stride);
+    }
+    wh_dump_png_flush(s, true);
+    free(s);
+
+    wh_dump_png_chunk(f, "IEND", NULL, 0);
+    return true;
+}
+
+static bool wh_dump_write_qoi(FILE* f, const WhaleDumpFrame* frame)
+{
+    u8 header[14] = {'q', 'o', 'i', 'f'};
+    wh_dump_put_be32(header + 4, frame->width);
+    wh_dump_put_be32(header + 8, frame->height);
+    header[12] = 4; /* RGBA */
+    header[13] = 0; /* sRGB */
+    fwrite(header, 1, sizeof(header), f);
+
+    u8 index[64][4] = {0};
+    u8 prev[4] = {0, 0, 0, 255};
+    u32 run = 0;
+
+    const u8* px = frame->pixels;
+    size_t n = (size_t)frame->width * frame->height;
+    for (size_t i = 0; i < n; i++, px += 4)
+    {
+        if (memcmp(px, prev, 4) == 0)
+        {
+            /* QOI_OP_RUN */
+            if (++run == 62 || i == n - 1)
+            {
+                fputc(0xc0 | (run - 1), f);
+                run = 0;
+            }
+            continue;
+        }
+
+        if (run)
+        {
+            fputc(0xc0 | (run - 1), f);
+            run = 0;
+        }
+
+        u32 hash = (px[0] * 3 + px[1] * 5 + px[2] * 7 + px[3] * 11) % 64;
+        if (memcmp(index[hash], px, 4) == 0)
+        {
+            /* QOI_OP_INDEX */
+            fputc(hash, f);
+        }
+        else if (px[3] == prev[3])
+        {
+            s8 dr = px[0] - prev[0];
+            s8 dg = px[1] - prev[1];
+            s8 db = px[2] - prev[2];
+            s8 dr_dg = dr - dg;
+            s8 db_dg = db - dg;
+
+            if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 &&
+                db <= 1)
+            {
+                /* QOI_OP_DIFF */
+                fputc(0x40 | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2), f);
+            }
+            else if (dg >= -32 && dg <= 31 && dr_dg >= -8 && dr_dg <= 7 &&
+                     db_dg >= -8 && db_dg <= 7)
+            {
+                /* QOI_OP_LUMA */
+                fputc(0x80 | (dg + 32), f);
+                fputc((dr_dg + 8) << 4 | (db_dg + 8), f);
+            }
+            else
+            {
+                /* QOI_OP_RGB */
+                fputc(0xfe, f);
+                fwrite(px, 1, 3, f);
+            }
+        }
+        else
+        {
+            /* QOI_OP_RGBA */
+            fputc(0xff, f);
+            fwrite(px, 1, 4, f);
+        }
+
+        memcpy(index[hash], px, 4);
+        memcpy(prev, px, 4);
+    }
+
+    static const u8 end[8] = {0, 0, 0, 0, 0, 0, 0, 1};
+    fwrite(end, 1, sizeof(end), f);
+    return true;
+}
+
+static bool wh_dump_write_raw(FILE* f, const WhaleDumpFrame* frame)
+{
+    size_t size = (size_t)frame->width * frame->height * 4;
+    return fwrite(frame->pixels, 1, size, f) == size;
+}
+
+static void wh_dump_write(const WhaleDumper* dumper, WhaleDumpFrame* frame)
+{
+    if (!wh_dump_convert(frame))
+    {
+        wh_log(
+            WARN, "dump: Unsupported format 0x%08x", (u32)frame->drm_format
+        );
+        return;
+    }
+
+    static const char* const ext[] = {
+        [WH_DUMP_PNG] = "png",
+        [WH_DUMP_QOI] = "qoi",
+        [WH_DUMP_RAW] = "rgba",
+    };
+
+    char path[4096];
+    if (frame->format == WH_DUMP_RAW)
+        snprintf(
+            path,
+            sizeof(path),
+            "%s/%s-%06u-%ux%u.%s",
+            dumper->dir,
+            frame->output,
+            frame->seq,
+            frame->width,
+            frame->height,
+            ext[frame->format]
+        );
+    else
+        snprintf(
+            path,
+            sizeof(path),
+            "%s/%s-%06u.%s",
+            dumper->dir,
+            frame->output,
+            frame->seq,
+            ext[frame->format]
+        );
+
+    FILE* f = fopen(path, "wb");
+    if (!f)
+    {
+        wh_log(ERR, "dump: Failed to open %s", path);
+        return;
+    }
+
+    /* Encoders write byte by byte, let stdio batch it. */
+    setvbuf(f, NULL, _IOFBF, 1 << 20);
+
+    bool ok = false;
+    switch (frame->format)
+    {
+    case WH_DUMP_PNG:
+        ok = wh_dump_write_png(f, frame);
+        break;
+    case WH_DUMP_QOI:
+        ok = wh_dump_write_qoi(f, frame);
+        break;
+    case WH_DUMP_RAW:
+        ok = wh_dump_write_raw(f, frame);
+        break;
+    }
+
+    if (fclose(f) != 0 || !ok)
+        wh_log(ERR, "dump: Failed to write %s", path);
+}
+
+static void* wh_dump_thread(void* data)
+{
+    WhaleDumper* dumper = data;
+
+    pthread_mutex_lock(&dumper->lock);
+    while (true)
+    {
+        while (dumper->running && wl_list_empty(&dumper->queue))
+            pthread_cond_wait(&dumper->cond, &dumper->lock);
+
+        if (wl_list_empty(&dumper->queue))
+            break;
+
+        WhaleDumpFrame* frame =
+            wl_container_of(dumper->queue.prev, frame, link);
+        wl_list_remove(&frame->link);
+        dumper->queued--;
+
+        pthread_mutex_unlock(&dumper->lock);
+        wh_dump_write(dumper, frame);
+        pthread_mutex_lock(&dumper->lock);
+
+        wl_list_insert(&dumper->free, &frame->link);
+    }
+    pthread_mutex_unlock(&dumper->lock);
+
+    return NULL;
+}
+
+void wh_dump_init(WhaleCompositor* comp)
+{
+    WhaleDumper* dumper = &comp->dumper;
+    wl_list_init(&dumper->queue);
+    wl_list_init(&dumper->free);
+    pthread_mutex_init(&dumper->lock, NULL);
+    pthread_cond_init(&dumper->cond, NULL);
+
+    dumper->dir = getenv("WHALE_DUMP_DIR");
+    if (!dumper->dir)
+        dumper->dir = ".";
+
+    const char* format = getenv("WHALE_DUMP");
+    if (format)
+    {
+        dumper->default_mode = WH_DUMP_EVERY_FRAME;
+        if (strcmp(format, "qoi") == 0)
+            dumper->default_format = WH_DUMP_QOI;
+        else if (strcmp(format, "raw") == 0)
+            dumper->default_format = WH_DUMP_RAW;
+        else
+            dumper->default_format = WH_DUMP_PNG;
+    }
+
+    wh_dump_crc_init();
+
+    swizzle_fn = wh_dump_swizzle_scalar;
+#ifdef WH_DUMP_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        swizzle_fn = wh_dump_swizzle_avx2;
+    else if (__builtin_cpu_supports("ssse3"))
+        swizzle_fn = wh_dump_swizzle_ssse3;
+#endif
+}
+
+void wh_dump_finish(WhaleCompositor* comp)
+{
+    WhaleDumper* dumper = &comp->dumper;
+
+    if (dumper->running)
+    {
+        pthread_mutex_lock(&dumper->lock);
+        dumper->running = false;
+        pthread_cond_signal(&dumper->cond);
+        pthread_mutex_unlock(&dumper->lock);
+        pthread_join(dumper->thread, NULL);
+    }
+
+    WhaleDumpFrame* frame;
+    WhaleDumpFrame* tmp;
+    wl_list_for_each_safe(frame, tmp, &dumper->free, link)
+    {
+        wl_list_remove(&frame->link);
+        free(frame->pixels);
+        free(frame);
+    }
+
+    if (dumper->dropped)
+        wh_log(
+            INFO,
+            "dump: %llu frames dropped",
+            (unsigned long long)dumper->dropped
+        );
+
+    pthread_cond_destroy(&dumper->cond);
+    pthread_mutex_destroy(&dumper->lock);
+}
+
+void wh_dump_output_set(
+    WhaleOutput* output, WhaleDumpMode mode, WhaleDumpFormat format
+)
+{
+    output->dump_mode = mode;
+    output->dump_format = format;
+
+    /* The scene only commits a buffer when something changed. Every buffer
+    it renders has the complete frame though, so asking for any frame is
+    enough. */
+    if (mode == WH_DUMP_ONCE)
+    {
+        wlr_output_update_needs_frame(output->wlr_output);
+        wlr_output_schedule_frame(output->wlr_output);
+    }
+}
+
+/**
+ * Get a frame whose pixels can hold `size` bytes, recycling one the encoder
+ * is done with if possible.
+ *
+ * @returns The frame or NULL if the encoder is too far behind.
+ */
+static WhaleDumpFrame* wh_dump_frame_get(WhaleDumper* dumper, size_t size)
+{
+    WhaleDumpFrame* frame = NULL;
+
+    pthread_mutex_lock(&dumper->lock);
+    if (dumper->queued < WH_DUMP_MAX_QUEUED && !wl_list_empty(&dumper->free))
+    {
+        frame = wl_container_of(dumper->free.next, frame, link);
+        wl_list_remove(&frame->link);
+    }
+    bool full = dumper->queued >= WH_DUMP_MAX_QUEUED;
+    pthread_mutex_unlock(&dumper->lock);
+
+    if (full)
+        return NULL;
+
+    if (!frame)
+        frame = calloc(1, sizeof(WhaleDumpFrame));
+    if (!frame)
+        return NULL;
+
+    if (frame->capacity < size)
+    {
+        free(frame->pixels);
+        frame->pixels = malloc(size);
+        frame->capacity = frame->pixels ? size : 0;
+    }
+
+    if (!frame->pixels)
+    {
+        free(frame);
+        return NULL;
+    }
+
+    return frame;
+}
+
+/**
+ * Copy the buffer's pixels into the frame, tightly packed. Only buffers the
+ * CPU can read are copied, like those of the pixman renderer. Reading GPU
+ * buffers back waits for the GPU, which the frame handler can't afford.
+ *
+ * @returns false if the buffer can't be read.
+ */
+static bool wh_dump_frame_copy(WhaleDumpFrame* frame, struct wlr_buffer* buffer)
+{
+    size_t dst_stride = (size_t)buffer->width * 4;
+
+    void* data;
+    u32 format;
+    size_t stride;
+    if (!wlr_buffer_begin_data_ptr_access(
+            buffer, WLR_BUFFER_DATA_PTR_ACCESS_READ, &data, &format, &stride
+        ))
+        return false;
+
+    /* Rows of other formats have another size, copying them as 32 bpp
+    would read past the end of the buffer. */
+    if (!wh_dump_format_supported(format) || stride < dst_stride)
+    {
+        wlr_buffer_end_data_ptr_access(buffer);
+        wh_log(WARN, "dump: Unsupported format 0x%08x", format);
+        return false;
+    }
+
+    for (int y = 0; y < buffer->height; y++)
+        memcpy(
+            frame->pixels + y * dst_stride,
+            (const u8*)data + y * stride,
+            dst_stride
+        );
+
+    wlr_buffer_end_data_ptr_access(buffer);
+    frame->drm_format = format;
+    return true;
+}
+
+static void wh_dump_queue(WhaleOutput* output, struct wlr_buffer* buffer)
+{
+    WhaleDumper* dumper = &output->comp->dumper;
+
+    if (!dumper->running)
+    {
+        if (pthread_create(&dumper->thread, NULL, wh_dump_thread, dumper) != 0)
+        {
+            wh_log(ERR, "dump: Failed to start the encoder thread");
+            output->dump_mode = WH_DUMP_OFF;
+            return;
+        }
+        dumper->running = true;
+    }
+
+    size_t size = (size_t)buffer->width * buffer->height * 4;
+    WhaleDumpFrame* frame = wh_dump_frame_get(dumper, size);
+    if (!frame)
+    {
+        if (dumper->dropped++ == 0)
+            wh_log(WARN, "dump: Encoder is behind, dropping frames");
+        return;
+    }
+
+    if (!wh_dump_frame_copy(frame, buffer))
+    {
+        /* Its buffers won't become readable, said once */
+        wh_log(
+            WARN,
+            "dump: Can't read %s from the CPU, not dumping it",
+            output->wlr_output->name
+        );
+        output->dump_mode = WH_DUMP_OFF;
+        pthread_mutex_lock(&dumper->lock);
+        wl_list_insert(&dumper->free, &frame->link);
+        pthread_mutex_unlock(&dumper->lock);
+        return;
+    }
+
+    snprintf(
+        frame->output, sizeof(frame->output), "%s", output->wlr_output->name
+    );
+    frame->seq = output->dump_seq++;
+    frame->format = output->dump_format;
+    frame->width = buffer->width;
+    frame->height = buffer->height;
+
+    pthread_mutex_lock(&dumper->lock);
+    wl_list_insert(&dumper->queue, &frame->link);
+    dumper->queued++;
+    pthread_cond_signal(&dumper->cond);
+    pthread_mutex_unlock(&dumper->lock);
+
+    if (output->dump_mode == WH_DUMP_ONCE)
+        output->dump_mode = WH_DUMP_OFF;
+}
+
+void wh_dump_output_commit(WhaleOutput* output)
+{
+    struct wlr_output_state state;
+    wlr_output_state_init(&state);
+
+    if (wlr_scene_output_build_state(output->scene_output, &state, NULL) &&
+        wlr_output_commit_state(output->wlr_output, &state) &&
+        state.committed & WLR_OUTPUT_STATE_BUFFER)
+        wh_dump_queue(output, state.buffer);
+
+    wlr_output_state_finish(&state);
+}
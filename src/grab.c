@@ -0,0 +1,158 @@
+#define WLR_USE_UNSTABLE
+#include <whale/client.h>
+#include <whale/compositor.h>
+#include <whale/grab.h>
+#include <whale/log.h>
+#include <whale/seat.h>
+#include <whale/types.h>
+#include <wlr/types/wlr_output_layout.h>
+#include <wlr/util/edges.h>
+#include <wlr/xcursor.h>
+
+/* Smallest content size a resize goes down to */
+#define WH_GRAB_MIN_SIZE 32
+
+void wh_grab_begin(
+    WhaleSeat* seat, WhaleClient* client, WhaleGrabMode mode, u32 edges
+)
+{
+    if (seat->grab.mode != WH_GRAB_NONE || client->grabbed)
+        return;
+
+    wh_client_float(client);
+
+    seat->grab = (WhaleGrab){
+        .mode = mode,
+        .client = client,
+        .edges = edges,
+        .start_x = seat->cursor->x,
+        .start_y = seat->cursor->y,
+        .start_box = client->float_box,
+    };
+    client->grabbed = true;
+
+    /* Clients don't see the pointer while it drags one of them around */
+    wlr_seat_pointer_notify_clear_focus(seat->wlr_seat);
+    wlr_cursor_set_xcursor(
+        seat->cursor,
+        seat->comp->cursor_manager,
+        mode == WH_GRAB_MOVE ? "grabbing" : wlr_xcursor_get_resize_name(edges)
+    );
+
+    wh_log(
+        DEBUG,
+        "grab: %s %s client %u",
+        seat->wlr_seat->name,
+        mode == WH_GRAB_MOVE ? "move" : "resize",
+        client->id
+    );
+}
+
+void wh_grab_motion(WhaleSeat* seat)
+{
+    WhaleGrab* grab = &seat->grab;
+    if (grab->mode == WH_GRAB_NONE)
+        return;
+
+    /* Pointers report far more often than outputs refresh, only the last
+    position matters by the time the next frame is drawn. */
+    grab->pending = true;
+
+    struct wlr_output* output = wlr_output_layout_output_at(
+        seat->comp->output_layout, seat->cursor->x, seat->cursor->y
+    );
+    if (output)
+        wlr_output_schedule_frame(output);
+}
+
+/* Stretch the start box by the cursor's travel along the dragged edges. */
+static struct wlr_box wh_grab_resize_box(const WhaleGrab* grab, int dx, int dy)
+{
+    struct wlr_box box = grab->start_box;
+
+    if (grab->edges & WLR_EDGE_LEFT)
+        box.width -= dx;
+    else if (grab->edges & WLR_EDGE_RIGHT)
+        box.width += dx;
+
+    if (grab->edges & WLR_EDGE_TOP)
+        box.height -= dy;
+    else if (grab->edges & WLR_EDGE_BOTTOM)
+        box.height += dy;
+
+    if (box.width < WH_GRAB_MIN_SIZE)
+        box.width = WH_GRAB_MIN_SIZE;
+    if (box.height < WH_GRAB_MIN_SIZE)
+        box.height = WH_GRAB_MIN_SIZE;
+
+    /* The opposite edges stay where they were */
+    if (grab->edges & WLR_EDGE_LEFT)
+        box.x += grab->start_box.width - box.width;
+    if (grab->edges & WLR_EDGE_TOP)
+        box.y += grab->start_box.height - box.height;
+
+    return box;
+}
+
+static void wh_grab_apply_seat(WhaleSeat* seat)
+{
+    WhaleGrab* grab = &seat->grab;
+    if (grab->mode == WH_GRAB_NONE || !grab->pending)
+        return;
+
+    grab->pending = false;
+
+    int dx = (int)(seat->cursor->x - grab->start_x);
+    int dy = (int)(seat->cursor->y - grab->start_y);
+
+    if (grab->mode == WH_GRAB_MOVE)
+    {
+        wh_client_move(
+            grab->client, grab->start_box.x + dx, grab->start_box.y + dy
+        );
+        return;
+    }
+
+    struct wlr_box box = wh_grab_resize_box(grab, dx, dy);
+    wh_client_resize(grab->client, &box, grab->edges);
+}
+
+void wh_grab_apply(WhaleCompositor* comp)
+{
+    WhaleSeat* seat;
+    wl_list_for_each(seat, &comp->seats, link)
+        wh_grab_apply_seat(seat);
+}
+
+static void wh_grab_reset(WhaleSeat* seat)
+{
+    seat->grab.client->grabbed = false;
+    seat->grab = (WhaleGrab){0};
+    wlr_cursor_set_xcursor(seat->cursor, seat->comp->cursor_manager, "default");
+}
+
+void wh_grab_end(WhaleSeat* seat)
+{
+    if (seat->grab.mode == WH_GRAB_NONE)
+        return;
+
+    /* Motion since the last frame still counts */
+    wh_grab_apply_seat(seat);
+    wh_grab_reset(seat);
+}
+
+void wh_grab_client_gone(WhaleClient* client)
+{
+    if (!client->grabbed)
+        return;
+
+    WhaleSeat* seat;
+    wl_list_for_each(seat, &client->comp->seats, link)
+    {
+        if (seat->grab.client == client)
+        {
+            wh_grab_reset(seat);
+            return;
+        }
+    }
+}
@@ -0,0 +1,282 @@
+#define _POSIX_C_SOURCE 199309L
+#define WLR_USE_UNSTABLE
+#include <stdlib.h>
+#include <time.h>
+#include <whale/compositor.h>
+#include <whale/idle.h>
+#include <whale/ipc.h>
+#include <whale/log.h>
+#include <whale/output.h>
+#include <whale/types.h>
+#include <wlr/types/wlr_idle_inhibit_v1.h>
+#include <wlr/types/wlr_idle_notify_v1.h>
+#include <wlr/types/wlr_output_power_management_v1.h>
+
+/* Keeps the outputs on and idle clients quiet while it lives. */
+typedef struct
+{
+    WhaleCompositor* comp;
+    struct wl_listener destroy;
+
+    /* WhaleIdle::inhibitors */
+    struct wl_list link;
+} WhaleIdleInhibitor;
+
+static u64 wh_idle_now_ms(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (u64)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+static void wh_idle_arm(WhaleIdle* idle, u64 ms)
+{
+    if (!idle->config.dpms_timeout_ms || !idle->dpms_timer)
+        return;
+
+    wl_event_source_timer_update(idle->dpms_timer, ms ? ms : 1);
+    idle->timer_armed = true;
+}
+
+static bool wh_idle_output_set_enabled(WhaleOutput* output, bool enabled)
+{
+    struct wlr_output_state state;
+    wlr_output_state_init(&state);
+    wlr_output_state_set_enabled(&state, enabled);
+    bool ok = wlr_output_commit_state(output->wlr_output, &state);
+    wlr_output_state_finish(&state);
+
+    if (!ok)
+    {
+        wh_log(
+            ERR,
+            "idle: Failed to turn %s %s",
+            output->wlr_output->name,
+            enabled ? "on" : "off"
+        );
+        return false;
+    }
+
+    /* A disabled output doesn't send frame events, its frame loop is only
+    started again here. */
+    if (enabled)
+        wlr_output_schedule_frame(output->wlr_output);
+
+    wh_ipc_output_changed(output->comp, output);
+    return true;
+}
+
+static void wh_idle_blank(WhaleCompositor* comp)
+{
+    WhaleOutput* output;
+    wl_list_for_each(output, &comp->outputs, link)
+    {
+        /* Virtual outputs are watched from elsewhere, local input says
+        nothing about their viewers. */
+        if (!output->wlr_output->enabled || output->is_virtual)
+            continue;
+
+        if (wh_idle_output_set_enabled(output, false))
+            output->idle_off = true;
+    }
+
+    comp->idle.blanked = true;
+    wh_log(INFO, "idle: Outputs off");
+}
+
+static void wh_idle_wake(WhaleCompositor* comp)
+{
+    WhaleOutput* output;
+    wl_list_for_each(output, &comp->outputs, link)
+    {
+        if (!output->idle_off || output->is_virtual)
+            continue;
+
+        output->idle_off = false;
+        wh_idle_output_set_enabled(output, true);
+    }
+
+    comp->idle.blanked = false;
+    wh_log(INFO, "idle: Outputs on");
+}
+
+static int on_dpms_timer(void* data)
+{
+    WhaleCompositor* comp = data;
+    WhaleIdle* idle = &comp->idle;
+
+    idle->timer_armed = false;
+
+    u64 idle_ms = wh_idle_now_ms() - idle->last_activity_ms;
+    if (idle_ms < idle->config.dpms_timeout_ms)
+    {
+        wh_idle_arm(idle, idle->config.dpms_timeout_ms - idle_ms);
+        return 0;
+    }
+
+    /* Re-armed when the last inhibitor goes away */
+    if (!wl_list_empty(&idle->inhibitors))
+        return 0;
+
+    wh_idle_blank(comp);
+    return 0;
+}
+
+void wh_idle_activity(WhaleCompositor* comp, struct wlr_seat* seat)
+{
+    WhaleIdle* idle = &comp->idle;
+    if (!idle->notifier)
+        return;
+
+    wlr_idle_notifier_v1_notify_activity(idle->notifier, seat);
+    idle->last_activity_ms = wh_idle_now_ms();
+
+    if (idle->blanked)
+        wh_idle_wake(comp);
+
+    if (!idle->timer_armed)
+        wh_idle_arm(idle, idle->config.dpms_timeout_ms);
+}
+
+static void on_inhibitor_destroy(struct wl_listener* listener, void*)
+{
+    WhaleIdleInhibitor* inhibitor =
+        wl_container_of(listener, inhibitor, destroy);
+    WhaleIdle* idle = &inhibitor->comp->idle;
+
+    UNLISTEN(&inhibitor->destroy);
+    wl_list_remove(&inhibitor->link);
+    free(inhibitor);
+
+    if (!wl_list_empty(&idle->inhibitors))
+        return;
+
+    wlr_idle_notifier_v1_set_inhibited(idle->notifier, false);
+
+    /* The full timeout starts over from here */
+    idle->last_activity_ms = wh_idle_now_ms();
+    if (!idle->timer_armed && !idle->blanked)
+        wh_idle_arm(idle, idle->config.dpms_timeout_ms);
+}
+
+static void on_new_inhibitor(struct wl_listener* listener, void* data)
+{
+    WhaleCompositor* comp =
+        wl_container_of(listener, comp, idle.listeners.new_inhibitor);
+    struct wlr_idle_inhibitor_v1* wlr_inhibitor = data;
+
+    WhaleIdleInhibitor* inhibitor = calloc(1, sizeof(WhaleIdleInhibitor));
+    if (!inhibitor)
+    {
+        wh_log(ERR, "idle: Failed to allocate inhibitor");
+        return;
+    }
+
+    inhibitor->comp = comp;
+    LISTEN(
+        &wlr_inhibitor->events.destroy,
+        &inhibitor->destroy,
+        on_inhibitor_destroy
+    );
+    wl_list_insert(&comp->idle.inhibitors, &inhibitor->link);
+
+    wlr_idle_notifier_v1_set_inhibited(comp->idle.notifier, true);
+
+    /* Whatever wanted to stay awake should be seen */
+    if (comp->idle.blanked)
+        wh_idle_wake(comp);
+}
+
+static void on_power_set_mode(struct wl_listener* listener, void* data)
+{
+    WhaleCompositor* comp =
+        wl_container_of(listener, comp, idle.listeners.power_set_mode);
+    struct wlr_output_power_v1_set_mode_event* ev = data;
+
+    WhaleOutput* output;
+    wl_list_for_each(output, &comp->outputs, link)
+    {
+        if (output->wlr_output != ev->output)
+            continue;
+
+        /* The client is in charge of this output now, input won't turn it
+        back on. */
+        output->idle_off = false;
+        wh_idle_output_set_enabled(
+            output, ev->mode == ZWLR_OUTPUT_POWER_V1_MODE_ON
+        );
+        return;
+    }
+}
+
+int wh_idle_init(WhaleCompositor* comp)
+{
+    WhaleIdle* idle = &comp->idle;
+    idle->config = comp->config.current.idle;
+    wl_list_init(&idle->inhibitors);
+
+    idle->notifier = wlr_idle_notifier_v1_create(comp->display);
+    idle->inhibit_manager = wlr_idle_inhibit_v1_create(comp->display);
+    idle->power_manager = wlr_output_power_manager_v1_create(comp->display);
+    idle->dpms_timer = wl_event_loop_add_timer(
+        wl_display_get_event_loop(comp->display), on_dpms_timer, comp
+    );
+    if (!idle->notifier || !idle->inhibit_manager || !idle->power_manager ||
+        !idle->dpms_timer)
+    {
+        wh_log(ERR, "idle: Failed to create idle globals");
+        return -1;
+    }
+
+    LISTEN(
+        &idle->inhibit_manager->events.new_inhibitor,
+        &idle->listeners.new_inhibitor,
+        on_new_inhibitor
+    );
+    LISTEN(
+        &idle->power_manager->events.set_mode,
+        &idle->listeners.power_set_mode,
+        on_power_set_mode
+    );
+
+    idle->last_activity_ms = wh_idle_now_ms();
+    wh_idle_arm(idle, idle->config.dpms_timeout_ms);
+
+    return 0;
+}
+
+void wh_idle_set_config(WhaleCompositor* comp, const WhaleIdleConfig* config)
+{
+    WhaleIdle* idle = &comp->idle;
+    if (idle->config.dpms_timeout_ms == config->dpms_timeout_ms)
+        return;
+
+    idle->config = *config;
+    if (!idle->dpms_timer || idle->blanked)
+        return;
+
+    if (!config->dpms_timeout_ms)
+    {
+        wl_event_source_timer_update(idle->dpms_timer, 0);
+        idle->timer_armed = false;
+        return;
+    }
+
+    /* Still counted from the last input */
+    u64 idle_ms = wh_idle_now_ms() - idle->last_activity_ms;
+    wh_idle_arm(
+        idle,
+        idle_ms < config->dpms_timeout_ms ? config->dpms_timeout_ms - idle_ms
+                                          : 0
+    );
+}
+
+void wh_idle_finish(WhaleCompositor* comp)
+{
+    WhaleIdle* idle = &comp->idle;
+
+    if (idle->dpms_timer)
+        wl_event_source_remove(idle->dpms_timer);
+    idle->dpms_timer = NULL;
+    idle->timer_armed = false;
+}
@@ -1,128 +1,250 @@
 #define _POSIX_C_SOURCE 200112L
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
 #include <time.h>
+#include <unistd.h>
 #include <whale/client.h>
+#include <whale/config.h>
+#include <whale/grab.h>
+#include <whale/idle.h>
 #include <whale/input.h>
+#include <whale/keybind.h>
+#include <whale/keymap.h>
 #include <whale/log.h>
+#include <whale/seat.h>
+#include <whale/tablet.h>
 #include <whale/types.h>
 #include <wlr/types/wlr_cursor.h>
+#include <wlr/types/wlr_pointer_gestures_v1.h>
+#include <wlr/types/wlr_touch.h>
 #include <wlr/types/wlr_xcursor_manager.h>
 #include <xkbcommon/xkbcommon.h>
 
-static void on_cursor_motion(struct wl_listener*, void*)
+static void wh_input_key_repeat_stop(KeyboardGroup* group)
 {
-    wh_log(DEBUG, "cursor: motion");
+    if (!group->repeat_bind)
+        return;
+
+    /* A zeroed it_value disarms the timer. */
+    struct itimerspec spec = {0};
+    timerfd_settime(group->key_repeat_fd, 0, &spec, NULL);
+
+    group->repeat_bind = NULL;
+}
+
+static void wh_input_key_repeat_stop_all(WhaleSeat* seat)
+{
+    KeyboardGroup* group;
+    wl_list_for_each(group, &seat->keyboard_groups, link)
+        wh_input_key_repeat_stop(group);
 }
 
-static bool wh_input_is_client_focused(const WhaleClient* client)
+static bool
+wh_input_is_client_focused(const WhaleSeat* seat, const WhaleClient* client)
 {
-    return client->comp->seat->keyboard_state.focused_surface ==
-           client->xdg_toplevel->base->surface;
+    return seat->wlr_seat->keyboard_state.focused_surface ==
+           wh_client_surface(client);
+}
+
+static void wh_input_keyboard_enter(WhaleSeat* seat, const WhaleClient* client)
+{
+    struct wlr_keyboard* keyboard = wlr_seat_get_keyboard(seat->wlr_seat);
+
+    wh_input_key_repeat_stop_all(seat);
+
+    wlr_seat_keyboard_notify_enter(
+        seat->wlr_seat,
+        wh_client_surface(client),
+        keyboard->keycodes,
+        keyboard->num_keycodes,
+        &keyboard->modifiers
+    );
 }
 
 /**
- * Focus all inputs on the specified client, meaning the keyboard, 
- * pointer.
+ * Focus all inputs of the seat on the specified client, meaning the
+ * keyboard, pointer.
  * 
- * @param enter_x X coord where the pointer entered the client
- * @param enter_y Y coord where the pointer entered the client
+ * @param pointer_surf The client's surface the pointer entered, the toplevel
+ * itself, one of its popups or subsurfaces.
+ * @param enter_x X coord where the pointer entered `pointer_surf`
+ * @param enter_y Y coord where the pointer entered `pointer_surf`
  * @param client The client that should receive focus.
  * 
  * @returns 0 on success or a negative value on failure.
  */
 static int wh_input_focus_all_inputs_on_client(
-    double enter_x, double enter_y, const WhaleClient* client
+    WhaleSeat* seat,
+    struct wlr_surface* pointer_surf,
+    double enter_x,
+    double enter_y,
+    const WhaleClient* client
 )
 {
-    WhaleCompositor* comp = client->comp;
-    struct wlr_seat* seat = comp->seat;
-    struct wlr_surface* surf = client->xdg_toplevel->base->surface;
-
-    struct wlr_keyboard* keyboard =
-        &comp->keyboard_group.wlr_keyboard_group->keyboard;
-
-    wlr_seat_keyboard_notify_enter(
-        seat,
-        surf,
-        keyboard->keycodes,
-        keyboard->num_keycodes,
-        &keyboard->modifiers
+    wh_input_keyboard_enter(seat, client);
+    wlr_seat_pointer_notify_enter(
+        seat->wlr_seat, pointer_surf, enter_x, enter_y
     );
 
-    wlr_seat_pointer_notify_enter(seat, surf, enter_x, enter_y);
-
     return 0;
 }
 
-static int wh_input_unfocus_all_inputs(const WhaleCompositor* comp)
+static int wh_input_unfocus_all_inputs(WhaleSeat* seat)
 {
-    struct wlr_seat* seat = comp->seat;
-    if (seat->keyboard_state.focused_surface)
+    struct wlr_seat* wlr_seat = seat->wlr_seat;
+    if (wlr_seat->keyboard_state.focused_surface)
     {
-        wlr_seat_keyboard_notify_clear_focus(seat);
-        wlr_seat_pointer_notify_clear_focus(seat);
+        wh_input_key_repeat_stop_all(seat);
+        wlr_seat_keyboard_notify_clear_focus(wlr_seat);
+        wlr_seat_pointer_notify_clear_focus(wlr_seat);
     }
 
     return 0;
 }
 
-static void on_cursor_motion_absolute(struct wl_listener* listener, void* data)
+void wh_input_cursor_motion(WhaleSeat* seat, u32 time_msec)
 {
-    WhaleCompositor* comp =
-        wl_container_of(listener, comp, listeners.cursor_motion_absolute);
+    /* Nothing under a dragged window gets the pointer */
+    if (seat->grab.mode != WH_GRAB_NONE)
+    {
+        wh_grab_motion(seat);
+        return;
+    }
 
-    struct wlr_pointer_motion_absolute_event* ev = data;
+    double x = seat->cursor->x;
+    double y = seat->cursor->y;
 
-    double x;
-    double y;
-    wlr_cursor_absolute_to_layout_coords(
-        comp->cursor, &ev->pointer->base, ev->x, ev->y, &x, &y
-    );
-
-    /* Get the top-most node over which our cursor is currently hovering. */
-    WhaleClient* hovered_client = wh_client_get_at_coords(x, y, comp);
+    /* Get the top-most surface over which our cursor is currently hovering,
+    it may be a popup or subsurface of the client. */
+    struct wlr_surface* surf;
+    double surf_x;
+    double surf_y;
+    WhaleClient* hovered_client =
+        wh_seat_client_at(seat, x, y, &surf, &surf_x, &surf_y);
     if (!hovered_client)
     {
+        u32 edges = 0;
+        WhaleClient* deco_client =
+            wh_decoration_at(seat->comp, x, y, &edges);
+
         /* This needs to be re-set every time in order to show up on screen
         (?)
          */
-        wlr_cursor_set_xcursor(comp->cursor, comp->cursor_manager, "default");
-        wh_input_unfocus_all_inputs(comp);
+        wlr_cursor_set_xcursor(
+            seat->cursor,
+            seat->comp->cursor_manager,
+            edges ? wlr_xcursor_get_resize_name(edges) : "default"
+        );
+
+        /* A window's own title bar and borders are part of it, they keep or
+        give it the keyboard. Only its surfaces lose the pointer. */
+        if (deco_client)
+        {
+            if (!wh_input_is_client_focused(seat, deco_client))
+                wh_input_keyboard_enter(seat, deco_client);
+
+            wlr_seat_pointer_notify_clear_focus(seat->wlr_seat);
+            return;
+        }
+
+        wh_input_unfocus_all_inputs(seat);
         return;
     }
 
-    double surf_x = x - hovered_client->scene_tree->node.x;
-    double surf_y = y - hovered_client->scene_tree->node.y;
+    /* X11 menus and tooltips never take the keyboard from their parent */
+    if (!hovered_client->unmanaged &&
+        !wh_input_is_client_focused(seat, hovered_client))
+    {
+        wh_input_focus_all_inputs_on_client(
+            seat, surf, surf_x, surf_y, hovered_client
+        );
+    }
+    else
+    {
+        /* Moving between the client's own surfaces, this does nothing while
+        the pointer stays on the same one. */
+        wlr_seat_pointer_notify_enter(seat->wlr_seat, surf, surf_x, surf_y);
+    }
 
-    if (!wh_input_is_client_focused(hovered_client))
-        wh_input_focus_all_inputs_on_client(surf_x, surf_y, hovered_client);
+    wlr_seat_pointer_notify_motion(seat->wlr_seat, time_msec, surf_x, surf_y);
+}
 
-    struct timespec now;
-    clock_gettime(CLOCK_MONOTONIC, &now);
-    u32 now_ms = now.tv_sec * 1000 + now.tv_nsec / 1000000;
-    wlr_seat_pointer_notify_motion(comp->seat, now_ms, surf_x, surf_y);
+static void on_cursor_motion(struct wl_listener* listener, void* data)
+{
+    WhaleSeat* seat = wl_container_of(listener, seat, listeners.cursor_motion);
+
+    struct wlr_pointer_motion_event* ev = data;
+
+    wh_seat_activity(seat);
+    wlr_cursor_move(seat->cursor, &ev->pointer->base, ev->delta_x, ev->delta_y);
+    wh_input_cursor_motion(seat, ev->time_msec);
+}
+
+static void on_cursor_motion_absolute(struct wl_listener* listener, void* data)
+{
+    WhaleSeat* seat =
+        wl_container_of(listener, seat, listeners.cursor_motion_absolute);
+
+    struct wlr_pointer_motion_absolute_event* ev = data;
+
+    wh_seat_activity(seat);
+    wlr_cursor_warp_absolute(seat->cursor, &ev->pointer->base, ev->x, ev->y);
+    wh_input_cursor_motion(seat, ev->time_msec);
+}
+
+void wh_input_pointer_button(
+    WhaleSeat* seat,
+    u32 time_msec,
+    u32 button,
+    enum wl_pointer_button_state state
+)
+{
+    /* Dragging a server-side title bar moves the window, dragging a border
+    resizes it. */
+    if (state == WL_POINTER_BUTTON_STATE_PRESSED &&
+        seat->grab.mode == WH_GRAB_NONE)
+    {
+        u32 edges;
+        WhaleClient* client = wh_decoration_at(
+            seat->comp, seat->cursor->x, seat->cursor->y, &edges
+        );
+        if (client)
+            wh_grab_begin(
+                seat, client, edges ? WH_GRAB_RESIZE : WH_GRAB_MOVE, edges
+            );
+    }
+
+    /* The seat keeps count of held buttons even while nothing has pointer
+    focus, a grab ends with the last of them. */
+    wlr_seat_pointer_notify_button(seat->wlr_seat, time_msec, button, state);
+
+    if (state == WL_POINTER_BUTTON_STATE_RELEASED &&
+        seat->wlr_seat->pointer_state.button_count == 0)
+        wh_grab_end(seat);
 }
 
 static void on_cursor_button(struct wl_listener* listener, void* data)
 {
-    WhaleCompositor* comp =
-        wl_container_of(listener, comp, listeners.cursor_button);
+    WhaleSeat* seat = wl_container_of(listener, seat, listeners.cursor_button);
     struct wlr_pointer_button_event* ev = data;
 
-    wlr_seat_pointer_notify_button(
-        comp->seat, ev->time_msec, ev->button, ev->state
-    );
+    wh_seat_activity(seat);
+    wh_input_pointer_button(seat, ev->time_msec, ev->button, ev->state);
 }
 
 static void on_cursor_axis(struct wl_listener* listener, void* data)
 {
-    WhaleCompositor* comp =
-        wl_container_of(listener, comp, listeners.cursor_axis);
+    WhaleSeat* seat = wl_container_of(listener, seat, listeners.cursor_axis);
 
     struct wlr_pointer_axis_event* ev = data;
 
+    wh_seat_activity(seat);
+
     wlr_seat_pointer_notify_axis(
-        comp->seat,
+        seat->wlr_seat,
         ev->time_msec,
         ev->orientation,
         ev->delta,
@@ -134,77 +256,700 @@ static void on_cursor_axis(struct wl_listener* listener, void* data)
 
 static void on_cursor_frame(struct wl_listener* listener, void*)
 {
-    WhaleCompositor* comp =
-        wl_container_of(listener, comp, listeners.cursor_frame);
+    WhaleSeat* seat = wl_container_of(listener, seat, listeners.cursor_frame);
 
     /* Notify the focused client. */
-    wlr_seat_pointer_notify_frame(comp->seat);
+    wlr_seat_pointer_notify_frame(seat->wlr_seat);
+}
+
+/**
+ * Find a touch point that is down.
+ *
+ * @param add Hand out a free slot if the point isn't down yet.
+ *
+ * @returns The point or NULL if there is none (or no free slot).
+ */
+static WhaleTouchPoint* wh_input_touch_point(WhaleSeat* seat, s32 id, bool add)
+{
+    WhaleTouchPoint* free_point = NULL;
+    for (int i = 0; i < WH_TOUCH_MAX_POINTS; i++)
+    {
+        WhaleTouchPoint* point = &seat->touch_points[i];
+        if (point->down && point->id == id)
+            return point;
+        if (!point->down && !free_point)
+            free_point = point;
+    }
+
+    return add ? free_point : NULL;
+}
+
+static void on_touch_down(struct wl_listener* listener, void* data)
+{
+    WhaleSeat* seat = wl_container_of(listener, seat, listeners.touch_down);
+    struct wlr_touch_down_event* ev = data;
+
+    wh_seat_activity(seat);
+
+    double x;
+    double y;
+    wlr_cursor_absolute_to_layout_coords(
+        seat->cursor, &ev->touch->base, ev->x, ev->y, &x, &y
+    );
+
+    /* Same hit-testing as the pointer, only done when a finger goes down */
+    struct wlr_surface* surf;
+    double surf_x;
+    double surf_y;
+    WhaleClient* client =
+        wh_client_surface_at(x, y, seat->comp, &surf, &surf_x, &surf_y);
+    WhaleTouchPoint* point = wh_input_touch_point(seat, ev->touch_id, true);
+    if (!client || !point)
+        return;
+
+    /* Touching a window focuses it like clicking it does, which also keeps
+    it from being throttled. */
+    if (!client->unmanaged && !wh_input_is_client_focused(seat, client))
+        wh_input_keyboard_enter(seat, client);
+
+    *point = (WhaleTouchPoint){
+        .id = ev->touch_id,
+        .down = true,
+        .origin_x = x - surf_x,
+        .origin_y = y - surf_y,
+    };
+
+    wlr_seat_touch_notify_down(
+        seat->wlr_seat, surf, ev->time_msec, ev->touch_id, surf_x, surf_y
+    );
+}
+
+static void on_touch_motion(struct wl_listener* listener, void* data)
+{
+    WhaleSeat* seat = wl_container_of(listener, seat, listeners.touch_motion);
+    struct wlr_touch_motion_event* ev = data;
+
+    wh_seat_activity(seat);
+
+    WhaleTouchPoint* point = wh_input_touch_point(seat, ev->touch_id, false);
+    if (!point)
+        return;
+
+    double x;
+    double y;
+    wlr_cursor_absolute_to_layout_coords(
+        seat->cursor, &ev->touch->base, ev->x, ev->y, &x, &y
+    );
+
+    /* Motion stays relative to the surface the finger went down on, even
+    once it leaves it. */
+    wlr_seat_touch_notify_motion(
+        seat->wlr_seat,
+        ev->time_msec,
+        ev->touch_id,
+        x - point->origin_x,
+        y - point->origin_y
+    );
+}
+
+static void on_touch_up(struct wl_listener* listener, void* data)
+{
+    WhaleSeat* seat = wl_container_of(listener, seat, listeners.touch_up);
+    struct wlr_touch_up_event* ev = data;
+
+    wh_seat_activity(seat);
+
+    WhaleTouchPoint* point = wh_input_touch_point(seat, ev->touch_id, false);
+    if (!point)
+        return;
+
+    point->down = false;
+    wlr_seat_touch_notify_up(seat->wlr_seat, ev->time_msec, ev->touch_id);
+}
+
+static void on_touch_cancel(struct wl_listener* listener, void* data)
+{
+    WhaleSeat* seat = wl_container_of(listener, seat, listeners.touch_cancel);
+    struct wlr_touch_cancel_event* ev = data;
+
+    WhaleTouchPoint* point = wh_input_touch_point(seat, ev->touch_id, false);
+    if (!point)
+        return;
+
+    point->down = false;
+
+    struct wlr_touch_point* wlr_point =
+        wlr_seat_touch_get_point(seat->wlr_seat, ev->touch_id);
+    if (wlr_point)
+        wlr_seat_touch_notify_cancel(seat->wlr_seat, wlr_point->client);
+}
+
+static void on_touch_frame(struct wl_listener* listener, void*)
+{
+    WhaleSeat* seat = wl_container_of(listener, seat, listeners.touch_frame);
+
+    /* Every point that changed since the last frame goes out as one batch,
+    clients only act on it once they see the frame. */
+    wlr_seat_touch_notify_frame(seat->wlr_seat);
+}
+
+/* Touchpad gestures go to the client with pointer focus, as they come. */
+
+static void on_swipe_begin(struct wl_listener* listener, void* data)
+{
+    WhaleSeat* seat = wl_container_of(listener, seat, listeners.swipe_begin);
+    struct wlr_pointer_swipe_begin_event* ev = data;
+    struct wlr_pointer_gestures_v1* gestures = seat->comp->pointer_gestures;
+
+    wh_seat_activity(seat);
+    wlr_pointer_gestures_v1_send_swipe_begin(
+        gestures, seat->wlr_seat, ev->time_msec, ev->fingers
+    );
 }
 
-static int wh_input_cursor_init(WhaleCompositor* comp)
+static void on_swipe_update(struct wl_listener* listener, void* data)
 {
-    comp->cursor = wlr_cursor_create();
-    wlr_cursor_attach_output_layout(comp->cursor, comp->output_layout);
+    WhaleSeat* seat = wl_container_of(listener, seat, listeners.swipe_update);
+    struct wlr_pointer_swipe_update_event* ev = data;
+    struct wlr_pointer_gestures_v1* gestures = seat->comp->pointer_gestures;
 
-    comp->cursor_manager = wlr_xcursor_manager_create(NULL, 24);
-    setenv("XCURSOR_SIZE", "24", 1);
+    wh_seat_activity(seat);
+    wlr_pointer_gestures_v1_send_swipe_update(
+        gestures, seat->wlr_seat, ev->time_msec, ev->dx, ev->dy
+    );
+}
+
+static void on_swipe_end(struct wl_listener* listener, void* data)
+{
+    WhaleSeat* seat = wl_container_of(listener, seat, listeners.swipe_end);
+    struct wlr_pointer_swipe_end_event* ev = data;
+    struct wlr_pointer_gestures_v1* gestures = seat->comp->pointer_gestures;
+
+    wh_seat_activity(seat);
+    wlr_pointer_gestures_v1_send_swipe_end(
+        gestures, seat->wlr_seat, ev->time_msec, ev->cancelled
+    );
+}
+
+static void on_pinch_begin(struct wl_listener* listener, void* data)
+{
+    WhaleSeat* seat = wl_container_of(listener, seat, listeners.pinch_begin);
+    struct wlr_pointer_pinch_begin_event* ev = data;
+    struct wlr_pointer_gestures_v1* gestures = seat->comp->pointer_gestures;
+
+    wh_seat_activity(seat);
+    wlr_pointer_gestures_v1_send_pinch_begin(
+        gestures, seat->wlr_seat, ev->time_msec, ev->fingers
+    );
+}
+
+static void on_pinch_update(struct wl_listener* listener, void* data)
+{
+    WhaleSeat* seat = wl_container_of(listener, seat, listeners.pinch_update);
+    struct wlr_pointer_pinch_update_event* ev = data;
+    struct wlr_pointer_gestures_v1* gestures = seat->comp->pointer_gestures;
+
+    wh_seat_activity(seat);
+    wlr_pointer_gestures_v1_send_pinch_update(
+        gestures,
+        seat->wlr_seat,
+        ev->time_msec,
+        ev->dx,
+        ev->dy,
+        ev->scale,
+        ev->rotation
+    );
+}
+
+static void on_pinch_end(struct wl_listener* listener, void* data)
+{
+    WhaleSeat* seat = wl_container_of(listener, seat, listeners.pinch_end);
+    struct wlr_pointer_pinch_end_event* ev = data;
+    struct wlr_pointer_gestures_v1* gestures = seat->comp->pointer_gestures;
+
+    wh_seat_activity(seat);
+    wlr_pointer_gestures_v1_send_pinch_end(
+        gestures, seat->wlr_seat, ev->time_msec, ev->cancelled
+    );
+}
+
+static void on_hold_begin(struct wl_listener* listener, void* data)
+{
+    WhaleSeat* seat = wl_container_of(listener, seat, listeners.hold_begin);
+    struct wlr_pointer_hold_begin_event* ev = data;
+    struct wlr_pointer_gestures_v1* gestures = seat->comp->pointer_gestures;
+
+    wh_seat_activity(seat);
+    wlr_pointer_gestures_v1_send_hold_begin(
+        gestures, seat->wlr_seat, ev->time_msec, ev->fingers
+    );
+}
+
+static void on_hold_end(struct wl_listener* listener, void* data)
+{
+    WhaleSeat* seat = wl_container_of(listener, seat, listeners.hold_end);
+    struct wlr_pointer_hold_end_event* ev = data;
+    struct wlr_pointer_gestures_v1* gestures = seat->comp->pointer_gestures;
+
+    wh_seat_activity(seat);
+    wlr_pointer_gestures_v1_send_hold_end(
+        gestures, seat->wlr_seat, ev->time_msec, ev->cancelled
+    );
+}
+
+static int wh_input_cursor_init(WhaleSeat* seat)
+{
+    seat->cursor = wlr_cursor_create();
+    if (!seat->cursor)
+    {
+        wh_log(ERR, "input: Failed to create cursor.");
+        return -1;
+    }
+
+    wlr_cursor_attach_output_layout(seat->cursor, seat->comp->output_layout);
 
     LISTEN(
-        &comp->cursor->events.motion,
-        &comp->listeners.cursor_motion,
+        &seat->cursor->events.motion,
+        &seat->listeners.cursor_motion,
         on_cursor_motion
     );
 
     LISTEN(
-        &comp->cursor->events.motion_absolute,
-        &comp->listeners.cursor_motion_absolute,
+        &seat->cursor->events.motion_absolute,
+        &seat->listeners.cursor_motion_absolute,
         on_cursor_motion_absolute
     );
 
     LISTEN(
-        &comp->cursor->events.button,
-        &comp->listeners.cursor_button,
+        &seat->cursor->events.button,
+        &seat->listeners.cursor_button,
         on_cursor_button
     );
 
     LISTEN(
-        &comp->cursor->events.axis, &comp->listeners.cursor_axis, on_cursor_axis
+        &seat->cursor->events.axis, &seat->listeners.cursor_axis, on_cursor_axis
     );
 
     /* A "frame" is a logical grouping of related events that should be
     processed atomically. Frame events are sent after one or more pointer
     events and signal that those events can be processed. */
     LISTEN(
-        &comp->cursor->events.frame,
-        &comp->listeners.cursor_frame,
+        &seat->cursor->events.frame,
+        &seat->listeners.cursor_frame,
         on_cursor_frame
     );
 
+    /* Touch devices are attached to the cursor too, which maps their
+    coordinates to outputs. The cursor itself doesn't move. */
+    LISTEN(
+        &seat->cursor->events.touch_down,
+        &seat->listeners.touch_down,
+        on_touch_down
+    );
+    LISTEN(
+        &seat->cursor->events.touch_motion,
+        &seat->listeners.touch_motion,
+        on_touch_motion
+    );
+    LISTEN(
+        &seat->cursor->events.touch_up, &seat->listeners.touch_up, on_touch_up
+    );
+    LISTEN(
+        &seat->cursor->events.touch_cancel,
+        &seat->listeners.touch_cancel,
+        on_touch_cancel
+    );
+    LISTEN(
+        &seat->cursor->events.touch_frame,
+        &seat->listeners.touch_frame,
+        on_touch_frame
+    );
+
+    LISTEN(
+        &seat->cursor->events.swipe_begin,
+        &seat->listeners.swipe_begin,
+        on_swipe_begin
+    );
+    LISTEN(
+        &seat->cursor->events.swipe_update,
+        &seat->listeners.swipe_update,
+        on_swipe_update
+    );
+    LISTEN(
+        &seat->cursor->events.swipe_end,
+        &seat->listeners.swipe_end,
+        on_swipe_end
+    );
+    LISTEN(
+        &seat->cursor->events.pinch_begin,
+        &seat->listeners.pinch_begin,
+        on_pinch_begin
+    );
+    LISTEN(
+        &seat->cursor->events.pinch_update,
+        &seat->listeners.pinch_update,
+        on_pinch_update
+    );
+    LISTEN(
+        &seat->cursor->events.pinch_end,
+        &seat->listeners.pinch_end,
+        on_pinch_end
+    );
+    LISTEN(
+        &seat->cursor->events.hold_begin,
+        &seat->listeners.hold_begin,
+        on_hold_begin
+    );
+    LISTEN(
+        &seat->cursor->events.hold_end,
+        &seat->listeners.hold_end,
+        on_hold_end
+    );
+
     // wlr_cursor_warp_closest(
-    //     comp->cursor, NULL, comp->cursor->x, comp->cursor->y
+    //     seat->cursor, NULL, seat->cursor->x, seat->cursor->y
     // );
-    wlr_cursor_set_xcursor(comp->cursor, comp->cursor_manager, "default");
+
+    /* No xcursor image is set here: loading the theme is deferred to the
+    first pointer motion, touch-only setups never load it. */
 
     return 0;
 }
 
-static int
-wl_input_pointer_init(struct wlr_pointer* pointer, WhaleCompositor* comp)
+static int wl_input_pointer_init(struct wlr_pointer* pointer, WhaleSeat* seat)
 {
-    wlr_cursor_attach_input_device(comp->cursor, &pointer->base);
+    wlr_cursor_attach_input_device(seat->cursor, &pointer->base);
     return 0;
 }
 
-static int
-wl_input_keyboard_init(struct wlr_keyboard* keyboard, WhaleCompositor* comp)
+/**
+ * Match a pressed key against the compositor keybindings. Bindings match on
+ * the level-0 keysyms of the key so `Super+Shift+q` is written with `q`, not
+ * `Q`.
+ *
+ * @returns The matching binding or NULL if the key is not bound.
+ */
+static const WhaleCompiledKeybind* wh_input_match_keybind(
+    WhaleCompositor* comp, struct wlr_keyboard* keyboard, u32 keycode
+)
+{
+    /* libinput keycodes are offset by 8 from xkb keycodes */
+    xkb_keycode_t xkb_keycode = keycode + 8;
+    xkb_layout_index_t layout =
+        xkb_state_key_get_layout(keyboard->xkb_state, xkb_keycode);
+
+    const xkb_keysym_t* syms;
+    int num_syms = xkb_keymap_key_get_syms_by_level(
+        keyboard->keymap, xkb_keycode, layout, 0, &syms
+    );
+
+    u32 mods = wlr_keyboard_get_modifiers(keyboard);
+    for (int i = 0; i < num_syms; i++)
+    {
+        const WhaleCompiledKeybind* bind = wh_keybind_lookup(
+            &comp->keybinds, comp->keybind_mode, mods, syms[i]
+        );
+
+        if (bind)
+            return bind;
+    }
+
+    return NULL;
+}
+
+static void wh_input_key_repeat_start(
+    KeyboardGroup* group, const WhaleCompiledKeybind* bind, u32 keycode
+)
+{
+    struct wlr_keyboard* keyboard = &group->wlr_keyboard_group->keyboard;
+    if (keyboard->repeat_info.rate <= 0)
+        return;
+
+    group->repeat_bind = bind;
+    group->repeat_keycode = keycode;
+
+    /* The interval is kept by the kernel relative to the first expiry, so
+    a late dispatch doesn't push the following repeats back. */
+    s64 interval_ns = 1000000000ll / keyboard->repeat_info.rate;
+    s64 delay_ns = keyboard->repeat_info.delay * 1000000ll;
+    struct itimerspec spec = {
+        .it_value =
+            {.tv_sec = delay_ns / 1000000000, .tv_nsec = delay_ns % 1000000000},
+        .it_interval =
+            {.tv_sec = interval_ns / 1000000000,
+             .tv_nsec = interval_ns % 1000000000},
+    };
+
+    /* A zero delay would disarm the timer instead. */
+    if (delay_ns == 0)
+        spec.it_value = spec.it_interval;
+
+    if (timerfd_settime(group->key_repeat_fd, 0, &spec, NULL) < 0)
+    {
+        wh_log(ERR, "input: Failed to arm key repeat timer");
+        group->repeat_bind = NULL;
+    }
+}
+
+static void on_keyboard_key(struct wl_listener* listener, void* data)
+{
+    KeyboardGroup* group = wl_container_of(listener, group, listeners.key);
+    WhaleSeat* seat = group->seat;
+    WhaleCompositor* comp = seat->comp;
+    struct wlr_keyboard_key_event* ev = data;
+
+    struct wlr_keyboard* keyboard = &group->wlr_keyboard_group->keyboard;
+
+    /* Also makes this the seat keybindings act on */
+    wh_seat_activity(seat);
+
+    /* Clients only know about one keymap at a time, the one of the seat's
+    keyboard. Groups share identical keymaps so this only switches when a
+    keyboard with a different layout is used. */
+    if (wlr_seat_get_keyboard(seat->wlr_seat) != keyboard)
+        wlr_seat_set_keyboard(seat->wlr_seat, keyboard);
+
+    if (ev->state == WL_KEYBOARD_KEY_STATE_RELEASED &&
+        group->repeat_bind && group->repeat_keycode == ev->keycode)
+        wh_input_key_repeat_stop(group);
+
+    /* The client never saw the press, focus may even have moved to it
+    because of the binding */
+    u64* bound = ev->keycode < WH_KEYCODE_COUNT
+                     ? &group->bound_keys[ev->keycode / 64]
+                     : NULL;
+    u64 bit = 1ull << (ev->keycode % 64);
+    if (ev->state == WL_KEYBOARD_KEY_STATE_RELEASED && bound && *bound & bit)
+    {
+        *bound &= ~bit;
+        return;
+    }
+
+    if (ev->state == WL_KEYBOARD_KEY_STATE_PRESSED)
+    {
+        const WhaleCompiledKeybind* bind =
+            wh_input_match_keybind(comp, keyboard, ev->keycode);
+
+        if (bind)
+        {
+            /* A new binding replaces whatever was repeating before. A
+            reload frees the binding along with the old table, a reload
+            binding can't repeat. */
+            bool repeat = bind->repeat && bind->action != WH_ACTION_RELOAD;
+            wh_input_key_repeat_stop(group);
+            if (bound)
+                *bound |= bit;
+            wh_keybind_run(comp, bind);
+            if (repeat)
+                wh_input_key_repeat_start(group, bind, ev->keycode);
+            return;
+        }
+    }
+
+    wlr_seat_keyboard_notify_key(
+        seat->wlr_seat, ev->time_msec, ev->keycode, ev->state
+    );
+}
+
+static int keyrepeat(int fd, u32, void* data)
+{
+    KeyboardGroup* group = data;
+
+    /* Ticks missed while the loop was busy are coalesced into one repeat,
+    the timer itself never drifts. */
+    u64 expirations;
+    if (read(fd, &expirations, sizeof(expirations)) != sizeof(expirations))
+        return 0;
+
+    if (group->repeat_bind)
+    {
+        group->seat->comp->active_seat = group->seat;
+        wh_keybind_run(group->seat->comp, group->repeat_bind);
+    }
+
+    return 0;
+}
+
+static void on_keyboard_modifier(struct wl_listener* listener, void*)
 {
-    wlr_keyboard_set_keymap(
-        keyboard, comp->keyboard_group.wlr_keyboard_group->keyboard.keymap
+    KeyboardGroup* group =
+        wl_container_of(listener, group, listeners.modifiers);
+    struct wlr_keyboard* keyboard = &group->wlr_keyboard_group->keyboard;
+
+    /* The held binding no longer matches once its modifiers change. */
+    wh_input_key_repeat_stop(group);
+
+    struct wlr_seat* wlr_seat = group->seat->wlr_seat;
+    if (wlr_seat_get_keyboard(wlr_seat) != keyboard)
+        wlr_seat_set_keyboard(wlr_seat, keyboard);
+
+    wlr_seat_keyboard_notify_modifiers(wlr_seat, &keyboard->modifiers);
+}
+
+/**
+ * Create a keyboard group of the seat for the given keymap, keyboards added
+ * to it must use the very same keymap.
+ *
+ * @returns The new group or NULL on failure.
+ */
+static KeyboardGroup*
+wh_input_keyboard_group_create(WhaleSeat* seat, struct xkb_keymap* keymap)
+{
+    KeyboardGroup* group = calloc(1, sizeof(KeyboardGroup));
+    if (!group)
+    {
+        wh_log(ERR, "input: Failed to allocate keyboard group.");
+        return NULL;
+    }
+
+    group->seat = seat;
+    group->wlr_keyboard_group = wlr_keyboard_group_create();
+    if (!group->wlr_keyboard_group)
+    {
+        wh_log(ERR, "input: Failed to create wlr keyboard group.");
+        free(group);
+        return NULL;
+    }
+
+    const WhaleConfig* config = &seat->comp->config.current;
+    struct wlr_keyboard* keyboard = &group->wlr_keyboard_group->keyboard;
+    wlr_keyboard_set_keymap(keyboard, keymap);
+    wlr_keyboard_set_repeat_info(
+        keyboard, config->repeat_rate, config->repeat_delay
     );
 
-    wlr_keyboard_group_add_keyboard(
-        comp->keyboard_group.wlr_keyboard_group, keyboard
+    group->key_repeat_fd =
+        timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (group->key_repeat_fd < 0)
+    {
+        wh_log(ERR, "input: Failed to create key repeat timer.");
+        wlr_keyboard_group_destroy(group->wlr_keyboard_group);
+        free(group);
+        return NULL;
+    }
+
+    /* The timer stays disarmed, and the loop asleep, unless a bound key is
+    held. */
+    group->key_repeat_source = wl_event_loop_add_fd(
+        wl_display_get_event_loop(seat->comp->display),
+        group->key_repeat_fd,
+        WL_EVENT_READABLE,
+        keyrepeat,
+        group
     );
+
+    /* Set up listeners for keyboard events */
+    LISTEN(&keyboard->events.key, &group->listeners.key, on_keyboard_key);
+    LISTEN(
+        &keyboard->events.modifiers,
+        &group->listeners.modifiers,
+        on_keyboard_modifier
+    );
+
+    wl_list_insert(seat->keyboard_groups.prev, &group->link);
+    return group;
+}
+
+/* For groups left without keyboards, never the seat's default group. */
+static void wh_input_keyboard_group_destroy(KeyboardGroup* group)
+{
+    UNLISTEN(&group->listeners.key);
+    UNLISTEN(&group->listeners.modifiers);
+    wl_event_source_remove(group->key_repeat_source);
+    close(group->key_repeat_fd);
+
+    wl_list_remove(&group->link);
+    wlr_keyboard_group_destroy(group->wlr_keyboard_group);
+    free(group);
+}
+
+static const struct xkb_rule_names* wh_input_device_keymap_names(
+    WhaleCompositor* comp, const struct wlr_input_device* dev
+)
+{
+    const WhaleConfig* config = &comp->config.current;
+    for (size_t i = 0; i < config->num_keymaps; i++)
+    {
+        const char* match = config->keymaps[i].device;
+        if (!match || (dev && dev->name && strcmp(match, dev->name) == 0))
+            return &config->keymaps[i].names;
+    }
+
+    return &config->keymaps[config->num_keymaps - 1].names;
+}
+
+/* Put the keyboard in the group of the seat that has the keymap. */
+static int wh_input_keyboard_join(
+    WhaleSeat* seat, struct wlr_keyboard* keyboard, struct xkb_keymap* keymap
+)
+{
+    /* The cache hands out one xkb_keymap per distinct keymap. */
+    KeyboardGroup* group = NULL;
+    KeyboardGroup* it;
+    wl_list_for_each(it, &seat->keyboard_groups, link)
+    {
+        if (it->wlr_keyboard_group->keyboard.keymap == keymap)
+        {
+            group = it;
+            break;
+        }
+    }
+
+    if (!group)
+        group = wh_input_keyboard_group_create(seat, keymap);
+    if (!group)
+        return -1;
+
+    wlr_keyboard_set_keymap(keyboard, keymap);
+
+    if (!wlr_keyboard_group_add_keyboard(group->wlr_keyboard_group, keyboard))
+    {
+        wh_log(ERR, "input: Failed to add keyboard to its group.");
+        return -1;
+    }
+
+    return 0;
+}
+
+static void on_keyboard_destroy(struct wl_listener* listener, void*)
+{
+    WhaleKeyboard* kb = wl_container_of(listener, kb, destroy);
+
+    /* Its group lets go of it by itself */
+    UNLISTEN(&kb->destroy);
+    wl_list_remove(&kb->link);
+    free(kb);
+}
+
+static int
+wl_input_keyboard_init(struct wlr_keyboard* keyboard, WhaleSeat* seat)
+{
+    struct xkb_keymap* keymap = wh_keymap_cache_get(
+        &seat->comp->keymap_cache,
+        wh_input_device_keymap_names(seat->comp, &keyboard->base)
+    );
+    if (!keymap)
+        return -1;
+
+    /* Tracked so it can change groups when its keymap is reconfigured */
+    WhaleKeyboard* kb = calloc(1, sizeof(WhaleKeyboard));
+    if (!kb)
+    {
+        wh_log(ERR, "input: Failed to allocate keyboard.");
+        return -1;
+    }
+
+    if (wh_input_keyboard_join(seat, keyboard, keymap) < 0)
+    {
+        free(kb);
+        return -1;
+    }
+
+    kb->seat = seat;
+    kb->wlr_keyboard = keyboard;
+    LISTEN(&keyboard->base.events.destroy, &kb->destroy, on_keyboard_destroy);
+    wl_list_insert(&seat->keyboards, &kb->link);
+
     return 0;
 }
 
@@ -216,30 +961,47 @@ static void on_new_input(struct wl_listener* listener, void* data)
     struct wlr_input_device* dev = data;
     wh_log(DEBUG, "input: new input (%s)", dev->name);
 
-    u32 seat_caps = comp->seat->capabilities;
+    WhaleSeat* seat = wh_seat_for_device(comp, dev);
+    if (!seat)
+        return;
+
+    u32 seat_caps = seat->wlr_seat->capabilities;
 
     switch (dev->type)
     {
     case WLR_INPUT_DEVICE_POINTER:
         struct wlr_pointer* ptr = wlr_pointer_from_input_device(dev);
-        if (wl_input_pointer_init(ptr, comp) == 0)
+        if (wl_input_pointer_init(ptr, seat) == 0)
             seat_caps |= WL_SEAT_CAPABILITY_POINTER;
 
         break;
 
     case WLR_INPUT_DEVICE_KEYBOARD:
         struct wlr_keyboard* keyboard = wlr_keyboard_from_input_device(dev);
-        if (wl_input_keyboard_init(keyboard, comp) == 0)
+        if (wl_input_keyboard_init(keyboard, seat) == 0)
             seat_caps |= WL_SEAT_CAPABILITY_KEYBOARD;
 
         break;
 
+    case WLR_INPUT_DEVICE_TOUCH:
+        wlr_cursor_attach_input_device(seat->cursor, dev);
+        seat_caps |= WL_SEAT_CAPABILITY_TOUCH;
+
+        break;
+
+    case WLR_INPUT_DEVICE_TABLET:
+        /* Clients without tablet support get pointer events instead */
+        if (wh_tablet_add(seat, dev) == 0)
+            seat_caps |= WL_SEAT_CAPABILITY_POINTER;
+
+        break;
+
     default:
         wh_log(WARN, "input: Unhandled device (%s)", dev->name);
         break;
     }
 
-    wlr_seat_set_capabilities(comp->seat, seat_caps);
+    wlr_seat_set_capabilities(seat->wlr_seat, seat_caps);
 }
 
 static int wh_input_devices_init(WhaleCompositor* comp)
@@ -253,143 +1015,360 @@ static int wh_input_devices_init(WhaleCompositor* comp)
     return 0;
 }
 
-static const struct xkb_rule_names xkb_rules = {
-    /* can specify fields: rules, model, layout, variant, options */
-    /* example:
-    .options = "ctrl:nocaps",
-    */
-    .options = NULL,
-};
-
-static void on_keyboard_key(struct wl_listener* listener, void* data)
+static int wh_input_keyboard_groups_init(WhaleSeat* seat)
 {
-    WhaleCompositor* comp =
-        wl_container_of(listener, comp, listeners.keyboard_key);
-    struct wlr_keyboard_key_event* ev = data;
+    /* The default group exists even without keyboards so the seat always
+    has a keymap to hand out. */
+    struct xkb_keymap* keymap = wh_keymap_cache_get(
+        &seat->comp->keymap_cache,
+        wh_input_device_keymap_names(seat->comp, NULL)
+    );
+    if (!keymap)
+        return -1;
 
-    wlr_seat_keyboard_notify_key(
-        comp->seat, ev->time_msec, ev->keycode, ev->state
+    KeyboardGroup* group = wh_input_keyboard_group_create(seat, keymap);
+    if (!group)
+        return -1;
+
+    wlr_seat_set_keyboard(
+        seat->wlr_seat, &group->wlr_keyboard_group->keyboard
     );
+
+    return 0;
 }
 
-int keyrepeat(void* data)
+static void on_request_set_cursor(struct wl_listener* listener, void* data)
 {
-    KeyboardGroup* group = data;
-    if (group->wlr_keyboard_group->keyboard.repeat_info.rate <= 0)
-        return 0;
+    WhaleSeat* seat =
+        wl_container_of(listener, seat, listeners.request_set_cursor);
+
+    struct wlr_seat_pointer_request_set_cursor_event* ev = data;
+
+    if (seat->wlr_seat->pointer_state.focused_client == ev->seat_client)
+    {
+        wlr_cursor_set_surface(
+            seat->cursor, ev->surface, ev->hotspot_x, ev->hotspot_y
+        );
+    }
+}
+
+int wh_input_seat_init(WhaleSeat* seat)
+{
+    int st = wh_input_keyboard_groups_init(seat);
+    if (st < 0)
+        return st;
+
+    st = wh_input_cursor_init(seat);
+    if (st < 0)
+        return st;
+
+    st = wh_tablet_seat_init(seat);
+    if (st < 0)
+        return st;
 
-    wl_event_source_timer_update(
-        group->key_repeat_source,
-        1000 / group->wlr_keyboard_group->keyboard.repeat_info.rate
+    LISTEN(
+        &seat->wlr_seat->events.request_set_cursor,
+        &seat->listeners.request_set_cursor,
+        on_request_set_cursor
     );
 
     return 0;
 }
 
-static void on_keyboard_modifier(struct wl_listener* listener, void*)
+/* Clients drawing their own cursors take the theme from the environment.
+setenv() must not run along the keymap prefetch thread, see
+wh_keymap_cache_wait(). */
+static void wh_input_cursor_env_export(WhaleCompositor* comp)
 {
-    WhaleCompositor* comp =
-        wl_container_of(listener, comp, listeners.keyboard_modifier);
+    const WhaleConfig* config = &comp->config.current;
+
+    char size[16];
+    snprintf(size, sizeof(size), "%u", config->cursor_size);
+    setenv("XCURSOR_SIZE", size, 1);
+    if (config->cursor_theme)
+        setenv("XCURSOR_THEME", config->cursor_theme, 1);
+}
+
+static struct wlr_xcursor_manager*
+wh_input_cursor_manager_create(WhaleCompositor* comp)
+{
+    const WhaleConfig* config = &comp->config.current;
 
-    wlr_seat_keyboard_notify_modifiers(
-        comp->seat, &comp->keyboard_group.wlr_keyboard_group->keyboard.modifiers
+    return wlr_xcursor_manager_create(
+        config->cursor_theme, config->cursor_size
     );
 }
 
-static int wh_input_keyboard_group_init(WhaleCompositor* comp)
+static bool wh_input_keyboard_group_empty(KeyboardGroup* group)
 {
-    comp->keyboard_group.wlr_keyboard_group = wlr_keyboard_group_create();
-    if (!comp->keyboard_group.wlr_keyboard_group)
+    WhaleKeyboard* kb;
+    wl_list_for_each(kb, &group->seat->keyboards, link)
     {
-        wh_log(ERR, "input: Failed to create wlr keyboard group.");
-        return -1;
+        if (kb->wlr_keyboard->group == group->wlr_keyboard_group)
+            return false;
     }
 
-    struct xkb_context* xkb_context = xkb_context_new(XKB_CONTEXT_NO_FLAGS);
-    if (!xkb_context)
+    return true;
+}
+
+/* Move the keyboards of the seat whose keymap changed to the group of their
+new keymap. */
+static void wh_input_seat_regroup(WhaleSeat* seat)
+{
+    WhaleCompositor* comp = seat->comp;
+    struct xkb_keymap* keymap = wh_keymap_cache_get(
+        &comp->keymap_cache, wh_input_device_keymap_names(comp, NULL)
+    );
+    if (!keymap)
+        return;
+
+    KeyboardGroup* fallback =
+        wl_container_of(seat->keyboard_groups.next, fallback, link);
+    struct wlr_keyboard_group* fallback_group = fallback->wlr_keyboard_group;
+
+    /* The default group follows the default keymap, its keyboards join
+    their group again below. */
+    if (fallback_group->keyboard.keymap != keymap)
     {
-        wh_log(ERR, "input: Failed to create new xkb context.");
-        return -1;
+        KeyboardGroup* group;
+        KeyboardGroup* tmp;
+        wl_list_for_each_safe(group, tmp, &seat->keyboard_groups, link)
+        {
+            if (group != fallback &&
+                group->wlr_keyboard_group->keyboard.keymap == keymap)
+                wh_input_keyboard_group_destroy(group);
+        }
+
+        WhaleKeyboard* kb;
+        wl_list_for_each(kb, &seat->keyboards, link)
+        {
+            if (kb->wlr_keyboard->group == fallback_group)
+                wlr_keyboard_group_remove_keyboard(
+                    fallback_group, kb->wlr_keyboard
+                );
+        }
+
+        wlr_keyboard_set_keymap(&fallback_group->keyboard, keymap);
     }
 
-    struct xkb_keymap* xkb_keymap = xkb_keymap_new_from_names(
-        xkb_context, &xkb_rules, XKB_KEYMAP_COMPILE_NO_FLAGS
-    );
+    WhaleKeyboard* kb;
+    wl_list_for_each(kb, &seat->keyboards, link)
+    {
+        struct wlr_keyboard* keyboard = kb->wlr_keyboard;
+        keymap = wh_keymap_cache_get(
+            &comp->keymap_cache,
+            wh_input_device_keymap_names(comp, &keyboard->base)
+        );
 
-    if (!xkb_keymap)
+        /* A keymap that doesn't compile leaves the keyboard as it is */
+        if (!keymap ||
+            (keyboard->group && keyboard->group->keyboard.keymap == keymap))
+            continue;
+
+        if (keyboard->group)
+            wlr_keyboard_group_remove_keyboard(keyboard->group, keyboard);
+        wh_input_keyboard_join(seat, keyboard, keymap);
+    }
+
+    KeyboardGroup* group;
+    KeyboardGroup* tmp;
+    wl_list_for_each_safe(group, tmp, &seat->keyboard_groups, link)
     {
-        wh_log(ERR, "input: Failed to compile xkb keymap.");
-        return -1;
+        if (group != fallback && wh_input_keyboard_group_empty(group))
+            wh_input_keyboard_group_destroy(group);
     }
 
-    wlr_keyboard_set_keymap(
-        &comp->keyboard_group.wlr_keyboard_group->keyboard, xkb_keymap
-    );
+    if (!wlr_seat_get_keyboard(seat->wlr_seat))
+        wlr_seat_set_keyboard(seat->wlr_seat, &fallback_group->keyboard);
+}
 
-    xkb_keymap_unref(xkb_keymap);
-    xkb_context_unref(xkb_context);
+/* Rule names a reload needs, the default keymap's first and then every
+keyboard's. NULL past the last one. */
+static const struct xkb_rule_names*
+wh_input_keymap_slot(WhaleCompositor* comp, u32 slot)
+{
+    if (slot == 0)
+        return wh_input_device_keymap_names(comp, NULL);
 
-    wlr_keyboard_set_repeat_info(
-        &comp->keyboard_group.wlr_keyboard_group->keyboard, 25, 400
-    );
-    comp->keyboard_group.key_repeat_source = wl_event_loop_add_timer(
-        wl_display_get_event_loop(comp->display),
-        keyrepeat,
-        &comp->keyboard_group
-    );
+    WhaleSeat* seat;
+    wl_list_for_each(seat, &comp->seats, link)
+    {
+        WhaleKeyboard* kb;
+        wl_list_for_each(kb, &seat->keyboards, link)
+        {
+            if (--slot == 0)
+                return wh_input_device_keymap_names(
+                    comp, &kb->wlr_keyboard->base
+                );
+        }
+    }
 
-    /* Set up listeners for keyboard events */
-    LISTEN(
-        &comp->keyboard_group.wlr_keyboard_group->keyboard.events.key,
-        &comp->listeners.keyboard_key,
-        on_keyboard_key
-    );
-    LISTEN(
-        &comp->keyboard_group.wlr_keyboard_group->keyboard.events.modifiers,
-        &comp->listeners.keyboard_modifier,
-        on_keyboard_modifier
-    );
+    return NULL;
+}
 
-    wlr_seat_set_keyboard(
-        comp->seat, &comp->keyboard_group.wlr_keyboard_group->keyboard
-    );
+/* Compile the next keymap missing from the cache in the background, and
+regroup the keyboards once none is. */
+static void wh_input_keymaps_step(WhaleCompositor* comp)
+{
+    WhaleKeymapCache* cache = &comp->keymap_cache;
+
+    /* Without a way to be woken up they are compiled by the regroup */
+    const struct xkb_rule_names* names;
+    while (comp->keymap_source &&
+           (names = wh_input_keymap_slot(comp, comp->keymaps_next)))
+    {
+        /* Moving on even if the prefetch fails, so a keymap that doesn't
+        compile is only tried once more by the regroup. */
+        comp->keymaps_next++;
+        if (!wh_keymap_cache_contains(cache, names) &&
+            wh_keymap_cache_prefetch(cache, names) == 0)
+            return;
+    }
+
+    comp->keymaps_pending = false;
+
+    WhaleSeat* seat;
+    wl_list_for_each(seat, &comp->seats, link)
+        wh_input_seat_regroup(seat);
+}
+
+static int on_keymap_prefetched(int fd, u32, void* data)
+{
+    WhaleCompositor* comp = data;
+
+    eventfd_t count;
+    eventfd_read(fd, &count);
+
+    /* The startup prefetch wakes us too, and a reload may have started
+    another one before this wakeup was handled. */
+    if (comp->keymaps_pending && !wh_keymap_cache_busy(&comp->keymap_cache))
+        wh_input_keymaps_step(comp);
 
     return 0;
 }
 
-static void on_request_set_cursor(struct wl_listener* listener, void* data)
+void wh_input_keymaps_changed(WhaleCompositor* comp)
 {
-    WhaleCompositor* comp =
-        wl_container_of(listener, comp, listeners.seat_request_set_cursor);
+    wh_input_key_repeat_cancel(comp);
 
-    struct wlr_seat_pointer_request_set_cursor_event* ev = data;
+    /* Compiling happens off the loop, the keyboards keep their current
+    keymap until every new one is ready. A reload while waiting starts over
+    once the running prefetch is done. */
+    comp->keymaps_next = 0;
+    if (comp->keymaps_pending && wh_keymap_cache_busy(&comp->keymap_cache))
+        return;
 
-    if (comp->seat->pointer_state.focused_client == ev->seat_client)
+    comp->keymaps_pending = true;
+    wh_input_keymaps_step(comp);
+}
+
+void wh_input_repeat_changed(WhaleCompositor* comp)
+{
+    const WhaleConfig* config = &comp->config.current;
+
+    /* Clients get it from the group keyboard they were sent */
+    WhaleSeat* seat;
+    wl_list_for_each(seat, &comp->seats, link)
     {
-        wlr_cursor_set_surface(
-            comp->cursor, ev->surface, ev->hotspot_x, ev->hotspot_y
-        );
+        KeyboardGroup* group;
+        wl_list_for_each(group, &seat->keyboard_groups, link)
+        {
+            wlr_keyboard_set_repeat_info(
+                &group->wlr_keyboard_group->keyboard,
+                config->repeat_rate,
+                config->repeat_delay
+            );
+        }
     }
 }
 
-int wh_input_init(WhaleCompositor* comp)
+void wh_input_cursor_theme_changed(WhaleCompositor* comp)
 {
-    comp->seat = wlr_seat_create(comp->display, "seat_0");
+    wh_keymap_cache_wait(&comp->keymap_cache);
+    wh_input_cursor_env_export(comp);
 
-    LISTEN(
-        &comp->seat->events.request_set_cursor,
-        &comp->listeners.seat_request_set_cursor,
-        on_request_set_cursor
+    struct wlr_xcursor_manager* manager = wh_input_cursor_manager_create(comp);
+    if (!manager)
+    {
+        wh_log(ERR, "input: Failed to load the cursor theme");
+        return;
+    }
+
+    /* Cursors still showing an image of the old theme must let go of it,
+    clients set theirs again when the pointer enters them anew. */
+    WhaleSeat* seat;
+    wl_list_for_each(seat, &comp->seats, link)
+    {
+        wlr_cursor_set_xcursor(seat->cursor, manager, "default");
+        wlr_seat_pointer_notify_clear_focus(seat->wlr_seat);
+    }
+
+    wlr_xcursor_manager_destroy(comp->cursor_manager);
+    comp->cursor_manager = manager;
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    u32 time_msec = now.tv_sec * 1000 + now.tv_nsec / 1000000;
+
+    wl_list_for_each(seat, &comp->seats, link)
+    {
+        if (seat->grab.mode == WH_GRAB_NONE)
+            wh_input_cursor_motion(seat, time_msec);
+    }
+}
+
+void wh_input_key_repeat_cancel(WhaleCompositor* comp)
+{
+    WhaleSeat* seat;
+    wl_list_for_each(seat, &comp->seats, link)
+        wh_input_key_repeat_stop_all(seat);
+}
+
+int wh_input_keymap_prefetch(WhaleCompositor* comp)
+{
+    if (wh_keymap_cache_init(&comp->keymap_cache) < 0)
+        return -1;
+
+    /* Exported before the thread starts, wh_input_init() runs while it
+    still compiles. */
+    wh_input_cursor_env_export(comp);
+
+    /* Not fatal, the keymap is then loaded when the first group is made. */
+    wh_keymap_cache_prefetch(
+        &comp->keymap_cache, wh_input_device_keymap_names(comp, NULL)
     );
 
-    int st = wh_input_cursor_init(comp);
-    if (st < 0)
-        return st;
+    return 0;
+}
+
+int wh_input_init(WhaleCompositor* comp)
+{
+    wl_list_init(&comp->seats);
+
+    /* Shared by the cursors of all seats */
+    comp->cursor_manager = wh_input_cursor_manager_create(comp);
 
-    st = wh_input_keyboard_group_init(comp);
+    comp->pointer_gestures = wlr_pointer_gestures_v1_create(comp->display);
+
+    /* Not fatal, keymaps are then compiled on the loop when they change */
+    if (comp->keymap_cache.prefetch_fd >= 0)
+        comp->keymap_source = wl_event_loop_add_fd(
+            wl_display_get_event_loop(comp->display),
+            comp->keymap_cache.prefetch_fd,
+            WL_EVENT_READABLE,
+            on_keymap_prefetched,
+            comp
+        );
+
+    int st = wh_tablet_init(comp);
     if (st < 0)
         return st;
 
+    comp->default_seat = wh_seat_create(comp, WH_SEAT_DEFAULT);
+    if (!comp->default_seat)
+        return -1;
+    comp->active_seat = comp->default_seat;
+
     st = wh_input_devices_init(comp);
     if (st < 0)
         return st;
@@ -0,0 +1,830 @@
+#define _GNU_SOURCE
+#define WLR_USE_UNSTABLE
+#include <errno.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <whale/client.h>
+#include <whale/compositor.h>
+#include <whale/dump.h>
+#include <whale/ipc.h>
+#include <whale/keybind.h>
+#include <whale/log.h>
+#include <whale/memory.h>
+#include <whale/output.h>
+#include <whale/types.h>
+#include <wlr/types/wlr_output_layout.h>
+
+/* Bound of the bytes queued for a single connection, a subscriber that lets
+its queue fill up is disconnected instead of stalling the compositor. */
+#define WH_IPC_QUEUE_SIZE (256 * 1024)
+
+/* Replies were asked for, a queue grows up to this to fit one */
+#define WH_IPC_MAX_REPLY (16 * 1024 * 1024)
+
+/* Titles longer than this are truncated */
+#define WH_IPC_MAX_TITLE 1024
+
+/* Large enough for any single event */
+#define WH_IPC_MAX_EVENT (sizeof(WhaleIpcHeader) + 64 + WH_IPC_MAX_TITLE)
+
+/* Bounded, append-only byte buffer. */
+typedef struct
+{
+    u8* data;
+    size_t len;
+    size_t cap;
+    /* Realloc'd up to WH_IPC_MAX_REPLY instead of overflowing */
+    bool growable;
+    bool overflow;
+} WhaleIpcWriter;
+
+typedef struct
+{
+    WhaleIpc* ipc;
+
+    int fd;
+    struct wl_event_source* source;
+
+    /* WH_IPC_EVENTS_* this connection subscribed to */
+    u32 events;
+
+    u8 in[sizeof(WhaleIpcHeader) + WH_IPC_MAX_PAYLOAD];
+    size_t in_len;
+
+    /* Bytes [out_off, out.len) are waiting to be written */
+    WhaleIpcWriter out;
+    size_t out_off;
+
+    struct wl_list link;
+} WhaleIpcConnection;
+
+static void wh_ipc_grow(WhaleIpcWriter* w, size_t need)
+{
+    size_t cap = w->cap ? w->cap : WH_IPC_QUEUE_SIZE;
+    while (cap < need)
+        cap *= 2;
+    if (cap > WH_IPC_MAX_REPLY)
+        return;
+
+    u8* data = realloc(w->data, cap);
+    if (!data)
+        return;
+
+    w->data = data;
+    w->cap = cap;
+}
+
+static void wh_ipc_put(WhaleIpcWriter* w, const void* data, size_t len)
+{
+    if (!w->overflow && w->growable && w->len + len > w->cap)
+        wh_ipc_grow(w, w->len + len);
+
+    if (w->overflow || w->len + len > w->cap)
+    {
+        w->overflow = true;
+        return;
+    }
+
+    memcpy(w->data + w->len, data, len);
+    w->len += len;
+}
+
+static void wh_ipc_put_u8(WhaleIpcWriter* w, u8 v)
+{
+    wh_ipc_put(w, &v, sizeof(v));
+}
+
+static void wh_ipc_put_u16(WhaleIpcWriter* w, u16 v)
+{
+    wh_ipc_put(w, &v, sizeof(v));
+}
+
+static void wh_ipc_put_u32(WhaleIpcWriter* w, u32 v)
+{
+    wh_ipc_put(w, &v, sizeof(v));
+}
+
+static void wh_ipc_put_u64(WhaleIpcWriter* w, u64 v)
+{
+    wh_ipc_put(w, &v, sizeof(v));
+}
+
+static void wh_ipc_put_s32(WhaleIpcWriter* w, s32 v)
+{
+    wh_ipc_put(w, &v, sizeof(v));
+}
+
+static void wh_ipc_put_str(WhaleIpcWriter* w, const char* str, size_t max)
+{
+    size_t len = str ? strnlen(str, max) : 0;
+    wh_ipc_put_u16(w, len);
+    wh_ipc_put(w, str, len);
+}
+
+static size_t wh_ipc_msg_begin(WhaleIpcWriter* w, u16 type)
+{
+    size_t start = w->len;
+    WhaleIpcHeader header = {.type = type};
+    wh_ipc_put(w, &header, sizeof(header));
+    return start;
+}
+
+static void wh_ipc_msg_end(WhaleIpcWriter* w, size_t start)
+{
+    if (w->overflow)
+        return;
+
+    u32 length = w->len - start - sizeof(WhaleIpcHeader);
+    memcpy(w->data + start + offsetof(WhaleIpcHeader, length), &length, 4);
+}
+
+static void wh_ipc_put_client(WhaleIpcWriter* w, const WhaleClient* client)
+{
+    const struct wlr_surface* surface = wh_client_surface(client);
+    struct wlr_box geom = wh_client_get_geometry(client);
+
+    wh_ipc_put_u32(w, client->id);
+    wh_ipc_put_s32(w, client->scene_tree->node.x);
+    wh_ipc_put_s32(w, client->scene_tree->node.y);
+    wh_ipc_put_u32(w, geom.width);
+    wh_ipc_put_u32(w, geom.height);
+    wh_ipc_put_u8(w, surface && surface->mapped);
+    wh_ipc_put_u8(w, client->focus_count > 0);
+    wh_ipc_put_str(w, wh_client_title(client), WH_IPC_MAX_TITLE);
+}
+
+static void wh_ipc_put_output(WhaleIpcWriter* w, const WhaleOutput* output)
+{
+    const struct wlr_output* wlr_output = output->wlr_output;
+
+    struct wlr_box box = {0};
+    wlr_output_layout_get_box(
+        output->comp->output_layout, output->wlr_output, &box
+    );
+
+    wh_ipc_put_str(w, wlr_output->name, WH_IPC_MAX_TITLE);
+    wh_ipc_put_s32(w, box.x);
+    wh_ipc_put_s32(w, box.y);
+    wh_ipc_put_u32(w, wlr_output->width);
+    wh_ipc_put_u32(w, wlr_output->height);
+    wh_ipc_put_s32(w, wlr_output->refresh);
+    wh_ipc_put_u8(w, wlr_output->enabled);
+}
+
+/* Events are only serialized while someone still wants them */
+static void wh_ipc_update_subscribed(WhaleIpc* ipc)
+{
+    ipc->subscribed = 0;
+
+    WhaleIpcConnection* conn;
+    wl_list_for_each(conn, &ipc->connections, link)
+        ipc->subscribed |= conn->events;
+}
+
+static void wh_ipc_connection_destroy(WhaleIpcConnection* conn)
+{
+    WhaleIpc* ipc = conn->ipc;
+
+    wl_event_source_remove(conn->source);
+    close(conn->fd);
+    wl_list_remove(&conn->link);
+    free(conn->out.data);
+    free(conn);
+
+    wh_ipc_update_subscribed(ipc);
+}
+
+/**
+ * Make room for `len` more bytes in the connection's queue.
+ *
+ * @returns false if the queue is full.
+ */
+static bool wh_ipc_connection_reserve(WhaleIpcConnection* conn, size_t len)
+{
+    WhaleIpcWriter* out = &conn->out;
+    if (!out->data)
+    {
+        out->data = malloc(WH_IPC_QUEUE_SIZE);
+        out->cap = WH_IPC_QUEUE_SIZE;
+        if (!out->data)
+            out->overflow = true;
+    }
+
+    if (out->len + len > out->cap && conn->out_off > 0)
+    {
+        memmove(out->data, out->data + conn->out_off, out->len - conn->out_off);
+        out->len -= conn->out_off;
+        conn->out_off = 0;
+    }
+
+    if (out->len + len > out->cap)
+        out->overflow = true;
+
+    return !out->overflow;
+}
+
+static void wh_ipc_schedule_flush(WhaleIpc* ipc);
+
+static void
+wh_ipc_queue(WhaleIpcConnection* conn, const WhaleIpcWriter* msg)
+{
+    if (msg->overflow || !wh_ipc_connection_reserve(conn, msg->len))
+        return;
+
+    wh_ipc_put(&conn->out, msg->data, msg->len);
+    wh_ipc_schedule_flush(conn->ipc);
+}
+
+/**
+ * Write as much of the queue as the socket takes without blocking.
+ *
+ * @returns false if the connection was destroyed.
+ */
+static bool wh_ipc_connection_flush(WhaleIpcConnection* conn)
+{
+    WhaleIpcWriter* out = &conn->out;
+    if (out->overflow)
+    {
+        wh_log(WARN, "ipc: Dropping subscriber that stopped reading");
+        wh_ipc_connection_destroy(conn);
+        return false;
+    }
+
+    while (conn->out_off < out->len)
+    {
+        ssize_t n = send(
+            conn->fd,
+            out->data + conn->out_off,
+            out->len - conn->out_off,
+            MSG_NOSIGNAL | MSG_DONTWAIT
+        );
+
+        if (n < 0 && errno == EINTR)
+            continue;
+
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
+
+        if (n < 0)
+        {
+            wh_ipc_connection_destroy(conn);
+            return false;
+        }
+
+        conn->out_off += n;
+    }
+
+    if (conn->out_off == out->len)
+    {
+        out->len = 0;
+        conn->out_off = 0;
+
+        /* Back to the subscriber bound once a large reply went out */
+        if (out->cap > WH_IPC_QUEUE_SIZE)
+        {
+            u8* data = realloc(out->data, WH_IPC_QUEUE_SIZE);
+            if (data)
+            {
+                out->data = data;
+                out->cap = WH_IPC_QUEUE_SIZE;
+            }
+        }
+    }
+
+    /* Only wake up for writability while something is left to write. */
+    u32 mask = WL_EVENT_READABLE;
+    if (out->len)
+        mask |= WL_EVENT_WRITABLE;
+    wl_event_source_fd_update(conn->source, mask);
+
+    return true;
+}
+
+static void wh_ipc_flush(void* data)
+{
+    WhaleIpc* ipc = data;
+    ipc->flush_idle = NULL;
+
+    WhaleIpcConnection* conn;
+    WhaleIpcConnection* tmp;
+    wl_list_for_each_safe(conn, tmp, &ipc->connections, link)
+    {
+        if (conn->out.len || conn->out.overflow)
+            wh_ipc_connection_flush(conn);
+    }
+}
+
+/* Everything queued during one event-loop iteration goes out in a single
+write per connection, at the start of the next one. */
+static void wh_ipc_schedule_flush(WhaleIpc* ipc)
+{
+    if (ipc->flush_idle)
+        return;
+
+    ipc->flush_idle = wl_event_loop_add_idle(
+        wl_display_get_event_loop(ipc->comp->display), wh_ipc_flush, ipc
+    );
+}
+
+static void
+wh_ipc_broadcast(WhaleIpc* ipc, u32 events, const WhaleIpcWriter* msg)
+{
+    WhaleIpcConnection* conn;
+    wl_list_for_each(conn, &ipc->connections, link)
+    {
+        if (conn->events & events)
+            wh_ipc_queue(conn, msg);
+    }
+}
+
+/* Replies listing things are written straight into the queue, which grows
+to fit them. The subscriber bound is for events nobody reads. */
+static WhaleIpcWriter* wh_ipc_reply_begin(WhaleIpcConnection* conn)
+{
+    if (!wh_ipc_connection_reserve(conn, 0))
+        return NULL;
+
+    conn->out.growable = true;
+    return &conn->out;
+}
+
+static void wh_ipc_reply_end(WhaleIpcWriter* w, size_t start)
+{
+    wh_ipc_msg_end(w, start);
+    w->growable = false;
+}
+
+static void wh_ipc_reply_clients(WhaleIpcConnection* conn)
+{
+    WhaleCompositor* comp = conn->ipc->comp;
+
+    WhaleIpcWriter* w = wh_ipc_reply_begin(conn);
+    if (!w)
+        return;
+
+    size_t start = wh_ipc_msg_begin(w, WH_IPC_GET_CLIENTS);
+    wh_ipc_put_u32(w, wl_list_length(&comp->clients));
+
+    WhaleClient* client;
+    wl_list_for_each(client, &comp->clients, link)
+        wh_ipc_put_client(w, client);
+
+    wh_ipc_reply_end(w, start);
+}
+
+static void wh_ipc_reply_outputs(WhaleIpcConnection* conn)
+{
+    WhaleCompositor* comp = conn->ipc->comp;
+
+    WhaleIpcWriter* w = wh_ipc_reply_begin(conn);
+    if (!w)
+        return;
+
+    size_t start = wh_ipc_msg_begin(w, WH_IPC_GET_OUTPUTS);
+    wh_ipc_put_u32(w, wl_list_length(&comp->outputs));
+
+    WhaleOutput* output;
+    wl_list_for_each(output, &comp->outputs, link)
+        wh_ipc_put_output(w, output);
+
+    wh_ipc_reply_end(w, start);
+}
+
+static void wh_ipc_reply_stats(WhaleIpcConnection* conn)
+{
+    WhaleCompositor* comp = conn->ipc->comp;
+
+    WhaleIpcWriter* w = wh_ipc_reply_begin(conn);
+    if (!w)
+        return;
+
+    size_t start = wh_ipc_msg_begin(w, WH_IPC_GET_STATS);
+    wh_ipc_put_u32(w, wl_list_length(&comp->throttle.conns));
+
+    const WhaleClientConn* client_conn;
+    wl_list_for_each(client_conn, &comp->throttle.conns, link)
+    {
+        wh_ipc_put_s32(w, client_conn->pid);
+        wh_ipc_put_u32(w, client_conn->rates.commits);
+        wh_ipc_put_u32(w, client_conn->rates.buffers);
+        wh_ipc_put_u32(w, client_conn->rates.requests);
+        wh_ipc_put_u8(w, client_conn->throttled);
+    }
+
+    wh_ipc_reply_end(w, start);
+}
+
+static void wh_ipc_reply_memory(WhaleIpcConnection* conn)
+{
+    WhaleCompositor* comp = conn->ipc->comp;
+
+    WhaleIpcWriter* w = wh_ipc_reply_begin(conn);
+    if (!w)
+        return;
+
+    size_t start = wh_ipc_msg_begin(w, WH_IPC_GET_MEMORY);
+    wh_ipc_put_u32(w, wl_list_length(&comp->clients));
+
+    const WhaleClient* client;
+    wl_list_for_each(client, &comp->clients, link)
+    {
+        const WhaleBufferStats* stats = &client->buffer_stats;
+        wh_ipc_put_u32(w, client->id);
+        wh_ipc_put_u32(w, stats->count);
+        wh_ipc_put_u32(w, wh_memory_swapchain_depth(stats));
+        wh_ipc_put_u64(w, stats->shm_bytes);
+        wh_ipc_put_u64(w, stats->dmabuf_bytes);
+        wh_ipc_put_u64(w, stats->peak_bytes);
+    }
+
+    wh_ipc_reply_end(w, start);
+}
+
+static void wh_ipc_reply_u32(WhaleIpcConnection* conn, u16 type, u32 value)
+{
+    u8 buf[sizeof(WhaleIpcHeader) + sizeof(u32)];
+    WhaleIpcWriter msg = {.data = buf, .cap = sizeof(buf)};
+
+    size_t start = wh_ipc_msg_begin(&msg, type);
+    wh_ipc_put_u32(&msg, value);
+    wh_ipc_msg_end(&msg, start);
+
+    wh_ipc_queue(conn, &msg);
+}
+
+static s32 wh_ipc_run_command(
+    WhaleIpcConnection* conn, const u8* payload, u32 length
+)
+{
+    u16 action;
+    u16 arg_len;
+    if (length < 2 * sizeof(u16))
+        return -1;
+
+    memcpy(&action, payload, sizeof(u16));
+    memcpy(&arg_len, payload + sizeof(u16), sizeof(u16));
+    if (arg_len > length - 2 * sizeof(u16))
+        return -1;
+
+    char arg[WH_IPC_MAX_PAYLOAD + 1];
+    memcpy(arg, payload + 2 * sizeof(u16), arg_len);
+    arg[arg_len] = '\0';
+
+    return wh_keybind_run_action(
+        conn->ipc->comp, action, arg_len ? arg : NULL
+    );
+}
+
+static s32 wh_ipc_dump(WhaleIpcConnection* conn, const u8* payload, u32 length)
+{
+    u16 name_len;
+    if (length < 2 + sizeof(u16))
+        return -1;
+
+    u8 mode = payload[0];
+    u8 format = payload[1];
+    memcpy(&name_len, payload + 2, sizeof(u16));
+    if (mode > WH_DUMP_EVERY_FRAME || format > WH_DUMP_RAW ||
+        name_len > length - 2 - sizeof(u16))
+        return -1;
+
+    const char* name = (const char*)payload + 2 + sizeof(u16);
+    s32 matched = 0;
+
+    WhaleOutput* output;
+    wl_list_for_each(output, &conn->ipc->comp->outputs, link)
+    {
+        const char* output_name = output->wlr_output->name;
+        if (name_len && (strlen(output_name) != name_len ||
+                         memcmp(output_name, name, name_len) != 0))
+            continue;
+
+        wh_dump_output_set(output, mode, format);
+        matched++;
+    }
+
+    return matched ? 0 : -1;
+}
+
+/**
+ * Handle a single request.
+ *
+ * @returns false if the request was malformed.
+ */
+static bool wh_ipc_handle_request(
+    WhaleIpcConnection* conn, const WhaleIpcHeader* header, const u8* payload
+)
+{
+    switch (header->type)
+    {
+    case WH_IPC_GET_OUTPUTS:
+        wh_ipc_reply_outputs(conn);
+        break;
+
+    case WH_IPC_GET_CLIENTS:
+        wh_ipc_reply_clients(conn);
+        break;
+
+    case WH_IPC_GET_STATS:
+        wh_ipc_reply_stats(conn);
+        break;
+
+    case WH_IPC_GET_MEMORY:
+        wh_ipc_reply_memory(conn);
+        break;
+
+    case WH_IPC_DUMP:
+    {
+        s32 status = wh_ipc_dump(conn, payload, header->length);
+        wh_ipc_reply_u32(conn, WH_IPC_DUMP, status);
+        break;
+    }
+
+    case WH_IPC_SUBSCRIBE:
+        if (header->length < sizeof(u32))
+            return false;
+
+        memcpy(&conn->events, payload, sizeof(u32));
+        wh_ipc_update_subscribed(conn->ipc);
+        wh_ipc_reply_u32(conn, WH_IPC_SUBSCRIBE, conn->events);
+        break;
+
+    case WH_IPC_COMMAND:
+    {
+        s32 status = wh_ipc_run_command(conn, payload, header->length);
+        wh_ipc_reply_u32(conn, WH_IPC_COMMAND, status);
+        break;
+    }
+
+    default:
+        return false;
+    }
+
+    wh_ipc_schedule_flush(conn->ipc);
+    return true;
+}
+
+/**
+ * Read and handle every complete request.
+ *
+ * @returns false if the connection was destroyed.
+ */
+static bool wh_ipc_connection_read(WhaleIpcConnection* conn)
+{
+    ssize_t n = recv(
+        conn->fd,
+        conn->in + conn->in_len,
+        sizeof(conn->in) - conn->in_len,
+        MSG_DONTWAIT
+    );
+
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+        return true;
+
+    if (n <= 0)
+    {
+        wh_ipc_connection_destroy(conn);
+        return false;
+    }
+
+    conn->in_len += n;
+
+    size_t off = 0;
+    while (conn->in_len - off >= sizeof(WhaleIpcHeader))
+    {
+        WhaleIpcHeader header;
+        memcpy(&header, conn->in + off, sizeof(header));
+
+        if (header.length > WH_IPC_MAX_PAYLOAD)
+        {
+            wh_log(WARN, "ipc: Request too large, disconnecting");
+            wh_ipc_connection_destroy(conn);
+            return false;
+        }
+
+        if (conn->in_len - off - sizeof(header) < header.length)
+            break;
+
+        const u8* payload = conn->in + off + sizeof(header);
+        if (!wh_ipc_handle_request(conn, &header, payload))
+        {
+            wh_log(WARN, "ipc: Malformed request, disconnecting");
+            wh_ipc_connection_destroy(conn);
+            return false;
+        }
+
+        off += sizeof(header) + header.length;
+    }
+
+    memmove(conn->in, conn->in + off, conn->in_len - off);
+    conn->in_len -= off;
+
+    return true;
+}
+
+static int on_connection_event(int, u32 mask, void* data)
+{
+    WhaleIpcConnection* conn = data;
+
+    if (mask & WL_EVENT_READABLE && !wh_ipc_connection_read(conn))
+        return 0;
+
+    if (mask & WL_EVENT_WRITABLE && !wh_ipc_connection_flush(conn))
+        return 0;
+
+    if (mask & (WL_EVENT_HANGUP | WL_EVENT_ERROR))
+        wh_ipc_connection_destroy(conn);
+
+    return 0;
+}
+
+static int on_ipc_accept(int fd, u32, void* data)
+{
+    WhaleIpc* ipc = data;
+
+    int conn_fd = accept4(fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (conn_fd < 0)
+        return 0;
+
+    WhaleIpcConnection* conn = calloc(1, sizeof(WhaleIpcConnection));
+    if (!conn)
+    {
+        close(conn_fd);
+        return 0;
+    }
+
+    conn->ipc = ipc;
+    conn->fd = conn_fd;
+    conn->source = wl_event_loop_add_fd(
+        wl_display_get_event_loop(ipc->comp->display),
+        conn_fd,
+        WL_EVENT_READABLE,
+        on_connection_event,
+        conn
+    );
+    if (!conn->source)
+    {
+        close(conn_fd);
+        free(conn);
+        return 0;
+    }
+
+    wl_list_insert(&ipc->connections, &conn->link);
+    return 0;
+}
+
+void wh_ipc_focus_changed(WhaleCompositor* comp, const WhaleClient* client)
+{
+    WhaleIpc* ipc = &comp->ipc;
+    if (!(ipc->subscribed & WH_IPC_EVENTS_FOCUS))
+        return;
+
+    u8 buf[sizeof(WhaleIpcHeader) + sizeof(u32)];
+    WhaleIpcWriter msg = {.data = buf, .cap = sizeof(buf)};
+    size_t start = wh_ipc_msg_begin(&msg, WH_IPC_EVENT_FOCUS);
+    wh_ipc_put_u32(&msg, client ? client->id : 0);
+    wh_ipc_msg_end(&msg, start);
+
+    wh_ipc_broadcast(ipc, WH_IPC_EVENTS_FOCUS, &msg);
+}
+
+int wh_ipc_init(WhaleCompositor* comp, const char* socket_name)
+{
+    WhaleIpc* ipc = &comp->ipc;
+    ipc->comp = comp;
+    ipc->fd = -1;
+    wl_list_init(&ipc->connections);
+
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    int len = snprintf(
+        addr.sun_path,
+        sizeof(addr.sun_path),
+        "%s/whale-%s.sock",
+        getenv("XDG_RUNTIME_DIR"),
+        socket_name
+    );
+    if (len < 0 || (size_t)len >= sizeof(addr.sun_path))
+    {
+        wh_log(ERR, "ipc: Socket path too long");
+        return -1;
+    }
+
+    ipc->fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (ipc->fd < 0)
+    {
+        wh_log(ERR, "ipc: Failed to create socket");
+        return -1;
+    }
+
+    /* The Wayland socket's lock already guarantees that no other whale
+    owns this name, anything left there is stale. */
+    unlink(addr.sun_path);
+    if (bind(ipc->fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 ||
+        listen(ipc->fd, 16) < 0)
+    {
+        wh_log(ERR, "ipc: Failed to bind %s", addr.sun_path);
+        close(ipc->fd);
+        ipc->fd = -1;
+        return -1;
+    }
+
+    ipc->path = strdup(addr.sun_path);
+    ipc->source = wl_event_loop_add_fd(
+        wl_display_get_event_loop(comp->display),
+        ipc->fd,
+        WL_EVENT_READABLE,
+        on_ipc_accept,
+        ipc
+    );
+
+    setenv("WHALE_IPC_SOCKET", addr.sun_path, 1);
+    wh_log(INFO, "WHALE_IPC_SOCKET: %s", addr.sun_path);
+
+    return 0;
+}
+
+void wh_ipc_finish(WhaleCompositor* comp)
+{
+    WhaleIpc* ipc = &comp->ipc;
+
+    WhaleIpcConnection* conn;
+    WhaleIpcConnection* tmp;
+    wl_list_for_each_safe(conn, tmp, &ipc->connections, link)
+        wh_ipc_connection_destroy(conn);
+
+    if (ipc->flush_idle)
+        wl_event_source_remove(ipc->flush_idle);
+    if (ipc->source)
+        wl_event_source_remove(ipc->source);
+    if (ipc->fd >= 0)
+        close(ipc->fd);
+    if (ipc->path)
+        unlink(ipc->path);
+
+    free(ipc->path);
+    ipc->path = NULL;
+    ipc->source = NULL;
+    ipc->flush_idle = NULL;
+    ipc->fd = -1;
+}
+
+void wh_ipc_client_changed(WhaleCompositor* comp, const WhaleClient* client)
+{
+    if (!(comp->ipc.subscribed & WH_IPC_EVENTS_CLIENT))
+        return;
+
+    u8 buf[WH_IPC_MAX_EVENT];
+    WhaleIpcWriter msg = {.data = buf, .cap = sizeof(buf)};
+    size_t start = wh_ipc_msg_begin(&msg, WH_IPC_EVENT_CLIENT_CHANGE);
+    wh_ipc_put_client(&msg, client);
+    wh_ipc_msg_end(&msg, start);
+
+    wh_ipc_broadcast(&comp->ipc, WH_IPC_EVENTS_CLIENT, &msg);
+}
+
+void wh_ipc_client_closed(WhaleCompositor* comp, const WhaleClient* client)
+{
+    if (!(comp->ipc.subscribed & WH_IPC_EVENTS_CLIENT))
+        return;
+
+    u8 buf[sizeof(WhaleIpcHeader) + sizeof(u32)];
+    WhaleIpcWriter msg = {.data = buf, .cap = sizeof(buf)};
+    size_t start = wh_ipc_msg_begin(&msg, WH_IPC_EVENT_CLIENT_CLOSE);
+    wh_ipc_put_u32(&msg, client->id);
+    wh_ipc_msg_end(&msg, start);
+
+    wh_ipc_broadcast(&comp->ipc, WH_IPC_EVENTS_CLIENT, &msg);
+}
+
+void wh_ipc_output_changed(WhaleCompositor* comp, const WhaleOutput* output)
+{
+    if (!(comp->ipc.subscribed & WH_IPC_EVENTS_OUTPUT))
+        return;
+
+    u8 buf[WH_IPC_MAX_EVENT];
+    WhaleIpcWriter msg = {.data = buf, .cap = sizeof(buf)};
+    size_t start = wh_ipc_msg_begin(&msg, WH_IPC_EVENT_OUTPUT_CHANGE);
+    wh_ipc_put_output(&msg, output);
+    wh_ipc_msg_end(&msg, start);
+
+    wh_ipc_broadcast(&comp->ipc, WH_IPC_EVENTS_OUTPUT, &msg);
+}
+
+void wh_ipc_output_removed(WhaleCompositor* comp, const WhaleOutput* output)
+{
+    if (!(comp->ipc.subscribed & WH_IPC_EVENTS_OUTPUT))
+        return;
+
+    u8 buf[WH_IPC_MAX_EVENT];
+    WhaleIpcWriter msg = {.data = buf, .cap = sizeof(buf)};
+    size_t start = wh_ipc_msg_begin(&msg, WH_IPC_EVENT_OUTPUT_REMOVE);
+    wh_ipc_put_str(&msg, output->wlr_output->name, WH_IPC_MAX_TITLE);
+    wh_ipc_msg_end(&msg, start);
+
+    wh_ipc_broadcast(&comp->ipc, WH_IPC_EVENTS_OUTPUT, &msg);
+}
@@ -0,0 +1,355 @@
+#define _POSIX_C_SOURCE 200809L
+#define WLR_USE_UNSTABLE
+#include <stdlib.h>
+#include <string.h>
+#include <whale/client.h>
+#include <whale/compositor.h>
+#include <whale/config.h>
+#include <whale/input.h>
+#include <whale/keybind.h>
+#include <whale/log.h>
+#include <whale/output.h>
+#include <whale/spawn.h>
+#include <whale/types.h>
+#include <wlr/backend/session.h>
+#include <wlr/types/wlr_keyboard.h>
+
+#define MOD_SUPER WLR_MODIFIER_LOGO
+#define MOD_SHIFT WLR_MODIFIER_SHIFT
+#define MOD_CTRL WLR_MODIFIER_CTRL
+#define MOD_ALT WLR_MODIFIER_ALT
+
+#define CHVT(n)                                                                \
+    {NULL, MOD_CTRL | MOD_ALT, XKB_KEY_F##n, WH_ACTION_CHVT, #n}
+
+static const WhaleKeybind default_keybinds[] = {
+    {NULL, MOD_SUPER, XKB_KEY_Return, WH_ACTION_SPAWN, "/bin/alacritty"},
+    {NULL, MOD_SUPER | MOD_SHIFT, XKB_KEY_q, WH_ACTION_CLOSE, NULL},
+    {NULL, MOD_SUPER | MOD_SHIFT, XKB_KEY_e, WH_ACTION_QUIT, NULL},
+    CHVT(1),
+    CHVT(2),
+    CHVT(3),
+    CHVT(4),
+    CHVT(5),
+    CHVT(6),
+    CHVT(7),
+    CHVT(8),
+    CHVT(9),
+    CHVT(10),
+    CHVT(11),
+    CHVT(12),
+};
+
+/* Keysyms fit in 29 bits and the modifier mask in 8 */
+static u64 wh_keybind_pack(u32 mode, u32 mods, xkb_keysym_t keysym)
+{
+    return ((u64)mode << 40) | ((u64)(mods & 0xff) << 32) | keysym;
+}
+
+static u32 wh_keybind_hash(u64 key, u32 mask)
+{
+    /* Fibonacci hashing, the high bits are the well mixed ones */
+    return (u32)((key * 0x9E3779B97F4A7C15ull) >> 32) & mask;
+}
+
+static int
+wh_keybind_find_mode(char* const* modes, u32 num_modes, const char* name)
+{
+    if (!name)
+        return 0;
+
+    for (u32 i = 0; i < num_modes; i++)
+    {
+        if (strcmp(modes[i], name) == 0)
+            return i;
+    }
+
+    return -1;
+}
+
+/* Register a mode name if we didn't see it yet, `modes` must be able to hold
+ * one more entry. */
+static u32
+wh_keybind_intern_mode(char** modes, u32* num_modes, const char* name)
+{
+    int idx = wh_keybind_find_mode(modes, *num_modes, name);
+    if (idx >= 0)
+        return idx;
+
+    modes[*num_modes] = (char*)name;
+    return (*num_modes)++;
+}
+
+static WhaleCompiledKeybind*
+wh_keybind_slot(const WhaleKeybindTable* table, u64 key)
+{
+    u32 i = wh_keybind_hash(key, table->mask);
+    while (table->slots[i].key && table->slots[i].key != key)
+        i = (i + 1) & table->mask;
+
+    return &table->slots[i];
+}
+
+int wh_keybind_table_compile(
+    WhaleKeybindTable* table, const WhaleKeybind* binds, size_t num_binds
+)
+{
+    /* Keep the load factor at or below 1/2 so probe chains stay short. */
+    u32 capacity = 8;
+    while (capacity < num_binds * 2)
+        capacity <<= 1;
+
+    /* Worst case every binding (and its target) names a new mode. */
+    size_t max_modes = 1 + num_binds * 2;
+    size_t strings_len = 0;
+    for (size_t i = 0; i < num_binds; i++)
+    {
+        if (binds[i].arg)
+            strings_len += strlen(binds[i].arg) + 1;
+        if (binds[i].mode)
+            strings_len += strlen(binds[i].mode) + 1;
+    }
+
+    WhaleCompiledKeybind* slots = calloc(capacity, sizeof(*slots));
+    char** modes = calloc(max_modes, sizeof(*modes));
+    char* strings = malloc(strings_len + sizeof("default"));
+    if (!slots || !modes || !strings)
+    {
+        free(slots);
+        free(modes);
+        free(strings);
+        wh_log(ERR, "keybind: Failed to allocate keybinding table");
+        return -1;
+    }
+
+    char* str = stpcpy(strings, "default") + 1;
+
+    u32 num_modes = 0;
+    wh_keybind_intern_mode(modes, &num_modes, strings);
+
+    WhaleKeybindTable compiled = {
+        .slots = slots,
+        .mask = capacity - 1,
+        .modes = modes,
+        .strings = strings,
+    };
+
+    for (size_t i = 0; i < num_binds; i++)
+    {
+        const WhaleKeybind* bind = &binds[i];
+        if (bind->keysym == XKB_KEY_NoSymbol)
+        {
+            wh_log(WARN, "keybind: Ignoring binding without a keysym");
+            continue;
+        }
+
+        if (wh_keybind_find_mode(modes, num_modes, bind->mode) < 0)
+        {
+            modes[num_modes] = str;
+            str = stpcpy(str, bind->mode) + 1;
+            num_modes++;
+        }
+
+        u32 mode = wh_keybind_find_mode(modes, num_modes, bind->mode);
+        u64 key = wh_keybind_pack(mode, bind->mods, bind->keysym);
+
+        WhaleCompiledKeybind* slot = wh_keybind_slot(&compiled, key);
+        slot->key = key;
+        slot->action = bind->action;
+        slot->repeat = bind->repeat;
+        slot->arg = NULL;
+        if (bind->arg)
+        {
+            slot->arg = str;
+            str = stpcpy(str, bind->arg) + 1;
+        }
+
+        if (bind->action == WH_ACTION_MODE)
+        {
+            /* Modes only referenced as targets still need an index. */
+            const char* target = bind->arg ? slot->arg : NULL;
+            slot->target_mode =
+                wh_keybind_intern_mode(modes, &num_modes, target);
+        }
+    }
+
+    compiled.num_modes = num_modes;
+
+    wh_keybind_table_finish(table);
+    *table = compiled;
+
+    wh_log(
+        DEBUG,
+        "keybind: compiled %zu bindings in %u modes (%u slots)",
+        num_binds,
+        num_modes,
+        capacity
+    );
+
+    return 0;
+}
+
+void wh_keybind_table_finish(WhaleKeybindTable* table)
+{
+    free(table->slots);
+    free(table->modes);
+    free(table->strings);
+    *table = (WhaleKeybindTable){0};
+}
+
+const WhaleCompiledKeybind* wh_keybind_lookup(
+    const WhaleKeybindTable* table, u32 mode, u32 mods, xkb_keysym_t keysym
+)
+{
+    if (!table->slots)
+        return NULL;
+
+    /* Lock modifiers must not change which binding matches. */
+    mods &= ~(WLR_MODIFIER_CAPS | WLR_MODIFIER_MOD2);
+
+    const WhaleCompiledKeybind* slot =
+        wh_keybind_slot(table, wh_keybind_pack(mode, mods, keysym));
+
+    return slot->key ? slot : NULL;
+}
+
+static int wh_keybind_compile(WhaleCompositor* comp, WhaleKeybindTable* table)
+{
+    const WhaleConfig* config = &comp->config.current;
+    if (config->num_binds)
+        return wh_keybind_table_compile(
+            table, config->binds, config->num_binds
+        );
+
+    return wh_keybind_table_compile(
+        table,
+        default_keybinds,
+        sizeof(default_keybinds) / sizeof(default_keybinds[0])
+    );
+}
+
+int wh_keybind_init(WhaleCompositor* comp)
+{
+    return wh_keybind_compile(comp, &comp->keybinds);
+}
+
+int wh_keybind_reload(WhaleCompositor* comp)
+{
+    WhaleKeybindTable table = {0};
+    if (wh_keybind_compile(comp, &table) < 0)
+        return -1;
+
+    int mode = wh_keybind_find_mode(
+        table.modes,
+        table.num_modes,
+        comp->keybinds.modes[comp->keybind_mode]
+    );
+
+    /* Held keys repeat a binding of the old table */
+    wh_input_key_repeat_cancel(comp);
+
+    wh_keybind_table_finish(&comp->keybinds);
+    comp->keybinds = table;
+    comp->keybind_mode = mode < 0 ? 0 : mode;
+
+    return 0;
+}
+
+/* Of the seat the binding was pressed on, or that last saw input when the
+action comes over IPC. */
+static void wh_keybind_close_focused(WhaleCompositor* comp)
+{
+    struct wlr_surface* surf =
+        comp->active_seat->wlr_seat->keyboard_state.focused_surface;
+    if (!surf)
+        return;
+
+    WhaleClient* client = wh_client_from_surface(surf);
+    if (client)
+        wh_client_close(client);
+}
+
+static void wh_keybind_set_mode(WhaleCompositor* comp, u32 mode)
+{
+    comp->keybind_mode = mode;
+    wh_log(DEBUG, "keybind: mode \"%s\"", comp->keybinds.modes[mode]);
+}
+
+int wh_keybind_run_action(
+    WhaleCompositor* comp, WhaleAction action, const char* arg
+)
+{
+    switch (action)
+    {
+    case WH_ACTION_SPAWN:
+        if (!arg || wh_spawn_command(comp, arg) < 0)
+            return -1;
+        break;
+
+    case WH_ACTION_CLOSE:
+        wh_keybind_close_focused(comp);
+        break;
+
+    case WH_ACTION_MODE:
+    {
+        int mode = wh_keybind_find_mode(
+            comp->keybinds.modes, comp->keybinds.num_modes, arg
+        );
+        if (mode < 0)
+            return -1;
+
+        wh_keybind_set_mode(comp, mode);
+        break;
+    }
+
+    case WH_ACTION_CHVT:
+        if (!comp->session || !arg)
+            return -1;
+
+        if (!wlr_session_change_vt(comp->session, atoi(arg)))
+            return -1;
+        break;
+
+    case WH_ACTION_QUIT:
+        wl_display_terminate(comp->display);
+        break;
+
+    case WH_ACTION_RELOAD:
+        if (wh_config_reload(comp) < 0)
+            return -1;
+        break;
+
+    case WH_ACTION_OUTPUT_ADD:
+    {
+        s32 width, height, refresh;
+        if (!arg || !wh_config_parse_mode(arg, &width, &height, &refresh))
+            return -1;
+
+        if (!wh_output_add_virtual(comp, width, height, refresh))
+            return -1;
+        break;
+    }
+
+    case WH_ACTION_OUTPUT_REMOVE:
+        if (!arg || wh_output_remove_virtual(comp, arg) < 0)
+            return -1;
+        break;
+
+    case WH_ACTION_NONE:
+        break;
+
+    default:
+        return -1;
+    }
+
+    return 0;
+}
+
+void wh_keybind_run(WhaleCompositor* comp, const WhaleCompiledKeybind* bind)
+{
+    /* The target mode was resolved when the table was compiled. */
+    if (bind->action == WH_ACTION_MODE)
+        wh_keybind_set_mode(comp, bind->target_mode);
+    else
+        wh_keybind_run_action(comp, bind->action, bind->arg);
+}
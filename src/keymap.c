@@ -0,0 +1,492 @@
+#define _POSIX_C_SOURCE 200809L
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include <whale/keymap.h>
+#include <whale/log.h>
+
+typedef struct
+{
+    /* Hash of the resolved rule names, see wh_keymap_names_hash() */
+    u64 names_hash;
+    /* Hash of the compiled keymap's text */
+    u64 content_hash;
+
+    /* Entries with the same content share one (referenced) keymap */
+    struct xkb_keymap* keymap;
+
+    struct wl_list link;
+} WhaleKeymapEntry;
+
+#define FNV_OFFSET 0xcbf29ce484222325ull
+#define FNV_PRIME 0x100000001b3ull
+
+static u64 wh_keymap_hash(u64 hash, const void* data, size_t len)
+{
+    const u8* bytes = data;
+    for (size_t i = 0; i < len; i++)
+        hash = (hash ^ bytes[i]) * FNV_PRIME;
+
+    return hash;
+}
+
+static u64 wh_keymap_hash_str(u64 hash, const char* str)
+{
+    if (!str)
+        str = "";
+
+    /* Hash the terminator too so ("ab", "c") and ("a", "bc") differ. */
+    return wh_keymap_hash(hash, str, strlen(str) + 1);
+}
+
+static const char* wh_keymap_name_or_env(const char* name, const char* var)
+{
+    return name && *name ? name : getenv(var);
+}
+
+/* Fill in unset names from the environment like xkbcommon would. The
+context is made not to read it, so the prefetch thread never calls
+getenv() while the main thread may setenv(). Only valid until the next
+setenv(). */
+static struct xkb_rule_names
+wh_keymap_names_resolve(const struct xkb_rule_names* names)
+{
+    return (struct xkb_rule_names){
+        .rules = wh_keymap_name_or_env(names->rules, "XKB_DEFAULT_RULES"),
+        .model = wh_keymap_name_or_env(names->model, "XKB_DEFAULT_MODEL"),
+        .layout = wh_keymap_name_or_env(names->layout, "XKB_DEFAULT_LAYOUT"),
+        .variant =
+            wh_keymap_name_or_env(names->variant, "XKB_DEFAULT_VARIANT"),
+        .options =
+            wh_keymap_name_or_env(names->options, "XKB_DEFAULT_OPTIONS"),
+    };
+}
+
+/* Of resolved names, see wh_keymap_names_resolve() */
+static u64 wh_keymap_names_hash(
+    const WhaleKeymapCache* cache, const struct xkb_rule_names* names
+)
+{
+    u64 hash = wh_keymap_hash(FNV_OFFSET, &cache->data_stamp, sizeof(u64));
+    hash = wh_keymap_hash_str(hash, names->rules);
+    hash = wh_keymap_hash_str(hash, names->model);
+    hash = wh_keymap_hash_str(hash, names->layout);
+    hash = wh_keymap_hash_str(hash, names->variant);
+    hash = wh_keymap_hash_str(hash, names->options);
+
+    return hash;
+}
+
+/* Package updates replace the files in these directories, bumping their
+mtime, which is enough to drop serialized keymaps built from old data. */
+static u64 wh_keymap_data_stamp(void)
+{
+    const char* root = getenv("XKB_CONFIG_ROOT");
+    if (!root)
+        root = "/usr/share/X11/xkb";
+
+    const char* home = getenv("HOME");
+    const char* config_home = getenv("XDG_CONFIG_HOME");
+    if (!home)
+        home = "";
+
+    char paths[4][512];
+    snprintf(paths[0], sizeof(paths[0]), "%s/rules", root);
+    snprintf(paths[1], sizeof(paths[1]), "%s/symbols", root);
+    if (config_home)
+        snprintf(paths[2], sizeof(paths[2]), "%s/xkb", config_home);
+    else
+        snprintf(paths[2], sizeof(paths[2]), "%s/.config/xkb", home);
+    snprintf(paths[3], sizeof(paths[3]), "%s/.xkb", home);
+
+    u64 stamp = FNV_OFFSET;
+    for (size_t i = 0; i < 4; i++)
+    {
+        struct stat st;
+        if (stat(paths[i], &st) < 0)
+            continue;
+
+        stamp = wh_keymap_hash(stamp, &st.st_mtim, sizeof(st.st_mtim));
+    }
+
+    return stamp;
+}
+
+static int wh_keymap_mkdir(const char* path)
+{
+    if (mkdir(path, 0700) < 0)
+    {
+        struct stat st;
+        if (stat(path, &st) < 0 || !S_ISDIR(st.st_mode))
+            return -1;
+    }
+
+    return 0;
+}
+
+static char* wh_keymap_cache_dir(void)
+{
+    char base[512];
+    const char* cache_home = getenv("XDG_CACHE_HOME");
+    const char* home = getenv("HOME");
+
+    if (cache_home && *cache_home)
+        snprintf(base, sizeof(base), "%s", cache_home);
+    else if (home && *home)
+        snprintf(base, sizeof(base), "%s/.cache", home);
+    else
+        return NULL;
+
+    char dir[600];
+    snprintf(dir, sizeof(dir), "%s/whale", base);
+    if (wh_keymap_mkdir(base) < 0 || wh_keymap_mkdir(dir) < 0)
+        return NULL;
+
+    snprintf(dir, sizeof(dir), "%s/whale/keymaps", base);
+    if (wh_keymap_mkdir(dir) < 0)
+        return NULL;
+
+    return strdup(dir);
+}
+
+static char* wh_keymap_read(const WhaleKeymapCache* cache, u64 names_hash)
+{
+    if (!cache->dir)
+        return NULL;
+
+    char path[700];
+    snprintf(
+        path,
+        sizeof(path),
+        "%s/%016llx.xkb",
+        cache->dir,
+        (unsigned long long)names_hash
+    );
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return NULL;
+
+    struct stat st;
+    char* text = NULL;
+    if (fstat(fd, &st) == 0 && st.st_size > 0)
+        text = malloc(st.st_size + 1);
+
+    if (text && read(fd, text, st.st_size) == st.st_size)
+    {
+        text[st.st_size] = '\0';
+    }
+    else
+    {
+        free(text);
+        text = NULL;
+    }
+
+    close(fd);
+    return text;
+}
+
+static void
+wh_keymap_write(const WhaleKeymapCache* cache, u64 names_hash, const char* text)
+{
+    if (!cache->dir)
+        return;
+
+    char path[700];
+    char tmp_path[720];
+    snprintf(
+        path,
+        sizeof(path),
+        "%s/%016llx.xkb",
+        cache->dir,
+        (unsigned long long)names_hash
+    );
+    snprintf(tmp_path, sizeof(tmp_path), "%s.XXXXXX", path);
+
+    int fd = mkstemp(tmp_path);
+    if (fd < 0)
+        return;
+
+    /* Write to a temporary file and rename it over so a concurrent reader
+    never sees a partial keymap. */
+    size_t len = strlen(text);
+    bool ok = write(fd, text, len) == (ssize_t)len;
+    close(fd);
+
+    if (!ok || rename(tmp_path, path) < 0)
+    {
+        unlink(tmp_path);
+        wh_log(WARN, "keymap: Failed to write %s", path);
+    }
+}
+
+static double wh_keymap_ms_since(const struct timespec* start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1e3 +
+           (now.tv_nsec - start->tv_nsec) / 1e6;
+}
+
+int wh_keymap_cache_init(WhaleKeymapCache* cache)
+{
+    wl_list_init(&cache->entries);
+
+    /* Without it keymaps are still prefetched, just never waited on from
+    the event loop. */
+    cache->prefetch_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (cache->prefetch_fd < 0)
+        wh_log(WARN, "keymap: Failed to create the prefetch eventfd");
+
+    cache->xkb_context = xkb_context_new(XKB_CONTEXT_NO_ENVIRONMENT_NAMES);
+    if (!cache->xkb_context)
+    {
+        wh_log(ERR, "keymap: Failed to create new xkb context.");
+        return -1;
+    }
+
+    cache->data_stamp = wh_keymap_data_stamp();
+    cache->dir = wh_keymap_cache_dir();
+    if (!cache->dir)
+        wh_log(WARN, "keymap: No cache directory, caching in memory only");
+
+    return 0;
+}
+
+static void wh_keymap_names_free(struct xkb_rule_names* names)
+{
+    free((char*)names->rules);
+    free((char*)names->model);
+    free((char*)names->layout);
+    free((char*)names->variant);
+    free((char*)names->options);
+    *names = (struct xkb_rule_names){0};
+}
+
+static int wh_keymap_names_copy(
+    struct xkb_rule_names* dst, const struct xkb_rule_names* src
+)
+{
+    const char* const from[] = {
+        src->rules, src->model, src->layout, src->variant, src->options,
+    };
+    const char** to[] = {
+        &dst->rules, &dst->model, &dst->layout, &dst->variant, &dst->options,
+    };
+
+    *dst = (struct xkb_rule_names){0};
+    for (size_t i = 0; i < sizeof(from) / sizeof(*from); i++)
+    {
+        if (from[i] && !(*to[i] = strdup(from[i])))
+        {
+            wh_keymap_names_free(dst);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+void wh_keymap_cache_wait(WhaleKeymapCache* cache)
+{
+    if (!cache->prefetching)
+        return;
+
+    pthread_join(cache->prefetch_thread, NULL);
+    cache->prefetching = false;
+    wh_keymap_names_free(&cache->prefetch_names);
+}
+
+void wh_keymap_cache_finish(WhaleKeymapCache* cache)
+{
+    wh_keymap_cache_wait(cache);
+
+    WhaleKeymapEntry* entry;
+    WhaleKeymapEntry* tmp;
+    wl_list_for_each_safe(entry, tmp, &cache->entries, link)
+    {
+        xkb_keymap_unref(entry->keymap);
+        wl_list_remove(&entry->link);
+        free(entry);
+    }
+
+    xkb_context_unref(cache->xkb_context);
+    free(cache->dir);
+    if (cache->prefetch_fd >= 0)
+        close(cache->prefetch_fd);
+    cache->prefetch_fd = -1;
+    cache->xkb_context = NULL;
+    cache->dir = NULL;
+}
+
+/* Names must be resolved, the hash computed from them on the main thread */
+static struct xkb_keymap* wh_keymap_cache_load(
+    WhaleKeymapCache* cache, const struct xkb_rule_names* names, u64 names_hash
+)
+{
+    WhaleKeymapEntry* entry;
+    wl_list_for_each(entry, &cache->entries, link)
+    {
+        if (entry->names_hash == names_hash)
+            return entry->keymap;
+    }
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    /* Loading the serialized text skips resolving every include in the xkb
+    data, which is where most of the compile time goes. */
+    struct xkb_keymap* keymap = NULL;
+    char* text = wh_keymap_read(cache, names_hash);
+    if (text)
+    {
+        keymap = xkb_keymap_new_from_string(
+            cache->xkb_context,
+            text,
+            XKB_KEYMAP_FORMAT_TEXT_V1,
+            XKB_KEYMAP_COMPILE_NO_FLAGS
+        );
+    }
+
+    if (keymap)
+    {
+        wh_log(
+            DEBUG,
+            "keymap: loaded from disk in %.2f ms",
+            wh_keymap_ms_since(&start)
+        );
+    }
+    else
+    {
+        free(text);
+
+        keymap = xkb_keymap_new_from_names(
+            cache->xkb_context, names, XKB_KEYMAP_COMPILE_NO_FLAGS
+        );
+        if (!keymap)
+        {
+            wh_log(ERR, "keymap: Failed to compile xkb keymap.");
+            return NULL;
+        }
+
+        text = xkb_keymap_get_as_string(keymap, XKB_KEYMAP_FORMAT_TEXT_V1);
+        if (text)
+            wh_keymap_write(cache, names_hash, text);
+
+        wh_log(
+            DEBUG, "keymap: compiled in %.2f ms", wh_keymap_ms_since(&start)
+        );
+    }
+
+    entry = calloc(1, sizeof(*entry));
+    if (!entry)
+    {
+        free(text);
+        xkb_keymap_unref(keymap);
+        return NULL;
+    }
+
+    entry->names_hash = names_hash;
+    entry->content_hash = text ? wh_keymap_hash_str(FNV_OFFSET, text) : 0;
+    entry->keymap = keymap;
+    free(text);
+
+    /* Different names can still produce the same keymap, share it. */
+    WhaleKeymapEntry* other;
+    wl_list_for_each(other, &cache->entries, link)
+    {
+        if (entry->content_hash && other->content_hash == entry->content_hash)
+        {
+            xkb_keymap_unref(entry->keymap);
+            entry->keymap = xkb_keymap_ref(other->keymap);
+            break;
+        }
+    }
+
+    wl_list_insert(&cache->entries, &entry->link);
+    return entry->keymap;
+}
+
+struct xkb_keymap* wh_keymap_cache_get(
+    WhaleKeymapCache* cache, const struct xkb_rule_names* names
+)
+{
+    /* xkbcommon objects may only be used from one thread at a time. */
+    wh_keymap_cache_wait(cache);
+
+    struct xkb_rule_names resolved = wh_keymap_names_resolve(names);
+    return wh_keymap_cache_load(
+        cache, &resolved, wh_keymap_names_hash(cache, &resolved)
+    );
+}
+
+static void* wh_keymap_prefetch_thread(void* data)
+{
+    WhaleKeymapCache* cache = data;
+    wh_keymap_cache_load(
+        cache, &cache->prefetch_names, cache->prefetch_hash
+    );
+
+    atomic_store(&cache->prefetch_done, true);
+    if (cache->prefetch_fd >= 0)
+        eventfd_write(cache->prefetch_fd, 1);
+
+    return NULL;
+}
+
+int wh_keymap_cache_prefetch(
+    WhaleKeymapCache* cache, const struct xkb_rule_names* names
+)
+{
+    wh_keymap_cache_wait(cache);
+
+    /* The names may be freed with the config they come from while the
+    thread still runs. */
+    struct xkb_rule_names resolved = wh_keymap_names_resolve(names);
+    if (wh_keymap_names_copy(&cache->prefetch_names, &resolved) < 0)
+        return -1;
+
+    cache->prefetch_hash = wh_keymap_names_hash(cache, &resolved);
+
+    atomic_store(&cache->prefetch_done, false);
+    if (pthread_create(
+            &cache->prefetch_thread, NULL, wh_keymap_prefetch_thread, cache
+        ) != 0)
+    {
+        wh_log(WARN, "keymap: Failed to start prefetch thread");
+        wh_keymap_names_free(&cache->prefetch_names);
+        return -1;
+    }
+
+    cache->prefetching = true;
+    return 0;
+}
+
+bool wh_keymap_cache_busy(WhaleKeymapCache* cache)
+{
+    return cache->prefetching && !atomic_load(&cache->prefetch_done);
+}
+
+bool wh_keymap_cache_contains(
+    WhaleKeymapCache* cache, const struct xkb_rule_names* names
+)
+{
+    wh_keymap_cache_wait(cache);
+
+    struct xkb_rule_names resolved = wh_keymap_names_resolve(names);
+    u64 names_hash = wh_keymap_names_hash(cache, &resolved);
+
+    WhaleKeymapEntry* entry;
+    wl_list_for_each(entry, &cache->entries, link)
+    {
+        if (entry->names_hash == names_hash)
+            return true;
+    }
+
+    return false;
+}
@@ -1,7 +1,6 @@
 
 #define _POSIX_C_SOURCE 200112L
 #define WLR_USE_UNSTABLE
-#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -17,11 +16,23 @@
 #include <wlr/types/wlr_subcompositor.h>
 #include <wlr/types/wlr_xcursor_manager.h>
 
+#include <whale/capture.h>
 #include <whale/client.h>
+#include <whale/config.h>
+#include <whale/decoration.h>
+#include <whale/dump.h>
+#include <whale/idle.h>
 #include <whale/compositor.h>
 #include <whale/input.h>
+#include <whale/ipc.h>
+#include <whale/keybind.h>
 #include <whale/log.h>
+#include <whale/memory.h>
 #include <whale/output.h>
+#include <whale/pacing.h>
+#include <whale/spawn.h>
+#include <whale/startup.h>
+#include <whale/throttle.h>
 #include <whale/types.h>
 
 static int die(const char* msg)
@@ -33,7 +44,7 @@ static int die(const char* msg)
 static int wh_init_wl_interfaces(WhaleCompositor* comp)
 {
     /* Interface for letting clients allocate surfaces & regions. */
-    wlr_compositor_create(comp->display, 6, comp->renderer);
+    comp->compositor = wlr_compositor_create(comp->display, 6, comp->renderer);
 
     /* Inteface for letting clients create sub-surfaces */
     wlr_subcompositor_create(comp->display);
@@ -48,60 +59,133 @@ static int wh_init_wl_interfaces(WhaleCompositor* comp)
         &comp->listeners.xdg_new_toplevel,
         wh_client_on_new_client
     );
+    LISTEN(
+        &comp->xdg_shell->events.new_popup,
+        &comp->listeners.xdg_new_popup,
+        wh_client_on_new_popup
+    );
 
     return 0;
 }
 
-static int wh_spawn_process(const char* pathname)
+static void usage(const char* prog)
+{
+    fprintf(stderr, "usage: %s [-o <width>x<height>[@<hz>]]...\n", prog);
+    fprintf(
+        stderr,
+        "  -o  create a virtual output, can be given several times\n"
+    );
+    exit(1);
+}
+
+int main(int argc, char** argv)
 {
-    const pid_t pid = fork();
-    if (pid < 0)
+    /* Virtual outputs to create once the backend runs */
+    WhaleOutputConfig* virtual_outputs =
+        calloc(argc, sizeof(WhaleOutputConfig));
+    size_t num_virtual_outputs = 0;
+    if (!virtual_outputs)
+        die("Failed to parse the command line!");
+
+    int opt;
+    while ((opt = getopt(argc, argv, "o:")) != -1)
     {
-        wh_log(ERR, "Failed to spawn process %s", pathname);
-        return -1;
+        WhaleOutputConfig* output = &virtual_outputs[num_virtual_outputs++];
+        if (opt != 'o' || !wh_config_parse_mode(
+                              optarg,
+                              &output->width,
+                              &output->height,
+                              &output->refresh
+                          ))
+            usage(argv[0]);
     }
 
-    if (pid > 0)
-        return 0; // parent, ok.
+    if (optind < argc)
+        usage(argv[0]);
 
-    /* child, close stdout, in and err on exec. */
-    fcntl(fileno(stdin), F_SETFD, FD_CLOEXEC);
-    fcntl(fileno(stdout), F_SETFD, FD_CLOEXEC);
-    fcntl(fileno(stderr), F_SETFD, FD_CLOEXEC);
-
-    char* const argv[] = {(char* const)pathname, NULL};
-    execv(pathname, argv);
-
-    exit(0);
-}
-
-int main(int, char**)
-{
     if (!getenv("XDG_RUNTIME_DIR"))
         die("Wayland needs XDG_RUNTIME_DIR env variable!");
 
+    wh_startup_mark("start");
+
     WhaleCompositor comp = {0};
 
     comp.display = wl_display_create();
     if (!comp.display)
         die("Failed to create wayland display!");
 
+    /* Every module below takes its settings from it */
+    if (wh_config_init(&comp) < 0)
+        die("Failed to load the config!");
+
+    if (wh_throttle_init(&comp) < 0)
+        die("Failed to set up client accounting!");
+
+    /* Before the keymap prefetch starts a thread */
+    if (wh_memory_init(&comp) < 0)
+        die("Failed to set up buffer accounting!");
+
+    wh_dump_init(&comp);
+
+    /* Clients can connect as soon as the socket exists, they just wait for
+    their first roundtrip until the loop runs. Globals are all created by
+    then, so the socket and the autostart list come first and the clients'
+    own startup overlaps with ours. */
+    const char* socket = wl_display_add_socket_auto(comp.display);
+    if (!socket)
+        die("Failed to create Wayland socket!");
+
+    setenv("WAYLAND_DISPLAY", socket, 1);
+
+    wh_log(INFO, "WAYLAND_DISPLAY: %s", socket);
+    wh_startup_mark("socket");
+
+    /* Before autostart, so children inherit WHALE_IPC_SOCKET. Whale is
+    still usable without it. */
+    if (wh_ipc_init(&comp, socket) < 0)
+        wh_log(WARN, "Failed to create the IPC socket");
+
+    if (wh_spawn_init(&comp) < 0)
+        die("Failed to set up child reaping!");
+
+#ifdef WH_XWAYLAND
+    /* DISPLAY has to be set for autostart too, the X server itself only
+    starts once something connects to it. */
+    if (wh_xwayland_reserve(&comp) < 0)
+        wh_log(WARN, "X11 clients are unavailable");
+#endif
+
+    wh_spawn_autostart(&comp);
+    wh_startup_mark("autostart");
+
+    /* The keymap compiles while the backend and renderer come up. */
+    if (wh_input_keymap_prefetch(&comp) < 0)
+        die("Failed to set up the keymap cache!");
+
     comp.backend = wlr_backend_autocreate(
         wl_display_get_event_loop(comp.display), &comp.session
     );
     if (!comp.backend)
         die("Failed to create wlr backend!");
 
+    /* Added before the backend starts, so it starts along with the rest */
+    if (wh_output_virtual_init(&comp) < 0)
+        wh_log(WARN, "Virtual outputs are unavailable");
+
+    wh_startup_mark("backend");
+
     comp.root_scene = wlr_scene_create();
 
-    float color[] = {0x12 / 255.f, 0x12 / 255.f, 0x12 / 255.f, 0xFF / 255.f};
-    comp.root_bg_rect =
-        wlr_scene_rect_create(&comp.root_scene->tree, 0, 0, color);
+    comp.root_bg_rect = wlr_scene_rect_create(
+        &comp.root_scene->tree, 0, 0, comp.config.current.background
+    );
 
     comp.renderer = wlr_renderer_autocreate(comp.backend);
     if (!comp.renderer)
         die("Failed to create wlr renderer!");
 
+    wh_startup_mark("renderer");
+
     // DWL creates the dmabuf manually to integrate it with the scene??
     wlr_renderer_init_wl_display(comp.renderer, comp.display);
 
@@ -112,6 +196,8 @@ int main(int, char**)
     if (wh_init_wl_interfaces(&comp) < 0)
         die("Failed to init some interfaces.");
 
+    wh_startup_mark("interfaces");
+
     /* An output layout is all of the outputs arranged into a
      * 2D coordinate space */
     comp.output_layout = wlr_output_layout_create(comp.display);
@@ -136,6 +222,7 @@ int main(int, char**)
         wlr_server_decoration_manager_create(comp.display),
         WLR_SERVER_DECORATION_MANAGER_MODE_SERVER
     );
+    wh_decoration_init(&comp);
     comp.xdg_decoration_manager =
         wlr_xdg_decoration_manager_v1_create(comp.display);
     LISTEN(
@@ -144,23 +231,54 @@ int main(int, char**)
         wh_client_on_new_xdg_decoration
     );
 
-    wh_input_init(&comp);
+    if (wh_capture_init(&comp) < 0)
+        wh_log(WARN, "Screen capture is unavailable");
 
-    // RUN()
-    const char* socket = wl_display_add_socket_auto(comp.display);
-    if (!socket)
-        die("Failed to create Wayland socket!");
+    if (wh_idle_init(&comp) < 0)
+        wh_log(WARN, "Idle management is unavailable");
 
-    setenv("WAYLAND_DISPLAY", socket, 1);
+    if (wh_pacing_init(&comp) < 0)
+        wh_log(WARN, "Presentation pacing is unavailable");
 
-    wh_log(INFO, "WAYLAND_DISPLAY: %s", socket);
+#ifdef WH_XWAYLAND
+    if (comp.xwayland.server && wh_xwayland_init(&comp) < 0)
+        wh_log(WARN, "X11 clients are unavailable");
+#endif
+
+    wh_input_init(&comp);
+    wh_startup_mark("input");
 
+    if (wh_keybind_init(&comp) < 0)
+        die("Failed to compile keybindings!");
+
+    // RUN()
     if (!wlr_backend_start(comp.backend))
         die("Failed to start wlr backend!");
 
-    wh_spawn_process("/bin/alacritty");
+    wh_startup_mark("backend start");
+
+    for (size_t i = 0; i < num_virtual_outputs; i++)
+    {
+        const WhaleOutputConfig* output = &virtual_outputs[i];
+        if (!wh_output_add_virtual(
+                &comp, output->width, output->height, output->refresh
+            ))
+            die("Failed to create a virtual output!");
+    }
+    free(virtual_outputs);
 
     wl_display_run(comp.display);
 
+    wh_ipc_finish(&comp);
+    wh_throttle_finish(&comp);
+    wh_dump_finish(&comp);
+    wh_decoration_finish(&comp);
+    wh_idle_finish(&comp);
+    wh_pacing_finish(&comp);
+#ifdef WH_XWAYLAND
+    wh_xwayland_finish(&comp);
+#endif
+    wh_config_finish(&comp);
+
     return 0;
 }
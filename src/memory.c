@@ -0,0 +1,235 @@
+#define _GNU_SOURCE
+#define WLR_USE_UNSTABLE
+#include <signal.h>
+#include <stdlib.h>
+#include <wayland-server-core.h>
+#include <whale/client.h>
+#include <whale/compositor.h>
+#include <whale/log.h>
+#include <whale/memory.h>
+#include <whale/types.h>
+#include <wlr/render/dmabuf.h>
+#include <wlr/types/wlr_buffer.h>
+#include <wlr/types/wlr_compositor.h>
+
+#define MIB(bytes) ((double)(bytes) / (1024 * 1024))
+
+/* A buffer accounted to a client, dropped when the buffer is destroyed. */
+typedef struct
+{
+    WhaleBufferStats* stats;
+    struct wlr_buffer* buffer;
+    /* Surface it was first attached to, only compared */
+    const struct wlr_surface* surface;
+
+    u64 size;
+    bool dmabuf;
+
+    struct wl_listener destroy;
+    /* WhaleBufferStats::buffers */
+    struct wl_list link;
+} WhaleBufferRef;
+
+static u64 wh_memory_buffer_size(struct wlr_buffer* buffer, bool* dmabuf)
+{
+    struct wlr_dmabuf_attributes attribs;
+    if (wlr_buffer_get_dmabuf(buffer, &attribs))
+    {
+        /* Planes may be subsampled, assuming full height gives an upper
+        bound without knowing every format. */
+        u64 size = 0;
+        for (int i = 0; i < attribs.n_planes; i++)
+            size += (u64)attribs.stride[i] * attribs.height;
+
+        *dmabuf = true;
+        return size;
+    }
+
+    *dmabuf = false;
+
+    struct wlr_shm_attributes shm;
+    if (wlr_buffer_get_shm(buffer, &shm))
+        return (u64)shm.stride * shm.height;
+
+    /* Some other kind of buffer, assume 32 bits per pixel */
+    return (u64)buffer->width * buffer->height * 4;
+}
+
+static void wh_memory_ref_destroy(WhaleBufferRef* ref)
+{
+    WhaleBufferStats* stats = ref->stats;
+
+    if (ref->dmabuf)
+        stats->dmabuf_bytes -= ref->size;
+    else
+        stats->shm_bytes -= ref->size;
+    stats->count--;
+
+    UNLISTEN(&ref->destroy);
+    wl_list_remove(&ref->link);
+    free(ref);
+}
+
+static void on_buffer_destroy(struct wl_listener* listener, void*)
+{
+    WhaleBufferRef* ref = wl_container_of(listener, ref, destroy);
+    wh_memory_ref_destroy(ref);
+}
+
+static void wh_memory_check_limit(
+    WhaleClient* client, const WhaleMemoryConfig* config, struct wl_client* wl
+)
+{
+    WhaleBufferStats* stats = &client->buffer_stats;
+    u64 total = stats->shm_bytes + stats->dmabuf_bytes;
+
+    if (!config->soft_limit || total <= config->soft_limit)
+    {
+        stats->over_limit = false;
+        return;
+    }
+
+    if (stats->over_limit)
+        return;
+
+    stats->over_limit = true;
+    wh_log(
+        WARN,
+        "memory: Client %u holds %.1f MiB of buffers, over the %.1f MiB limit",
+        client->id,
+        MIB(total),
+        MIB(config->soft_limit)
+    );
+
+    /* Posting the error only flags the connection, libwayland destroys it
+    once it is done dispatching, so this is safe from a commit handler. */
+    if (config->kill)
+        wl_client_post_implementation_error(
+            wl, "buffer memory limit exceeded"
+        );
+}
+
+void wh_memory_account_commit(WhaleClient* client, struct wlr_surface* surface)
+{
+    if (!(surface->pending.committed & WLR_SURFACE_STATE_BUFFER) ||
+        !surface->pending.buffer)
+        return;
+
+    struct wlr_buffer* buffer = surface->pending.buffer;
+    WhaleBufferStats* stats = &client->buffer_stats;
+
+    /* Clients cycle through a handful of buffers, a list is enough. */
+    WhaleBufferRef* ref;
+    wl_list_for_each(ref, &stats->buffers, link)
+    {
+        if (ref->buffer == buffer)
+            return;
+    }
+
+    ref = calloc(1, sizeof(WhaleBufferRef));
+    if (!ref)
+        return;
+
+    ref->stats = stats;
+    ref->buffer = buffer;
+    ref->surface = surface;
+    ref->size = wh_memory_buffer_size(buffer, &ref->dmabuf);
+    LISTEN(&buffer->events.destroy, &ref->destroy, on_buffer_destroy);
+    wl_list_insert(&stats->buffers, &ref->link);
+
+    if (ref->dmabuf)
+        stats->dmabuf_bytes += ref->size;
+    else
+        stats->shm_bytes += ref->size;
+    stats->count++;
+
+    u64 total = stats->shm_bytes + stats->dmabuf_bytes;
+    if (total > stats->peak_bytes)
+        stats->peak_bytes = total;
+
+    wh_memory_check_limit(
+        client, &client->comp->memory, wl_resource_get_client(surface->resource)
+    );
+}
+
+void wh_memory_stats_init(WhaleBufferStats* stats)
+{
+    *stats = (WhaleBufferStats){0};
+    wl_list_init(&stats->buffers);
+}
+
+void wh_memory_stats_finish(WhaleBufferStats* stats)
+{
+    WhaleBufferRef* ref;
+    WhaleBufferRef* tmp;
+    wl_list_for_each_safe(ref, tmp, &stats->buffers, link)
+        wh_memory_ref_destroy(ref);
+}
+
+u32 wh_memory_swapchain_depth(const WhaleBufferStats* stats)
+{
+    u32 depth = 0;
+
+    const WhaleBufferRef* ref;
+    wl_list_for_each(ref, &stats->buffers, link)
+    {
+        u32 n = 0;
+        const WhaleBufferRef* other;
+        wl_list_for_each(other, &stats->buffers, link)
+            n += other->surface == ref->surface;
+
+        if (n > depth)
+            depth = n;
+    }
+
+    return depth;
+}
+
+void wh_memory_dump(WhaleCompositor* comp)
+{
+    u64 total = 0;
+
+    WhaleClient* client;
+    wl_list_for_each(client, &comp->clients, link)
+    {
+        const WhaleBufferStats* stats = &client->buffer_stats;
+        total += stats->shm_bytes + stats->dmabuf_bytes;
+
+        wh_log(
+            INFO,
+            "memory: %u \"%s\": %u buffers, depth %u, %.1f MiB shm, "
+            "%.1f MiB dmabuf, peak %.1f MiB",
+            client->id,
+            wh_client_title(client),
+            stats->count,
+            wh_memory_swapchain_depth(stats),
+            MIB(stats->shm_bytes),
+            MIB(stats->dmabuf_bytes),
+            MIB(stats->peak_bytes)
+        );
+    }
+
+    wh_log(INFO, "memory: %.1f MiB of client buffers in total", MIB(total));
+}
+
+static int on_sigusr1(int, void* data)
+{
+    wh_memory_dump(data);
+    return 0;
+}
+
+int wh_memory_init(WhaleCompositor* comp)
+{
+    comp->memory = comp->config.current.memory;
+
+    /* Blocks SIGUSR1 and reads it from a signalfd. */
+    if (!wl_event_loop_add_signal(
+            wl_display_get_event_loop(comp->display), SIGUSR1, on_sigusr1, comp
+        ))
+    {
+        wh_log(ERR, "memory: Failed to watch SIGUSR1");
+        return -1;
+    }
+
+    return 0;
+}
@@ -1,34 +1,68 @@
 
 #define _POSIX_C_SOURCE 199309L
 #define WLR_USE_UNSTABLE
-#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 #include <wayland-util.h>
 #include <whale/compositor.h>
+#include <whale/config.h>
+#include <whale/dump.h>
+#include <whale/grab.h>
+#include <whale/ipc.h>
 #include <whale/log.h>
 #include <whale/output.h>
+#include <whale/pacing.h>
+#include <whale/startup.h>
+#include <whale/throttle.h>
 #include <whale/types.h>
 #include <wlr/backend.h>
+#include <wlr/backend/headless.h>
+#include <wlr/backend/multi.h>
 
 static void on_monitor_frame(struct wl_listener* listener, void*)
 {
     WhaleOutput* output = wl_container_of(listener, output, listener_frame);
 
-    wlr_scene_output_commit(output->scene_output, NULL);
+    wh_startup_mark("first output frame");
+
+    /* Windows being dragged move once per frame, not per pointer event */
+    wh_grab_apply(output->comp);
 
     struct timespec ts;
     clock_gettime(CLOCK_MONOTONIC, &ts);
-    wlr_scene_output_send_frame_done(output->scene_output, &ts);
+    wh_pacing_output_frame(output->comp, output->scene_output, &ts);
+
+    if (output->dump_mode != WH_DUMP_OFF)
+        wh_dump_output_commit(output);
+    else
+        wlr_scene_output_commit(output->scene_output, NULL);
+
+    wh_pacing_output_latched(output->comp, output->scene_output);
+    wh_throttle_send_frame_done(output->comp, output->scene_output, &ts);
 }
 
-static void on_monitor_destroy(struct wl_listener*, void*)
+static void on_monitor_destroy(struct wl_listener* listener, void*)
 {
-    printf("output: destroy\n");
+    WhaleOutput* output = wl_container_of(listener, output, listener_destroy);
+
+    wh_log(DEBUG, "output: destroy %s", output->wlr_output->name);
+    wh_ipc_output_removed(output->comp, output);
+
+    UNLISTEN(&output->listener_frame);
+    UNLISTEN(&output->listener_destroy);
+    UNLISTEN(&output->listener_request_state);
+
+    output->wlr_output->data = NULL;
+    wl_list_remove(&output->link);
+    free(output);
 }
 
-static void on_monitor_request_state(struct wl_listener*, void* data)
+static void on_monitor_request_state(struct wl_listener* listener, void* data)
 {
+    WhaleOutput* output =
+        wl_container_of(listener, output, listener_request_state);
+
     /* The monitor is asking us that it wants this state */
     struct wlr_output_event_request_state* event = data;
     wlr_output_commit_state(event->output, event->state);
@@ -36,6 +70,82 @@ static void on_monitor_request_state(struct wl_listener*, void* data)
     wh_log(
         DEBUG, "output: size %dx%d", event->output->width, event->output->height
     );
+    wh_ipc_output_changed(output->comp, output);
+}
+
+/* The listed mode closest to the configured one, NULL if none has its
+size. */
+static struct wlr_output_mode* wh_output_find_mode(
+    struct wlr_output* wlr_output, const WhaleOutputConfig* config
+)
+{
+    struct wlr_output_mode* best = NULL;
+    struct wlr_output_mode* mode;
+    wl_list_for_each(mode, &wlr_output->modes, link)
+    {
+        if (mode->width != config->width || mode->height != config->height)
+            continue;
+
+        /* Without a refresh rate the fastest one */
+        if (!best ||
+            (config->refresh ? abs(mode->refresh - config->refresh) <
+                                   abs(best->refresh - config->refresh)
+                             : mode->refresh > best->refresh))
+            best = mode;
+    }
+
+    return best;
+}
+
+void wh_output_configure(WhaleOutput* output)
+{
+    struct wlr_output* wlr_output = output->wlr_output;
+    const WhaleOutputConfig* config =
+        wh_config_output(&output->comp->config.current, wlr_output->name);
+
+    /* Virtual outputs keep the mode they were made with unless the config
+    gives them another one */
+    WhaleOutputConfig virtual_config;
+    if (output->is_virtual && (!config || !config->width))
+    {
+        virtual_config = config ? *config : (WhaleOutputConfig){0};
+        virtual_config.width = output->virtual_width;
+        virtual_config.height = output->virtual_height;
+        virtual_config.refresh = output->virtual_refresh;
+        config = &virtual_config;
+    }
+
+    struct wlr_output_state state;
+    wlr_output_state_init(&state);
+    wlr_output_state_set_enabled(&state, true);
+    wlr_output_state_set_scale(
+        &state, config && config->scale > 0 ? config->scale : 1
+    );
+
+    struct wlr_output_mode* mode =
+        config && config->width ? wh_output_find_mode(wlr_output, config)
+                                : wlr_output_preferred_mode(wlr_output);
+
+    /* Backends without fixed modes take any size */
+    if (mode || !config || !config->width)
+        wlr_output_state_set_mode(&state, mode);
+    else
+        wlr_output_state_set_custom_mode(
+            &state, config->width, config->height, config->refresh
+        );
+
+    if (!wlr_output_commit_state(wlr_output, &state))
+        wh_log(ERR, "output: Failed to configure %s", wlr_output->name);
+    wlr_output_state_finish(&state);
+
+    wh_log(
+        DEBUG,
+        "output: %s %dx%d@%d",
+        wlr_output->name,
+        wlr_output->width,
+        wlr_output->height,
+        wlr_output->refresh
+    );
 }
 
 void wh_output_on_new_output(struct wl_listener* listener, void* data)
@@ -58,7 +168,11 @@ void wh_output_on_new_output(struct wl_listener* listener, void* data)
         return;
     }
 
+    mon->comp = comp;
     mon->wlr_output = wlr_output;
+    wlr_output->data = mon;
+    mon->dump_mode = comp->dumper.default_mode;
+    mon->dump_format = comp->dumper.default_format;
 
     /* Set the output's event listeners */
     LISTEN(&wlr_output->events.frame, &mon->listener_frame, on_monitor_frame);
@@ -71,15 +185,7 @@ void wh_output_on_new_output(struct wl_listener* listener, void* data)
         on_monitor_request_state
     );
 
-    /* Set the monitor to it's prefered state */
-    struct wlr_output_state state;
-    wlr_output_state_init(&state);
-    wlr_output_state_set_enabled(&state, true);
-    wlr_output_state_set_scale(&state, 1);
-    wlr_output_state_set_mode(&state, wlr_output_preferred_mode(wlr_output));
-
-    wlr_output_commit_state(wlr_output, &state);
-    wlr_output_state_finish(&state);
+    wh_output_configure(mon);
 
     /* Add the output to the output-layout, from left to right. */
     wlr_output_layout_add_auto(comp->output_layout, wlr_output);
@@ -89,6 +195,7 @@ void wh_output_on_new_output(struct wl_listener* listener, void* data)
 
     /* Keep track of this output */
     wl_list_insert(&comp->outputs, &mon->link);
+    wh_ipc_output_changed(comp, mon);
 }
 
 void wh_output_layout_on_change(struct wl_listener* listener, void*)
@@ -106,4 +213,105 @@ void wh_output_layout_on_change(struct wl_listener* listener, void*)
     wlr_scene_rect_set_size(
         comp->root_bg_rect, scene_geom.width, scene_geom.height
     );
+
+    /* Outputs may have moved */
+    WhaleOutput* output;
+    wl_list_for_each(output, &comp->outputs, link)
+        wh_ipc_output_changed(comp, output);
+}
+
+static void wh_output_find_headless(struct wlr_backend* backend, void* data)
+{
+    struct wlr_backend** headless = data;
+    if (!*headless && wlr_backend_is_headless(backend))
+        *headless = backend;
+}
+
+int wh_output_virtual_init(WhaleCompositor* comp)
+{
+    if (!wlr_backend_is_multi(comp->backend))
+    {
+        wh_log(ERR, "output: Can't add a headless backend");
+        return -1;
+    }
+
+    /* Reuse the one WLR_BACKENDS=headless made */
+    wlr_multi_for_each_backend(
+        comp->backend, wh_output_find_headless, &comp->headless_backend
+    );
+    if (comp->headless_backend)
+        return 0;
+
+    comp->headless_backend =
+        wlr_headless_backend_create(wl_display_get_event_loop(comp->display));
+    if (!comp->headless_backend)
+    {
+        wh_log(ERR, "output: Failed to create the headless backend");
+        return -1;
+    }
+
+    if (!wlr_multi_backend_add(comp->backend, comp->headless_backend))
+    {
+        wh_log(ERR, "output: Failed to add the headless backend");
+        wlr_backend_destroy(comp->headless_backend);
+        comp->headless_backend = NULL;
+        return -1;
+    }
+
+    return 0;
+}
+
+WhaleOutput* wh_output_add_virtual(
+    WhaleCompositor* comp, s32 width, s32 height, s32 refresh
+)
+{
+    if (!comp->headless_backend)
+        return NULL;
+
+    /* Announced right away, wh_output_on_new_output() sets it up */
+    struct wlr_output* wlr_output =
+        wlr_headless_add_output(comp->headless_backend, width, height);
+    if (!wlr_output)
+    {
+        wh_log(ERR, "output: Failed to create a virtual output");
+        return NULL;
+    }
+
+    WhaleOutput* output = wlr_output->data;
+    if (!output)
+    {
+        wlr_output_destroy(wlr_output);
+        return NULL;
+    }
+
+    output->is_virtual = true;
+    output->virtual_width = width;
+    output->virtual_height = height;
+    output->virtual_refresh = refresh;
+    wh_output_configure(output);
+    wh_ipc_output_changed(comp, output);
+
+    wh_log(INFO, "output: virtual %s", wlr_output->name);
+    return output;
+}
+
+int wh_output_remove_virtual(WhaleCompositor* comp, const char* name)
+{
+    WhaleOutput* output;
+    wl_list_for_each(output, &comp->outputs, link)
+    {
+        struct wlr_output* wlr_output = output->wlr_output;
+        if (strcmp(wlr_output->name, name) != 0)
+            continue;
+
+        /* Only outputs that exist in nothing but whale */
+        if (!wlr_output_is_headless(wlr_output))
+            return -1;
+
+        wh_log(INFO, "output: remove virtual %s", name);
+        wlr_output_destroy(wlr_output);
+        return 0;
+    }
+
+    return -1;
 }
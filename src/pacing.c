@@ -0,0 +1,762 @@
+#define _POSIX_C_SOURCE 199309L
+#define WLR_USE_UNSTABLE
+#include <commit-timing-v1-protocol.h>
+#include <fifo-v1-protocol.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <wayland-server-core.h>
+#include <whale/compositor.h>
+#include <whale/log.h>
+#include <whale/pacing.h>
+#include <whale/types.h>
+#include <wlr/types/wlr_compositor.h>
+#include <wlr/types/wlr_output.h>
+#include <wlr/types/wlr_presentation_time.h>
+#include <wlr/types/wlr_scene.h>
+#include <wlr/util/addon.h>
+
+/* Surfaces on no output get their barriers cleared at this rate, hidden
+clients are slowed down, not stalled */
+#define WH_PACING_HIDDEN_MS 100
+/* Far targets are checked again after this long */
+#define WH_PACING_MAX_SLEEP_MS 1000
+/* Outputs that don't report a refresh rate */
+#define WH_PACING_DEFAULT_PERIOD_NS (1000000000ull / 60)
+
+/* Constraints of one commit, double-buffered with the surface state */
+typedef struct
+{
+    bool set_barrier;
+    bool wait_barrier;
+    bool has_target;
+    /* CLOCK_MONOTONIC ns it may be presented at the earliest */
+    u64 target_ns;
+} WhalePacingState;
+
+typedef struct
+{
+    /* Of wlr_surface_lock_pending() */
+    u32 seq;
+    WhalePacingState state;
+} WhaleHeldCommit;
+
+typedef struct
+{
+    WhaleCompositor* comp;
+    struct wlr_surface* surface;
+    struct wlr_addon addon;
+
+    struct wlr_surface_synced synced;
+    WhalePacingState pending;
+    WhalePacingState current;
+
+    /* Set by applying a set_barrier commit, cleared once it was latched */
+    bool barrier;
+
+    struct wl_resource* fifo;
+    struct wl_resource* timer;
+
+    /* WhaleHeldCommit, oldest first. wlroots keeps every later commit
+    cached behind a held one, so they are applied in order. */
+    struct wl_array held;
+
+    struct wl_listener client_commit;
+    struct wl_listener commit;
+
+    /* WhalePacing::surfaces */
+    struct wl_list link;
+    /* WhalePacingFrame::ready */
+    struct wl_list ready_link;
+} WhalePacedSurface;
+
+typedef struct
+{
+    WhaleCompositor* comp;
+    struct wlr_scene_output* scene_output;
+    u64 now_ns;
+    /* When what is committed now is expected on screen */
+    u64 present_ns;
+    /* WhalePacedSurface with commits to release once the scene walk is
+    over, applying them may change the scene */
+    struct wl_list ready;
+} WhalePacingFrame;
+
+static u64 wh_pacing_ns(const struct timespec* ts)
+{
+    return (u64)ts->tv_sec * 1000000000 + ts->tv_nsec;
+}
+
+static u64 wh_pacing_now_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return wh_pacing_ns(&now);
+}
+
+static u64 wh_pacing_period_ns(const struct wlr_output* output)
+{
+    return output->refresh > 0 ? 1000000000000ull / output->refresh
+                               : WH_PACING_DEFAULT_PERIOD_NS;
+}
+
+/* Refresh period of the fastest enabled output the surface is on, 0 if it
+is on none. */
+static u64 wh_pacing_surface_period_ns(struct wlr_surface* surface)
+{
+    u64 period = 0;
+    struct wlr_surface_output* surface_output;
+    wl_list_for_each(surface_output, &surface->current_outputs, link)
+    {
+        struct wlr_output* output = surface_output->output;
+        if (!output->enabled)
+            continue;
+
+        u64 output_period = wh_pacing_period_ns(output);
+        if (!period || output_period < period)
+            period = output_period;
+    }
+
+    return period;
+}
+
+static void wh_pacing_arm(WhalePacing* pacing, u64 now_ns, u64 deadline_ns)
+{
+    if (pacing->timer_armed && pacing->timer_deadline_ns <= deadline_ns)
+        return;
+
+    u64 ms =
+        deadline_ns > now_ns ? (deadline_ns - now_ns + 999999) / 1000000 : 1;
+    if (ms > WH_PACING_MAX_SLEEP_MS)
+        ms = WH_PACING_MAX_SLEEP_MS;
+
+    wl_event_source_timer_update(pacing->timer, ms);
+    pacing->timer_armed = true;
+    pacing->timer_deadline_ns = deadline_ns;
+}
+
+static bool wh_pacing_ready(
+    const WhalePacedSurface* paced,
+    const WhalePacingState* state,
+    u64 present_ns
+)
+{
+    if (state->wait_barrier && paced->barrier)
+        return false;
+
+    return !state->has_target || state->target_ns <= present_ns;
+}
+
+static void wh_pacing_clear_barrier(WhalePacedSurface* paced)
+{
+    if (!paced->barrier)
+        return;
+
+    paced->barrier = false;
+    paced->comp->pacing.barriers--;
+}
+
+/* Make sure something releases the oldest held commit: frames of the
+surface's outputs once its barrier is gone or its target is a refresh
+away, the timer before that or if it is on no output. */
+static void wh_pacing_schedule(WhalePacedSurface* paced, u64 now_ns)
+{
+    if (!paced->held.size)
+        return;
+
+    WhalePacing* pacing = &paced->comp->pacing;
+    const WhaleHeldCommit* head = paced->held.data;
+    bool barrier = head->state.wait_barrier && paced->barrier;
+    u64 target = head->state.has_target ? head->state.target_ns : 0;
+
+    u64 period = wh_pacing_surface_period_ns(paced->surface);
+    if (!period)
+    {
+        u64 deadline = target;
+        if (barrier && deadline < now_ns + WH_PACING_HIDDEN_MS * 1000000)
+            deadline = now_ns + WH_PACING_HIDDEN_MS * 1000000;
+
+        wh_pacing_arm(pacing, now_ns, deadline);
+        return;
+    }
+
+    /* A frame clears the barrier even if nothing on screen changes */
+    if (!barrier && target > now_ns + period)
+    {
+        wh_pacing_arm(pacing, now_ns, target - period);
+        return;
+    }
+
+    struct wlr_surface_output* surface_output;
+    wl_list_for_each(surface_output, &paced->surface->current_outputs, link)
+    {
+        if (surface_output->output->enabled)
+            wlr_output_schedule_frame(surface_output->output);
+    }
+}
+
+/* Apply the held commits that are ready, in order. Applying one may set
+the barrier the next one waits for. */
+static void wh_pacing_release(WhalePacedSurface* paced, u64 present_ns)
+{
+    WhaleHeldCommit* held = paced->held.data;
+    size_t count = paced->held.size / sizeof(WhaleHeldCommit);
+
+    size_t done = 0;
+    while (done < count &&
+           wh_pacing_ready(paced, &held[done].state, present_ns))
+        wlr_surface_unlock_cached(paced->surface, held[done++].seq);
+
+    if (!done)
+        return;
+
+    memmove(held, held + done, (count - done) * sizeof(WhaleHeldCommit));
+    paced->held.size -= done * sizeof(WhaleHeldCommit);
+    paced->comp->pacing.held -= done;
+}
+
+static void wh_pacing_state_move(void* dst, void* src)
+{
+    memcpy(dst, src, sizeof(WhalePacingState));
+    memset(src, 0, sizeof(WhalePacingState));
+}
+
+static const struct wlr_surface_synced_impl synced_impl = {
+    .state_size = sizeof(WhalePacingState),
+    .move_state = wh_pacing_state_move,
+};
+
+static void on_client_commit(struct wl_listener* listener, void*)
+{
+    WhalePacedSurface* paced =
+        wl_container_of(listener, paced, client_commit);
+    const WhalePacingState* state = &paced->pending;
+
+    if (!state->wait_barrier && !state->has_target)
+        return;
+
+    /* Nothing is known of the next refresh yet, targets are held until
+    they passed or a frame is close enough to them. Later commits queue up
+    behind held ones. */
+    u64 now_ns = wh_pacing_now_ns();
+    if (!paced->held.size && wh_pacing_ready(paced, state, now_ns))
+        return;
+
+    WhaleHeldCommit* held = wl_array_add(&paced->held, sizeof(*held));
+    if (!held)
+    {
+        wh_log(ERR, "pacing: Failed to hold a commit, applying it now");
+        return;
+    }
+
+    held->seq = wlr_surface_lock_pending(paced->surface);
+    held->state = *state;
+    paced->comp->pacing.held++;
+
+    wh_pacing_schedule(paced, now_ns);
+}
+
+static void on_commit(struct wl_listener* listener, void*)
+{
+    WhalePacedSurface* paced = wl_container_of(listener, paced, commit);
+
+    if (paced->current.set_barrier && !paced->barrier)
+    {
+        paced->barrier = true;
+        paced->comp->pacing.barriers++;
+    }
+}
+
+static void wh_pacing_addon_destroy(struct wlr_addon* addon)
+{
+    WhalePacedSurface* paced = wl_container_of(addon, paced, addon);
+    WhalePacing* pacing = &paced->comp->pacing;
+
+    /* wlroots drops the held commits with the surface */
+    pacing->held -= paced->held.size / sizeof(WhaleHeldCommit);
+    wh_pacing_clear_barrier(paced);
+
+    if (paced->fifo)
+        wl_resource_set_user_data(paced->fifo, NULL);
+    if (paced->timer)
+        wl_resource_set_user_data(paced->timer, NULL);
+
+    UNLISTEN(&paced->client_commit);
+    UNLISTEN(&paced->commit);
+
+    wlr_surface_synced_finish(&paced->synced);
+    wlr_addon_finish(&paced->addon);
+    wl_array_release(&paced->held);
+    wl_list_remove(&paced->link);
+    wl_list_remove(&paced->ready_link);
+    free(paced);
+}
+
+static const struct wlr_addon_interface addon_impl = {
+    .name = "whale_paced_surface",
+    .destroy = wh_pacing_addon_destroy,
+};
+
+static WhalePacedSurface*
+wh_pacing_surface_get(WhaleCompositor* comp, struct wlr_surface* surface)
+{
+    struct wlr_addon* addon =
+        wlr_addon_find(&surface->addons, &comp->pacing, &addon_impl);
+    if (addon)
+    {
+        WhalePacedSurface* paced = wl_container_of(addon, paced, addon);
+        return paced;
+    }
+
+    WhalePacedSurface* paced = calloc(1, sizeof(WhalePacedSurface));
+    if (!paced)
+        return NULL;
+
+    if (!wlr_surface_synced_init(
+            &paced->synced,
+            surface,
+            &synced_impl,
+            &paced->pending,
+            &paced->current
+        ))
+    {
+        free(paced);
+        return NULL;
+    }
+
+    paced->comp = comp;
+    paced->surface = surface;
+    wl_array_init(&paced->held);
+    wlr_addon_init(&paced->addon, &surface->addons, &comp->pacing, &addon_impl);
+
+    LISTEN(
+        &surface->events.client_commit,
+        &paced->client_commit,
+        on_client_commit
+    );
+    LISTEN(&surface->events.commit, &paced->commit, on_commit);
+
+    wl_list_insert(&comp->pacing.surfaces, &paced->link);
+    wl_list_init(&paced->ready_link);
+    return paced;
+}
+
+static WhalePacedSurface* wh_pacing_surface_from_buffer(
+    WhaleCompositor* comp,
+    struct wlr_scene_buffer* buffer,
+    struct wlr_scene_output* scene_output
+)
+{
+    /* Surfaces spanning outputs are paced by one of them */
+    if (buffer->primary_output != scene_output)
+        return NULL;
+
+    struct wlr_scene_surface* scene_surface =
+        wlr_scene_surface_try_from_buffer(buffer);
+    if (!scene_surface)
+        return NULL;
+
+    struct wlr_addon* addon = wlr_addon_find(
+        &scene_surface->surface->addons, &comp->pacing, &addon_impl
+    );
+    if (!addon)
+        return NULL;
+
+    WhalePacedSurface* paced = wl_container_of(addon, paced, addon);
+    return paced;
+}
+
+static void
+wh_pacing_frame_iter(struct wlr_scene_buffer* buffer, int, int, void* data)
+{
+    WhalePacingFrame* frame = data;
+    WhalePacedSurface* paced =
+        wh_pacing_surface_from_buffer(frame->comp, buffer, frame->scene_output);
+    if (!paced || !paced->held.size)
+        return;
+
+    /* Buffers shown twice on the output are listed once */
+    wl_list_remove(&paced->ready_link);
+    wl_list_insert(frame->ready.prev, &paced->ready_link);
+}
+
+static void
+wh_pacing_latched_iter(struct wlr_scene_buffer* buffer, int, int, void* data)
+{
+    WhalePacingFrame* frame = data;
+    WhalePacedSurface* paced =
+        wh_pacing_surface_from_buffer(frame->comp, buffer, frame->scene_output);
+    if (!paced || !paced->barrier)
+        return;
+
+    wh_pacing_clear_barrier(paced);
+    wh_pacing_schedule(paced, frame->now_ns);
+}
+
+void wh_pacing_output_frame(
+    WhaleCompositor* comp,
+    struct wlr_scene_output* scene_output,
+    const struct timespec* now
+)
+{
+    if (!comp->pacing.held)
+        return;
+
+    /* The frame event comes right after a refresh, what is committed now
+    is shown on the next one */
+    u64 now_ns = wh_pacing_ns(now);
+    WhalePacingFrame frame = {
+        .comp = comp,
+        .scene_output = scene_output,
+        .now_ns = now_ns,
+        .present_ns = now_ns + wh_pacing_period_ns(scene_output->output),
+    };
+
+    wl_list_init(&frame.ready);
+    wlr_scene_output_for_each_buffer(
+        scene_output, wh_pacing_frame_iter, &frame
+    );
+
+    /* Popped one at a time, a surface destroyed by another's commit
+    handlers leaves the list on its own. */
+    while (!wl_list_empty(&frame.ready))
+    {
+        WhalePacedSurface* paced =
+            wl_container_of(frame.ready.next, paced, ready_link);
+        wl_list_remove(&paced->ready_link);
+        wl_list_init(&paced->ready_link);
+
+        wh_pacing_release(paced, frame.present_ns);
+        wh_pacing_schedule(paced, now_ns);
+    }
+}
+
+void wh_pacing_output_latched(
+    WhaleCompositor* comp, struct wlr_scene_output* scene_output
+)
+{
+    if (!comp->pacing.barriers)
+        return;
+
+    WhalePacingFrame frame = {
+        .comp = comp,
+        .scene_output = scene_output,
+        .now_ns = wh_pacing_now_ns(),
+    };
+
+    wlr_scene_output_for_each_buffer(
+        scene_output, wh_pacing_latched_iter, &frame
+    );
+}
+
+static int wh_pacing_on_timer(void* data)
+{
+    WhaleCompositor* comp = data;
+    WhalePacing* pacing = &comp->pacing;
+    pacing->timer_armed = false;
+
+    u64 now_ns = wh_pacing_now_ns();
+    WhalePacedSurface* paced;
+    wl_list_for_each(paced, &pacing->surfaces, link)
+    {
+        if (!paced->held.size)
+            continue;
+
+        /* Shown surfaces are released by their outputs' frames */
+        if (!wh_pacing_surface_period_ns(paced->surface))
+        {
+            wh_pacing_clear_barrier(paced);
+            wh_pacing_release(paced, now_ns);
+        }
+
+        wh_pacing_schedule(paced, now_ns);
+    }
+
+    return 0;
+}
+
+static void wh_pacing_handle_destroy(struct wl_client*, struct wl_resource* res)
+{
+    wl_resource_destroy(res);
+}
+
+static void
+wh_pacing_fifo_set_barrier(struct wl_client*, struct wl_resource* res)
+{
+    WhalePacedSurface* paced = wl_resource_get_user_data(res);
+    if (!paced)
+    {
+        wl_resource_post_error(
+            res, WP_FIFO_V1_ERROR_SURFACE_DESTROYED, "surface destroyed"
+        );
+        return;
+    }
+
+    paced->pending.set_barrier = true;
+}
+
+static void
+wh_pacing_fifo_wait_barrier(struct wl_client*, struct wl_resource* res)
+{
+    WhalePacedSurface* paced = wl_resource_get_user_data(res);
+    if (!paced)
+    {
+        wl_resource_post_error(
+            res, WP_FIFO_V1_ERROR_SURFACE_DESTROYED, "surface destroyed"
+        );
+        return;
+    }
+
+    paced->pending.wait_barrier = true;
+}
+
+static const struct wp_fifo_v1_interface fifo_impl = {
+    .set_barrier = wh_pacing_fifo_set_barrier,
+    .wait_barrier = wh_pacing_fifo_wait_barrier,
+    .destroy = wh_pacing_handle_destroy,
+};
+
+static void wh_pacing_fifo_destroy(struct wl_resource* res)
+{
+    WhalePacedSurface* paced = wl_resource_get_user_data(res);
+    if (paced)
+        paced->fifo = NULL;
+}
+
+static void wh_pacing_get_fifo(
+    struct wl_client* client,
+    struct wl_resource* res,
+    u32 id,
+    struct wl_resource* surface_res
+)
+{
+    WhaleCompositor* comp = wl_resource_get_user_data(res);
+    struct wlr_surface* surface = wlr_surface_from_resource(surface_res);
+
+    WhalePacedSurface* paced = wh_pacing_surface_get(comp, surface);
+    if (!paced)
+    {
+        wl_client_post_no_memory(client);
+        return;
+    }
+
+    if (paced->fifo)
+    {
+        wl_resource_post_error(
+            res,
+            WP_FIFO_MANAGER_V1_ERROR_ALREADY_EXISTS,
+            "surface already has a fifo"
+        );
+        return;
+    }
+
+    paced->fifo = wl_resource_create(
+        client, &wp_fifo_v1_interface, wl_resource_get_version(res), id
+    );
+    if (!paced->fifo)
+    {
+        wl_client_post_no_memory(client);
+        return;
+    }
+
+    wl_resource_set_implementation(
+        paced->fifo, &fifo_impl, paced, wh_pacing_fifo_destroy
+    );
+}
+
+static const struct wp_fifo_manager_v1_interface fifo_manager_impl = {
+    .destroy = wh_pacing_handle_destroy,
+    .get_fifo = wh_pacing_get_fifo,
+};
+
+static void wh_pacing_bind_fifo_manager(
+    struct wl_client* client, void* data, u32 version, u32 id
+)
+{
+    struct wl_resource* res =
+        wl_resource_create(client, &wp_fifo_manager_v1_interface, version, id);
+    if (!res)
+    {
+        wl_client_post_no_memory(client);
+        return;
+    }
+
+    wl_resource_set_implementation(res, &fifo_manager_impl, data, NULL);
+}
+
+static void wh_pacing_set_timestamp(
+    struct wl_client*,
+    struct wl_resource* res,
+    u32 tv_sec_hi,
+    u32 tv_sec_lo,
+    u32 tv_nsec
+)
+{
+    WhalePacedSurface* paced = wl_resource_get_user_data(res);
+    if (!paced)
+    {
+        wl_resource_post_error(
+            res,
+            WP_COMMIT_TIMER_V1_ERROR_SURFACE_DESTROYED,
+            "surface destroyed"
+        );
+        return;
+    }
+
+    if (tv_nsec >= 1000000000)
+    {
+        wl_resource_post_error(
+            res,
+            WP_COMMIT_TIMER_V1_ERROR_INVALID_TIMESTAMP,
+            "tv_nsec out of range"
+        );
+        return;
+    }
+
+    if (paced->pending.has_target)
+    {
+        wl_resource_post_error(
+            res,
+            WP_COMMIT_TIMER_V1_ERROR_TIMESTAMP_EXISTS,
+            "timestamp already set for this commit"
+        );
+        return;
+    }
+
+    /* Times past what fits in 64 bits of ns are never reached anyway */
+    u64 sec = (u64)tv_sec_hi << 32 | tv_sec_lo;
+    paced->pending.has_target = true;
+    paced->pending.target_ns = sec < UINT64_MAX / 1000000000 - 1
+                                   ? sec * 1000000000 + tv_nsec
+                                   : UINT64_MAX;
+}
+
+static const struct wp_commit_timer_v1_interface timer_impl = {
+    .set_timestamp = wh_pacing_set_timestamp,
+    .destroy = wh_pacing_handle_destroy,
+};
+
+static void wh_pacing_timer_destroy(struct wl_resource* res)
+{
+    WhalePacedSurface* paced = wl_resource_get_user_data(res);
+    if (paced)
+        paced->timer = NULL;
+}
+
+static void wh_pacing_get_timer(
+    struct wl_client* client,
+    struct wl_resource* res,
+    u32 id,
+    struct wl_resource* surface_res
+)
+{
+    WhaleCompositor* comp = wl_resource_get_user_data(res);
+    struct wlr_surface* surface = wlr_surface_from_resource(surface_res);
+
+    WhalePacedSurface* paced = wh_pacing_surface_get(comp, surface);
+    if (!paced)
+    {
+        wl_client_post_no_memory(client);
+        return;
+    }
+
+    if (paced->timer)
+    {
+        wl_resource_post_error(
+            res,
+            WP_COMMIT_TIMING_MANAGER_V1_ERROR_COMMIT_TIMER_EXISTS,
+            "surface already has a commit timer"
+        );
+        return;
+    }
+
+    paced->timer = wl_resource_create(
+        client, &wp_commit_timer_v1_interface, wl_resource_get_version(res), id
+    );
+    if (!paced->timer)
+    {
+        wl_client_post_no_memory(client);
+        return;
+    }
+
+    wl_resource_set_implementation(
+        paced->timer, &timer_impl, paced, wh_pacing_timer_destroy
+    );
+}
+
+static const struct wp_commit_timing_manager_v1_interface
+    commit_timing_manager_impl = {
+        .destroy = wh_pacing_handle_destroy,
+        .get_timer = wh_pacing_get_timer,
+};
+
+static void wh_pacing_bind_commit_timing_manager(
+    struct wl_client* client, void* data, u32 version, u32 id
+)
+{
+    struct wl_resource* res = wl_resource_create(
+        client, &wp_commit_timing_manager_v1_interface, version, id
+    );
+    if (!res)
+    {
+        wl_client_post_no_memory(client);
+        return;
+    }
+
+    wl_resource_set_implementation(
+        res, &commit_timing_manager_impl, data, NULL
+    );
+}
+
+int wh_pacing_init(WhaleCompositor* comp)
+{
+    WhalePacing* pacing = &comp->pacing;
+    wl_list_init(&pacing->surfaces);
+
+    /* Target times are on its clock, CLOCK_MONOTONIC */
+    if (!wlr_presentation_create(comp->display, comp->backend, 2))
+    {
+        wh_log(ERR, "pacing: Failed to create wp_presentation");
+        return -1;
+    }
+
+    pacing->timer = wl_event_loop_add_timer(
+        wl_display_get_event_loop(comp->display), wh_pacing_on_timer, comp
+    );
+    if (!pacing->timer)
+    {
+        wh_log(ERR, "pacing: Failed to create the timer");
+        return -1;
+    }
+
+    pacing->fifo_manager = wl_global_create(
+        comp->display,
+        &wp_fifo_manager_v1_interface,
+        1,
+        comp,
+        wh_pacing_bind_fifo_manager
+    );
+    pacing->commit_timing_manager = wl_global_create(
+        comp->display,
+        &wp_commit_timing_manager_v1_interface,
+        1,
+        comp,
+        wh_pacing_bind_commit_timing_manager
+    );
+    if (!pacing->fifo_manager || !pacing->commit_timing_manager)
+    {
+        wh_log(ERR, "pacing: Failed to create the globals");
+        return -1;
+    }
+
+    return 0;
+}
+
+void wh_pacing_finish(WhaleCompositor* comp)
+{
+    WhalePacing* pacing = &comp->pacing;
+
+    if (pacing->timer)
+        wl_event_source_remove(pacing->timer);
+    pacing->timer = NULL;
+}
@@ -0,0 +1,186 @@
+#define WLR_USE_UNSTABLE
+#include <stdlib.h>
+#include <string.h>
+#include <whale/client.h>
+#include <whale/compositor.h>
+#include <whale/decoration.h>
+#include <whale/idle.h>
+#include <whale/input.h>
+#include <whale/ipc.h>
+#include <whale/log.h>
+#include <whale/seat.h>
+#include <whale/throttle.h>
+#include <whale/types.h>
+#ifdef WH_XWAYLAND
+#include <whale/xwayland.h>
+#endif
+#include <wlr/types/wlr_seat.h>
+
+static const char* wh_seat_device_seat_name(
+    const WhaleCompositor* comp, const struct wlr_input_device* dev
+)
+{
+    const WhaleConfig* config = &comp->config.current;
+    for (size_t i = 0; dev->name && i < config->num_seats; i++)
+    {
+        if (strcmp(config->seats[i].device, dev->name) == 0)
+            return config->seats[i].seat;
+    }
+
+    return WH_SEAT_DEFAULT;
+}
+
+static void on_focus_change(struct wl_listener* listener, void* data)
+{
+    WhaleSeat* seat = wl_container_of(listener, seat, listeners.focus_change);
+    struct wlr_seat_keyboard_focus_change_event* ev = data;
+
+    wh_throttle_focus_changed(seat->comp, ev->old_surface, ev->new_surface);
+
+    WhaleClient* old =
+        ev->old_surface ? wh_client_from_surface(ev->old_surface) : NULL;
+    WhaleClient* new =
+        ev->new_surface ? wh_client_from_surface(ev->new_surface) : NULL;
+
+    wh_ipc_focus_changed(seat->comp, new);
+
+    if (old == new)
+        return;
+
+    /* Clients stay focused while any seat has them focused */
+    if (old && old->focus_count)
+        old->focus_count--;
+    if (new)
+        new->focus_count++;
+
+    if (old)
+        wh_decoration_update(old);
+    if (new)
+        wh_decoration_update(new);
+
+#ifdef WH_XWAYLAND
+    wh_xwayland_focus_changed(old, new);
+#endif
+}
+
+WhaleSeat* wh_seat_create(WhaleCompositor* comp, const char* name)
+{
+    WhaleSeat* seat = calloc(1, sizeof(WhaleSeat));
+    if (!seat)
+    {
+        wh_log(ERR, "seat: Failed to allocate seat %s", name);
+        return NULL;
+    }
+
+    seat->comp = comp;
+    wl_list_init(&seat->keyboard_groups);
+    wl_list_init(&seat->keyboards);
+
+    seat->wlr_seat = wlr_seat_create(comp->display, name);
+    if (!seat->wlr_seat)
+    {
+        wh_log(ERR, "seat: Failed to create seat %s", name);
+        free(seat);
+        return NULL;
+    }
+
+    seat->wlr_seat->data = seat;
+
+    if (wh_input_seat_init(seat) < 0)
+    {
+        wlr_seat_destroy(seat->wlr_seat);
+        free(seat);
+        return NULL;
+    }
+
+    LISTEN(
+        &seat->wlr_seat->keyboard_state.events.focus_change,
+        &seat->listeners.focus_change,
+        on_focus_change
+    );
+
+    wl_list_insert(comp->seats.prev, &seat->link);
+    wh_log(INFO, "seat: %s", name);
+
+    return seat;
+}
+
+WhaleSeat*
+wh_seat_for_device(WhaleCompositor* comp, const struct wlr_input_device* dev)
+{
+    const char* name = wh_seat_device_seat_name(comp, dev);
+
+    /* Only done when a device is plugged in, there are a handful of seats */
+    WhaleSeat* seat;
+    wl_list_for_each(seat, &comp->seats, link)
+    {
+        if (strcmp(seat->wlr_seat->name, name) == 0)
+            return seat;
+    }
+
+    return wh_seat_create(comp, name);
+}
+
+WhaleSeat* wh_seat_from_wlr_seat(const struct wlr_seat* wlr_seat)
+{
+    return wlr_seat->data;
+}
+
+void wh_seat_activity(WhaleSeat* seat)
+{
+    seat->comp->active_seat = seat;
+    wh_idle_activity(seat->comp, seat->wlr_seat);
+}
+
+/* floor() without libm, layout coords can be negative */
+static int wh_seat_pixel(double coord)
+{
+    int pixel = (int)coord;
+    return pixel > coord ? pixel - 1 : pixel;
+}
+
+WhaleClient* wh_seat_client_at(
+    WhaleSeat* seat,
+    double x,
+    double y,
+    struct wlr_surface** surface,
+    double* sx,
+    double* sy
+)
+{
+    WhaleHitCache* hit = &seat->hit;
+    int px = wh_seat_pixel(x);
+    int py = wh_seat_pixel(y);
+
+    /* Surfaces sit at whole layout pixels and input regions are made of
+    whole surface pixels, every point of a pixel hits the same surface. */
+    if (!hit->valid || hit->scene_serial != seat->comp->scene_serial ||
+        hit->x != px || hit->y != py)
+    {
+        struct wlr_surface* surf = NULL;
+        double surf_x = 0;
+        double surf_y = 0;
+        WhaleClient* client =
+            wh_client_surface_at(x, y, seat->comp, &surf, &surf_x, &surf_y);
+
+        *hit = (WhaleHitCache){
+            .valid = true,
+            .scene_serial = seat->comp->scene_serial,
+            .x = px,
+            .y = py,
+            .client = client,
+            .surface = client ? surf : NULL,
+            .surface_x = x - surf_x,
+            .surface_y = y - surf_y,
+        };
+    }
+
+    if (surface)
+        *surface = hit->surface;
+    if (sx)
+        *sx = x - hit->surface_x;
+    if (sy)
+        *sy = y - hit->surface_y;
+
+    return hit->client;
+}
@@ -0,0 +1,303 @@
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <wayland-server-core.h>
+#include <whale/compositor.h>
+#include <whale/log.h>
+#include <whale/spawn.h>
+#include <whale/types.h>
+
+extern char** environ;
+
+/* A spawned process that was not reaped yet. */
+typedef struct
+{
+    WhaleCompositor* comp;
+    pid_t pid;
+
+    /* -1 if the child is reaped on SIGCHLD instead */
+    int pidfd;
+    struct wl_event_source* source;
+
+    struct wl_list link;
+} WhaleChild;
+
+static int wh_spawn_pidfd_open(pid_t pid)
+{
+#ifdef SYS_pidfd_open
+    return syscall(SYS_pidfd_open, pid, 0);
+#else
+    (void)pid;
+    return -1;
+#endif
+}
+
+static void wh_spawn_child_destroy(WhaleChild* child)
+{
+    if (child->source)
+        wl_event_source_remove(child->source);
+    if (child->pidfd >= 0)
+        close(child->pidfd);
+
+    wl_list_remove(&child->link);
+    free(child);
+}
+
+/**
+ * Reap the child if it exited.
+ *
+ * @returns true if the child was reaped.
+ */
+static bool wh_spawn_child_reap(WhaleChild* child)
+{
+    int status;
+    pid_t pid = waitpid(child->pid, &status, WNOHANG);
+    if (pid == 0)
+        return false;
+
+    if (pid > 0 && WIFEXITED(status))
+        wh_log(
+            DEBUG,
+            "spawn: %d exited with status %d",
+            child->pid,
+            WEXITSTATUS(status)
+        );
+    else if (pid > 0 && WIFSIGNALED(status))
+        wh_log(
+            DEBUG, "spawn: %d killed by signal %d", child->pid, WTERMSIG(status)
+        );
+
+    wh_spawn_child_destroy(child);
+    return true;
+}
+
+/* Reap the children that have no pidfd watched, in case their SIGCHLD was
+lost (sent before it was blocked, or to a thread not blocking it). */
+static void wh_spawn_reap_unwatched(WhaleCompositor* comp)
+{
+    WhaleChild* child;
+    WhaleChild* tmp;
+    wl_list_for_each_safe(child, tmp, &comp->children, link)
+    {
+        if (!child->source)
+            wh_spawn_child_reap(child);
+    }
+}
+
+static int on_child_pidfd(int, u32, void* data)
+{
+    WhaleChild* child = data;
+    WhaleCompositor* comp = child->comp;
+
+    wh_spawn_child_reap(child);
+    wh_spawn_reap_unwatched(comp);
+    return 0;
+}
+
+static int on_sigchld(int, void* data)
+{
+    WhaleCompositor* comp = data;
+
+    /* Signals coalesce, any number of children may have exited. Only wait
+    for our own children, wlroots waits for the ones it spawns itself. */
+    WhaleChild* child;
+    WhaleChild* tmp;
+    wl_list_for_each_safe(child, tmp, &comp->children, link)
+        wh_spawn_child_reap(child);
+
+    return 0;
+}
+
+/* Blocks SIGCHLD and reads it from a signalfd, for children without a
+pidfd. */
+static int wh_spawn_watch_sigchld(WhaleCompositor* comp)
+{
+    if (comp->sigchld_source)
+        return 0;
+
+    comp->sigchld_source = wl_event_loop_add_signal(
+        wl_display_get_event_loop(comp->display), SIGCHLD, on_sigchld, comp
+    );
+    if (!comp->sigchld_source)
+    {
+        wh_log(ERR, "spawn: Failed to watch SIGCHLD");
+        return -1;
+    }
+
+    return 0;
+}
+
+int wh_spawn_init(WhaleCompositor* comp)
+{
+    wl_list_init(&comp->children);
+
+    /* Prefer a pidfd per child, it doesn't need SIGCHLD blocked in the
+    compositor (and every thread it starts). */
+    int pidfd = wh_spawn_pidfd_open(getpid());
+    if (pidfd >= 0)
+    {
+        close(pidfd);
+        return 0;
+    }
+
+    wh_log(INFO, "spawn: No pidfd support, reaping children on SIGCHLD");
+    return wh_spawn_watch_sigchld(comp);
+}
+
+/**
+ * Build the child's environment from ours with `env` applied on top.
+ *
+ * @returns A NULL terminated array to free() (the strings are borrowed).
+ */
+static char** wh_spawn_build_env(const char* const* env)
+{
+    size_t num_environ = 0;
+    while (environ[num_environ])
+        num_environ++;
+
+    size_t num_env = 0;
+    while (env && env[num_env])
+        num_env++;
+
+    char** envp = calloc(num_environ + num_env + 1, sizeof(char*));
+    if (!envp)
+        return NULL;
+
+    size_t n = 0;
+    for (size_t i = 0; i < num_environ; i++)
+    {
+        /* Skip variables overridden by `env` */
+        const char* eq = strchr(environ[i], '=');
+        size_t name_len = eq ? (size_t)(eq - environ[i]) : strlen(environ[i]);
+
+        bool overridden = false;
+        for (size_t j = 0; j < num_env && !overridden; j++)
+            overridden = strncmp(env[j], environ[i], name_len) == 0 &&
+                         env[j][name_len] == '=';
+
+        if (!overridden)
+            envp[n++] = environ[i];
+    }
+
+    for (size_t i = 0; i < num_env; i++)
+        envp[n++] = (char*)env[i];
+
+    return envp;
+}
+
+pid_t wh_spawn(
+    WhaleCompositor* comp, const char* const* argv, const char* const* env
+)
+{
+    WhaleChild* child = calloc(1, sizeof(WhaleChild));
+    char** envp = env ? wh_spawn_build_env(env) : environ;
+    if (!child || !envp)
+    {
+        free(child);
+        wh_log(ERR, "spawn: Failed to spawn %s", argv[0]);
+        return -1;
+    }
+
+    posix_spawnattr_t attr;
+    posix_spawnattr_init(&attr);
+
+    /* Our signal mask and handlers (SIGCHLD is blocked for the signalfd)
+    must not leak into the child. */
+    sigset_t set;
+    sigemptyset(&set);
+    posix_spawnattr_setsigmask(&attr, &set);
+    sigfillset(&set);
+    posix_spawnattr_setsigdefault(&attr, &set);
+
+    short flags = POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF;
+#ifdef POSIX_SPAWN_SETSID
+    /* Don't take the child down with the compositor's session. */
+    flags |= POSIX_SPAWN_SETSID;
+#endif
+    posix_spawnattr_setflags(&attr, flags);
+
+    /* The child doesn't get the compositor's stdio. */
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(
+        &actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0
+    );
+    posix_spawn_file_actions_addopen(
+        &actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0
+    );
+    posix_spawn_file_actions_adddup2(&actions, STDOUT_FILENO, STDERR_FILENO);
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 34)
+    /* Nor any descriptor that missed O_CLOEXEC. */
+    posix_spawn_file_actions_addclosefrom_np(&actions, STDERR_FILENO + 1);
+#endif
+
+    /* posix_spawn uses vfork semantics (CLONE_VM | CLONE_VFORK), so the
+    compositor's page tables are never copied. */
+    pid_t pid;
+    int err = posix_spawnp(
+        &pid, argv[0], &actions, &attr, (char* const*)argv, envp
+    );
+
+    posix_spawn_file_actions_destroy(&actions);
+    posix_spawnattr_destroy(&attr);
+    if (envp != environ)
+        free(envp);
+
+    if (err != 0)
+    {
+        wh_log(ERR, "spawn: Failed to spawn %s: %s", argv[0], strerror(err));
+        free(child);
+        return -1;
+    }
+
+    child->comp = comp;
+    child->pid = pid;
+    child->pidfd = wh_spawn_pidfd_open(pid);
+    wl_list_insert(&comp->children, &child->link);
+
+    if (child->pidfd >= 0)
+    {
+        child->source = wl_event_loop_add_fd(
+            wl_display_get_event_loop(comp->display),
+            child->pidfd,
+            WL_EVENT_READABLE,
+            on_child_pidfd,
+            child
+        );
+    }
+
+    wh_log(DEBUG, "spawn: %s (%d)", argv[0], pid);
+
+    /* Out of descriptors or memory for this one, SIGCHLD reaps it instead.
+    Any earlier child in the same situation is swept on every spawn. */
+    if (!child->source)
+    {
+        if (child->pidfd >= 0)
+            close(child->pidfd);
+        child->pidfd = -1;
+
+        wh_spawn_watch_sigchld(comp);
+    }
+    wh_spawn_reap_unwatched(comp);
+
+    return pid;
+}
+
+pid_t wh_spawn_command(WhaleCompositor* comp, const char* command)
+{
+    const char* const argv[] = {"/bin/sh", "-c", command, NULL};
+    return wh_spawn(comp, argv, NULL);
+}
+
+void wh_spawn_autostart(WhaleCompositor* comp)
+{
+    const WhaleConfig* config = &comp->config.current;
+    for (size_t i = 0; i < config->num_autostart; i++)
+        wh_spawn_command(comp, config->autostart[i]);
+}
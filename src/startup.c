@@ -0,0 +1,78 @@
+#define _POSIX_C_SOURCE 200809L
+#include <time.h>
+#include <whale/log.h>
+#include <whale/startup.h>
+#include <whale/types.h>
+
+#define MAX_STARTUP_PHASES 32
+
+typedef struct
+{
+    const char* phase;
+    struct timespec monotonic;
+} StartupMark;
+
+static StartupMark marks[MAX_STARTUP_PHASES];
+static u32 num_marks;
+static bool finished;
+
+static double wh_startup_ms(const struct timespec* ts)
+{
+    return ts->tv_sec * 1e3 + ts->tv_nsec / 1e6;
+}
+
+void wh_startup_mark(const char* phase)
+{
+    if (finished || num_marks == MAX_STARTUP_PHASES)
+        return;
+
+    /* Phases like the first frame are marked from paths that run again. */
+    for (u32 i = 0; i < num_marks; i++)
+    {
+        if (marks[i].phase == phase)
+            return;
+    }
+
+    marks[num_marks].phase = phase;
+    clock_gettime(CLOCK_MONOTONIC, &marks[num_marks].monotonic);
+    num_marks++;
+}
+
+void wh_startup_finish(const char* phase)
+{
+    if (finished)
+        return;
+
+    wh_startup_mark(phase);
+    finished = true;
+
+    /* CLOCK_MONOTONIC doesn't count suspend, it matches CLOCK_BOOTTIME this
+    early after boot, but take the offset now to be exact. */
+    struct timespec mono;
+    struct timespec boot;
+    clock_gettime(CLOCK_MONOTONIC, &mono);
+    clock_gettime(CLOCK_BOOTTIME, &boot);
+    double boot_offset = wh_startup_ms(&boot) - wh_startup_ms(&mono);
+
+    double start = wh_startup_ms(&marks[0].monotonic);
+    double prev = start;
+    for (u32 i = 0; i < num_marks; i++)
+    {
+        double t = wh_startup_ms(&marks[i].monotonic);
+        wh_log(
+            INFO,
+            "startup: %-24s %9.2f ms (+%8.2f ms)",
+            marks[i].phase,
+            t - start,
+            t - prev
+        );
+        prev = t;
+    }
+
+    wh_log(
+        INFO,
+        "startup: %s %.2f ms after boot",
+        phase,
+        wh_startup_ms(&marks[num_marks - 1].monotonic) + boot_offset
+    );
+}
@@ -0,0 +1,242 @@
+#define WLR_USE_UNSTABLE
+#include <linux/input-event-codes.h>
+#include <math.h>
+#include <whale/client.h>
+#include <whale/compositor.h>
+#include <whale/input.h>
+#include <whale/log.h>
+#include <whale/seat.h>
+#include <whale/tablet.h>
+#include <whale/types.h>
+#include <wlr/types/wlr_cursor.h>
+#include <wlr/types/wlr_tablet_tool.h>
+#include <wlr/types/wlr_tablet_v2.h>
+
+/* The tablet-v2 side of a tool, made the first time the tool comes close.
+wlroots destroys it along with the tool. */
+static struct wlr_tablet_v2_tablet_tool*
+wh_tablet_get_tool(WhaleSeat* seat, struct wlr_tablet_tool* wlr_tool)
+{
+    if (!wlr_tool->data)
+    {
+        wlr_tool->data = wlr_tablet_tool_create(
+            seat->comp->tablet_manager, seat->wlr_seat, wlr_tool
+        );
+    }
+
+    return wlr_tool->data;
+}
+
+/**
+ * Send the tool's position to the surface under the cursor, or move the
+ * pointer there if the surface doesn't support tablets.
+ *
+ * @returns The tool if a surface has its focus, NULL if the pointer stands in
+ * for it.
+ */
+static struct wlr_tablet_v2_tablet_tool* wh_tablet_tool_motion(
+    WhaleSeat* seat,
+    struct wlr_tablet* wlr_tablet,
+    struct wlr_tablet_tool* wlr_tool,
+    u32 time_msec
+)
+{
+    struct wlr_tablet_v2_tablet* tablet = wlr_tablet->base.data;
+    struct wlr_tablet_v2_tablet_tool* tool = wh_tablet_get_tool(seat, wlr_tool);
+
+    /* Same hit-testing as the pointer */
+    struct wlr_surface* surf;
+    double surf_x;
+    double surf_y;
+    WhaleClient* client = wh_seat_client_at(
+        seat, seat->cursor->x, seat->cursor->y, &surf, &surf_x, &surf_y
+    );
+
+    if (client && tablet && tool && seat->grab.mode == WH_GRAB_NONE &&
+        wlr_surface_accepts_tablet_v2(surf, tablet))
+    {
+        if (tool->focused_surface != surf)
+            wlr_send_tablet_v2_tablet_tool_proximity_in(tool, tablet, surf);
+
+        wlr_send_tablet_v2_tablet_tool_motion(tool, surf_x, surf_y);
+        return tool;
+    }
+
+    if (tool && tool->focused_surface)
+        wlr_send_tablet_v2_tablet_tool_proximity_out(tool);
+
+    wh_input_cursor_motion(seat, time_msec);
+    wlr_seat_pointer_notify_frame(seat->wlr_seat);
+    return NULL;
+}
+
+static void on_tool_axis(struct wl_listener* listener, void* data)
+{
+    WhaleSeat* seat =
+        wl_container_of(listener, seat, listeners.tablet_tool_axis);
+    struct wlr_tablet_tool_axis_event* ev = data;
+
+    wh_seat_activity(seat);
+
+    /* Axes that didn't change are left alone */
+    if (ev->updated_axes & (WLR_TABLET_TOOL_AXIS_X | WLR_TABLET_TOOL_AXIS_Y))
+    {
+        wlr_cursor_warp_absolute(
+            seat->cursor,
+            &ev->tablet->base,
+            ev->updated_axes & WLR_TABLET_TOOL_AXIS_X ? ev->x : NAN,
+            ev->updated_axes & WLR_TABLET_TOOL_AXIS_Y ? ev->y : NAN
+        );
+    }
+
+    struct wlr_tablet_v2_tablet_tool* tool =
+        wh_tablet_tool_motion(seat, ev->tablet, ev->tool, ev->time_msec);
+    if (!tool)
+        return;
+
+    if (ev->updated_axes & WLR_TABLET_TOOL_AXIS_PRESSURE)
+        wlr_send_tablet_v2_tablet_tool_pressure(tool, ev->pressure);
+    if (ev->updated_axes & WLR_TABLET_TOOL_AXIS_DISTANCE)
+        wlr_send_tablet_v2_tablet_tool_distance(tool, ev->distance);
+    if (ev->updated_axes &
+        (WLR_TABLET_TOOL_AXIS_TILT_X | WLR_TABLET_TOOL_AXIS_TILT_Y))
+        wlr_send_tablet_v2_tablet_tool_tilt(tool, ev->tilt_x, ev->tilt_y);
+    if (ev->updated_axes & WLR_TABLET_TOOL_AXIS_ROTATION)
+        wlr_send_tablet_v2_tablet_tool_rotation(tool, ev->rotation);
+    if (ev->updated_axes & WLR_TABLET_TOOL_AXIS_SLIDER)
+        wlr_send_tablet_v2_tablet_tool_slider(tool, ev->slider);
+    if (ev->updated_axes & WLR_TABLET_TOOL_AXIS_WHEEL)
+        wlr_send_tablet_v2_tablet_tool_wheel(tool, ev->wheel_delta, 0);
+}
+
+static void on_tool_proximity(struct wl_listener* listener, void* data)
+{
+    WhaleSeat* seat =
+        wl_container_of(listener, seat, listeners.tablet_tool_proximity);
+    struct wlr_tablet_tool_proximity_event* ev = data;
+
+    wh_seat_activity(seat);
+
+    if (ev->state == WLR_TABLET_TOOL_PROXIMITY_OUT)
+    {
+        struct wlr_tablet_v2_tablet_tool* tool = ev->tool->data;
+        if (tool && tool->focused_surface)
+            wlr_send_tablet_v2_tablet_tool_proximity_out(tool);
+        return;
+    }
+
+    wlr_cursor_warp_absolute(seat->cursor, &ev->tablet->base, ev->x, ev->y);
+    wh_tablet_tool_motion(seat, ev->tablet, ev->tool, ev->time_msec);
+}
+
+static void on_tool_tip(struct wl_listener* listener, void* data)
+{
+    WhaleSeat* seat =
+        wl_container_of(listener, seat, listeners.tablet_tool_tip);
+    struct wlr_tablet_tool_tip_event* ev = data;
+
+    wh_seat_activity(seat);
+
+    bool down = ev->state == WLR_TABLET_TOOL_TIP_DOWN;
+    struct wlr_tablet_v2_tablet_tool* tool = ev->tool->data;
+    if (tool && tool->focused_surface)
+    {
+        if (down)
+            wlr_send_tablet_v2_tablet_tool_down(tool);
+        else
+            wlr_send_tablet_v2_tablet_tool_up(tool);
+        return;
+    }
+
+    /* The tip is the left button for everyone else, title bars and grabs
+    included */
+    wh_input_pointer_button(
+        seat,
+        ev->time_msec,
+        BTN_LEFT,
+        down ? WL_POINTER_BUTTON_STATE_PRESSED
+             : WL_POINTER_BUTTON_STATE_RELEASED
+    );
+    wlr_seat_pointer_notify_frame(seat->wlr_seat);
+}
+
+static void on_tool_button(struct wl_listener* listener, void* data)
+{
+    WhaleSeat* seat =
+        wl_container_of(listener, seat, listeners.tablet_tool_button);
+    struct wlr_tablet_tool_button_event* ev = data;
+
+    wh_seat_activity(seat);
+
+    /* Both states are released = 0, pressed = 1 */
+    struct wlr_tablet_v2_tablet_tool* tool = ev->tool->data;
+    if (tool && tool->focused_surface)
+    {
+        wlr_send_tablet_v2_tablet_tool_button(
+            tool, ev->button, (enum zwp_tablet_pad_v2_button_state)ev->state
+        );
+        return;
+    }
+
+    wh_input_pointer_button(
+        seat,
+        ev->time_msec,
+        ev->button,
+        (enum wl_pointer_button_state)ev->state
+    );
+    wlr_seat_pointer_notify_frame(seat->wlr_seat);
+}
+
+int wh_tablet_add(WhaleSeat* seat, struct wlr_input_device* dev)
+{
+    struct wlr_tablet_v2_tablet* tablet =
+        wlr_tablet_create(seat->comp->tablet_manager, seat->wlr_seat, dev);
+    if (!tablet)
+    {
+        wh_log(ERR, "tablet: Failed to create tablet (%s)", dev->name);
+        return -1;
+    }
+
+    dev->data = tablet;
+    wlr_cursor_attach_input_device(seat->cursor, dev);
+
+    return 0;
+}
+
+int wh_tablet_seat_init(WhaleSeat* seat)
+{
+    LISTEN(
+        &seat->cursor->events.tablet_tool_axis,
+        &seat->listeners.tablet_tool_axis,
+        on_tool_axis
+    );
+    LISTEN(
+        &seat->cursor->events.tablet_tool_proximity,
+        &seat->listeners.tablet_tool_proximity,
+        on_tool_proximity
+    );
+    LISTEN(
+        &seat->cursor->events.tablet_tool_tip,
+        &seat->listeners.tablet_tool_tip,
+        on_tool_tip
+    );
+    LISTEN(
+        &seat->cursor->events.tablet_tool_button,
+        &seat->listeners.tablet_tool_button,
+        on_tool_button
+    );
+
+    return 0;
+}
+
+int wh_tablet_init(WhaleCompositor* comp)
+{
+    comp->tablet_manager = wlr_tablet_v2_create(comp->display);
+    if (!comp->tablet_manager)
+    {
+        wh_log(ERR, "tablet: Failed to create tablet manager");
+        return -1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,309 @@
+#define _GNU_SOURCE
+#define WLR_USE_UNSTABLE
+#include <stdlib.h>
+#include <time.h>
+#include <wayland-server-core.h>
+#include <wayland-server-protocol.h>
+#include <whale/compositor.h>
+#include <whale/log.h>
+#include <whale/throttle.h>
+#include <whale/types.h>
+#include <wlr/types/wlr_compositor.h>
+#include <wlr/types/wlr_scene.h>
+
+#define WH_THROTTLE_WINDOW_MS 1000
+
+static void on_conn_destroy(struct wl_listener* listener, void*)
+{
+    WhaleClientConn* conn = wl_container_of(listener, conn, destroy);
+    WhaleThrottle* throttle = &conn->comp->throttle;
+
+    if (throttle->last_conn == conn)
+        throttle->last_conn = NULL;
+
+    UNLISTEN(&conn->destroy);
+    wl_list_remove(&conn->link);
+    free(conn);
+}
+
+WhaleClientConn*
+wh_throttle_conn_get(WhaleCompositor* comp, struct wl_client* wl_client)
+{
+    WhaleThrottle* throttle = &comp->throttle;
+    if (throttle->last_conn && throttle->last_conn->wl_client == wl_client)
+        return throttle->last_conn;
+
+    struct wl_listener* listener =
+        wl_client_get_destroy_listener(wl_client, on_conn_destroy);
+    if (listener)
+    {
+        WhaleClientConn* conn = wl_container_of(listener, conn, destroy);
+        throttle->last_conn = conn;
+        return conn;
+    }
+
+    WhaleClientConn* conn = calloc(1, sizeof(WhaleClientConn));
+    if (!conn)
+        return NULL;
+
+    conn->comp = comp;
+    conn->wl_client = wl_client;
+    wl_client_get_credentials(wl_client, &conn->pid, NULL, NULL);
+
+    conn->destroy.notify = on_conn_destroy;
+    wl_client_add_destroy_listener(wl_client, &conn->destroy);
+    wl_list_insert(&throttle->conns, &conn->link);
+
+    throttle->last_conn = conn;
+    return conn;
+}
+
+void wh_throttle_focus_changed(
+    WhaleCompositor* comp,
+    struct wlr_surface* old_surface,
+    struct wlr_surface* new_surface
+)
+{
+    /* Looked up without creating it, a connection being torn down has
+    already dropped its accounting when its surfaces lose focus. */
+    if (old_surface)
+    {
+        struct wl_listener* listener = wl_client_get_destroy_listener(
+            wl_resource_get_client(old_surface->resource), on_conn_destroy
+        );
+        if (listener)
+        {
+            WhaleClientConn* conn = wl_container_of(listener, conn, destroy);
+            if (conn->focus_count)
+                conn->focus_count--;
+        }
+    }
+
+    if (new_surface)
+    {
+        WhaleClientConn* conn = wh_throttle_conn_get(
+            comp, wl_resource_get_client(new_surface->resource)
+        );
+        if (conn)
+            conn->focus_count++;
+    }
+}
+
+/* Runs for every message while at least one logger exists, keep it short. */
+static void wh_throttle_log_message(
+    void* data,
+    enum wl_protocol_logger_type type,
+    const struct wl_protocol_logger_message* message
+)
+{
+    if (type != WL_PROTOCOL_LOGGER_REQUEST)
+        return;
+
+    WhaleCompositor* comp = data;
+    WhaleClientConn* conn =
+        wh_throttle_conn_get(comp, wl_resource_get_client(message->resource));
+    if (!conn)
+        return;
+
+    if (!comp->throttle.window_armed)
+    {
+        wl_event_source_timer_update(
+            comp->throttle.window_timer, WH_THROTTLE_WINDOW_MS
+        );
+        comp->throttle.window_armed = true;
+    }
+
+    conn->current.requests++;
+
+    /* The class is the interface's name, libwayland hands out the same
+    pointer to everyone so comparing it is enough. */
+    if (wl_resource_get_class(message->resource) != wl_surface_interface.name)
+        return;
+
+    if (message->message_opcode == WL_SURFACE_COMMIT)
+        conn->current.commits++;
+    else if (message->message_opcode == WL_SURFACE_ATTACH &&
+             message->arguments[0].o)
+        conn->current.buffers++;
+}
+
+static bool wh_throttle_over(u32 value, u32 limit)
+{
+    return limit && value > limit;
+}
+
+static bool wh_throttle_under(u32 value, u32 limit)
+{
+    return !limit || value <= limit / 2;
+}
+
+static void wh_throttle_update(WhaleThrottle* throttle, WhaleClientConn* conn)
+{
+    const WhaleThrottleConfig* config = &throttle->config;
+    const WhaleClientCounters* rates = &conn->rates;
+
+    if (!conn->throttled &&
+        (wh_throttle_over(rates->commits, config->max_commits) ||
+         wh_throttle_over(rates->buffers, config->max_buffers) ||
+         wh_throttle_over(rates->requests, config->max_requests)))
+    {
+        conn->throttled = true;
+        wh_log(
+            WARN,
+            "throttle: Throttling %d (%u commits/s, %u buffers/s, "
+            "%u requests/s)",
+            conn->pid,
+            rates->commits,
+            rates->buffers,
+            rates->requests
+        );
+    }
+    /* Some hysteresis, so a client hovering around a limit doesn't flip
+    every second. */
+    else if (conn->throttled &&
+             wh_throttle_under(rates->commits, config->max_commits) &&
+             wh_throttle_under(rates->buffers, config->max_buffers) &&
+             wh_throttle_under(rates->requests, config->max_requests))
+    {
+        conn->throttled = false;
+        wh_log(INFO, "throttle: %d calmed down", conn->pid);
+    }
+}
+
+static int on_window_timer(void* data)
+{
+    WhaleCompositor* comp = data;
+    WhaleThrottle* throttle = &comp->throttle;
+
+    bool active = false;
+    WhaleClientConn* conn;
+    wl_list_for_each(conn, &throttle->conns, link)
+    {
+        active |= conn->current.requests > 0 || conn->throttled;
+        conn->rates = conn->current;
+        conn->current = (WhaleClientCounters){0};
+        wh_throttle_update(throttle, conn);
+    }
+
+    /* A quiet window is the last one until the next request */
+    throttle->window_armed = active;
+    if (active)
+        wl_event_source_timer_update(
+            throttle->window_timer, WH_THROTTLE_WINDOW_MS
+        );
+    return 0;
+}
+
+int wh_throttle_init(WhaleCompositor* comp)
+{
+    WhaleThrottle* throttle = &comp->throttle;
+    throttle->config = comp->config.current.throttle;
+    wl_list_init(&throttle->conns);
+
+    throttle->logger = wl_display_add_protocol_logger(
+        comp->display, wh_throttle_log_message, comp
+    );
+    throttle->window_timer = wl_event_loop_add_timer(
+        wl_display_get_event_loop(comp->display), on_window_timer, comp
+    );
+    if (!throttle->logger || !throttle->window_timer)
+    {
+        wh_log(ERR, "throttle: Failed to start client accounting");
+        return -1;
+    }
+
+    wl_event_source_timer_update(throttle->window_timer, WH_THROTTLE_WINDOW_MS);
+    throttle->window_armed = true;
+    return 0;
+}
+
+void wh_throttle_finish(WhaleCompositor* comp)
+{
+    WhaleThrottle* throttle = &comp->throttle;
+
+    if (throttle->logger)
+        wl_protocol_logger_destroy(throttle->logger);
+    if (throttle->window_timer)
+        wl_event_source_remove(throttle->window_timer);
+
+    WhaleClientConn* conn;
+    WhaleClientConn* tmp;
+    wl_list_for_each_safe(conn, tmp, &throttle->conns, link)
+        on_conn_destroy(&conn->destroy, NULL);
+
+    throttle->logger = NULL;
+    throttle->window_timer = NULL;
+}
+
+typedef struct
+{
+    WhaleCompositor* comp;
+    struct wlr_scene_output* scene_output;
+    const struct timespec* now;
+    u64 now_ms;
+
+} WhaleFrameDone;
+
+static bool wh_throttle_frame_allowed(WhaleFrameDone* fd, WhaleClientConn* conn)
+{
+    /* Focused clients are interactive and never throttled */
+    if (!conn || !conn->throttled || conn->focus_count)
+        return true;
+
+    u32 fps = conn->comp->throttle.config.throttled_fps;
+    u64 interval = fps ? 1000 / fps : WH_THROTTLE_WINDOW_MS;
+
+    /* Several surfaces of the client may be shown in the same frame. */
+    if (conn->last_frame_ms == fd->now_ms)
+        return true;
+
+    if (fd->now_ms - conn->last_frame_ms < interval)
+        return false;
+
+    conn->last_frame_ms = fd->now_ms;
+    return true;
+}
+
+static void wh_throttle_frame_done_iter(
+    struct wlr_scene_buffer* buffer, int, int, void* data
+)
+{
+    WhaleFrameDone* fd = data;
+
+    /* Surfaces spanning outputs are paced by one of them */
+    if (buffer->primary_output != fd->scene_output)
+        return;
+
+    struct wlr_scene_surface* scene_surface =
+        wlr_scene_surface_try_from_buffer(buffer);
+    if (!scene_surface)
+        return;
+
+    struct wlr_surface* surface = scene_surface->surface;
+    WhaleClientConn* conn = wh_throttle_conn_get(
+        fd->comp, wl_resource_get_client(surface->resource)
+    );
+
+    /* Skipped callbacks stay queued on the surface until the next frame
+    we let through. */
+    if (wh_throttle_frame_allowed(fd, conn))
+        wlr_surface_send_frame_done(surface, fd->now);
+}
+
+void wh_throttle_send_frame_done(
+    WhaleCompositor* comp,
+    struct wlr_scene_output* scene_output,
+    const struct timespec* now
+)
+{
+    WhaleFrameDone fd = {
+        .comp = comp,
+        .scene_output = scene_output,
+        .now = now,
+        .now_ms = (u64)now->tv_sec * 1000 + now->tv_nsec / 1000000,
+    };
+
+    wlr_scene_output_for_each_buffer(
+        scene_output, wh_throttle_frame_done_iter, &fd
+    );
+}
@@ -0,0 +1,399 @@
+#define _POSIX_C_SOURCE 200112L
+#define WLR_USE_UNSTABLE
+#include <stdlib.h>
+#include <whale/client.h>
+#include <whale/compositor.h>
+#include <whale/decoration.h>
+#include <whale/grab.h>
+#include <whale/log.h>
+#include <whale/types.h>
+#include <whale/xwayland.h>
+#include <wlr/types/wlr_scene.h>
+#include <wlr/xwayland.h>
+#include <wlr/xwayland/server.h>
+
+#define WH_XWAYLAND_IDLE_TIMEOUT 60
+
+static void wh_xwayland_on_map(struct wl_listener* listener, void*)
+{
+    WhaleClient* client = wl_container_of(listener, client, listeners.map);
+    struct wlr_xwayland_surface* xsurface = client->xwayland_surface;
+
+    if (client->unmanaged)
+        wlr_scene_node_raise_to_top(&client->scene_tree->node);
+    else
+        client->server_side_decorations =
+            xsurface->decorations == WLR_XWAYLAND_SURFACE_DECORATIONS_ALL;
+
+    wh_client_mapped(client);
+}
+
+static void wh_xwayland_on_unmap(struct wl_listener* listener, void*)
+{
+    WhaleClient* client = wl_container_of(listener, client, listeners.unmap);
+    wh_client_unmapped(client);
+}
+
+static void wh_xwayland_on_commit(struct wl_listener* listener, void*)
+{
+    WhaleClient* client = wl_container_of(listener, client, listeners.commit);
+    wh_client_committed(client);
+}
+
+/* The X window got a wl_surface, which it may swap for another one over its
+lifetime. */
+static void wh_xwayland_on_associate(struct wl_listener* listener, void*)
+{
+    WhaleClient* client =
+        wl_container_of(listener, client, listeners.associate);
+    struct wlr_surface* surface = client->xwayland_surface->surface;
+
+    client->surface_tree =
+        wlr_scene_subsurface_tree_create(client->scene_tree, surface);
+    wh_client_track_surface(client, surface);
+
+    LISTEN(&surface->events.map, &client->listeners.map, wh_xwayland_on_map);
+    LISTEN(
+        &surface->events.unmap, &client->listeners.unmap, wh_xwayland_on_unmap
+    );
+    LISTEN(
+        &surface->events.commit,
+        &client->listeners.commit,
+        wh_xwayland_on_commit
+    );
+}
+
+static void wh_xwayland_dissociate(WhaleClient* client)
+{
+    if (!client->surface_tree)
+        return;
+
+    UNLISTEN(&client->listeners.map);
+    UNLISTEN(&client->listeners.unmap);
+    UNLISTEN(&client->listeners.commit);
+
+    wlr_scene_node_destroy(&client->surface_tree->node);
+    client->surface_tree = NULL;
+}
+
+static void wh_xwayland_on_dissociate(struct wl_listener* listener, void*)
+{
+    WhaleClient* client =
+        wl_container_of(listener, client, listeners.dissociate);
+    wh_xwayland_dissociate(client);
+}
+
+static void
+wh_xwayland_on_request_configure(struct wl_listener* listener, void* data)
+{
+    WhaleClient* client =
+        wl_container_of(listener, client, listeners.request_configure);
+    struct wlr_xwayland_surface_configure_event* ev = data;
+    struct wlr_xwayland_surface* xsurface = client->xwayland_surface;
+
+    /* Windows that place themselves and windows not shown yet get what they
+    ask for, whale lays out the others and tells them where they are. */
+    if (client->unmanaged || !xsurface->surface || !xsurface->surface->mapped)
+    {
+        wlr_xwayland_surface_configure(
+            xsurface, ev->x, ev->y, ev->width, ev->height
+        );
+        return;
+    }
+
+    int left, right, top, bottom;
+    wh_decoration_insets(client, &left, &right, &top, &bottom);
+    wlr_xwayland_surface_configure(
+        xsurface,
+        client->scene_tree->node.x + left,
+        client->scene_tree->node.y + top,
+        xsurface->width,
+        xsurface->height
+    );
+}
+
+/* Unmanaged windows may move without drawing anything new, like menus
+and tooltips being reused. */
+static void wh_xwayland_on_set_geometry(struct wl_listener* listener, void*)
+{
+    WhaleClient* client =
+        wl_container_of(listener, client, listeners.set_geometry);
+    struct wlr_xwayland_surface* xsurface = client->xwayland_surface;
+
+    if (!client->unmanaged)
+        return;
+
+    wlr_scene_node_set_position(
+        &client->scene_tree->node, xsurface->x, xsurface->y
+    );
+    client->comp->scene_serial++;
+}
+
+static void
+wh_xwayland_on_set_override_redirect(struct wl_listener* listener, void*)
+{
+    WhaleClient* client =
+        wl_container_of(listener, client, listeners.set_override_redirect);
+    struct wlr_xwayland_surface* xsurface = client->xwayland_surface;
+
+    if (client->unmanaged == xsurface->override_redirect)
+        return;
+
+    client->unmanaged = xsurface->override_redirect;
+    wh_log(
+        DEBUG,
+        "xwayland: window now %s",
+        client->unmanaged ? "unmanaged" : "managed"
+    );
+
+    if (!xsurface->surface || !xsurface->surface->mapped)
+        return;
+
+    /* Mapped windows switch over as wh_xwayland_on_map() would set them
+    up */
+    if (client->unmanaged)
+    {
+        client->server_side_decorations = false;
+        wlr_scene_node_set_position(&client->surface_tree->node, 0, 0);
+        wlr_scene_node_raise_to_top(&client->scene_tree->node);
+        wh_grab_client_gone(client);
+        wh_decoration_update(client);
+    }
+    else
+        client->server_side_decorations =
+            xsurface->decorations == WLR_XWAYLAND_SURFACE_DECORATIONS_ALL;
+
+    wh_client_committed(client);
+    client->comp->scene_serial++;
+}
+
+static void wh_xwayland_on_set_title(struct wl_listener* listener, void*)
+{
+    WhaleClient* client =
+        wl_container_of(listener, client, listeners.set_title);
+    wh_client_title_changed(client);
+}
+
+static void wh_xwayland_on_set_class(struct wl_listener* listener, void*)
+{
+    WhaleClient* client =
+        wl_container_of(listener, client, listeners.set_app_id);
+    wh_client_app_id_changed(client);
+}
+
+/* X11 has no serials, the button must still be held on the window. X
+clients only know of the seat given to the X server. */
+static void wh_xwayland_on_request_move(struct wl_listener* listener, void*)
+{
+    WhaleClient* client =
+        wl_container_of(listener, client, listeners.request_move);
+    WhaleSeat* seat = client->comp->default_seat;
+
+    if (!client->unmanaged &&
+        wh_client_has_pointer_button(client, seat->wlr_seat))
+        wh_grab_begin(seat, client, WH_GRAB_MOVE, 0);
+}
+
+static void
+wh_xwayland_on_request_resize(struct wl_listener* listener, void* data)
+{
+    WhaleClient* client =
+        wl_container_of(listener, client, listeners.request_resize);
+    struct wlr_xwayland_resize_event* ev = data;
+    WhaleSeat* seat = client->comp->default_seat;
+
+    if (!client->unmanaged &&
+        wh_client_has_pointer_button(client, seat->wlr_seat))
+        wh_grab_begin(seat, client, WH_GRAB_RESIZE, ev->edges);
+}
+
+static void wh_xwayland_on_destroy(struct wl_listener* listener, void*)
+{
+    WhaleClient* client = wl_container_of(listener, client, listeners.destroy);
+
+    wh_xwayland_dissociate(client);
+
+    UNLISTEN(&client->listeners.associate);
+    UNLISTEN(&client->listeners.dissociate);
+    UNLISTEN(&client->listeners.destroy);
+    UNLISTEN(&client->listeners.request_configure);
+    UNLISTEN(&client->listeners.set_geometry);
+    UNLISTEN(&client->listeners.set_override_redirect);
+    UNLISTEN(&client->listeners.set_title);
+    UNLISTEN(&client->listeners.set_app_id);
+    UNLISTEN(&client->listeners.request_move);
+    UNLISTEN(&client->listeners.request_resize);
+
+    client->xwayland_surface->data = NULL;
+    wh_client_destroy(client);
+}
+
+static void on_new_surface(struct wl_listener* listener, void* data)
+{
+    WhaleCompositor* comp =
+        wl_container_of(listener, comp, xwayland.listeners.new_surface);
+    struct wlr_xwayland_surface* xsurface = data;
+
+    WhaleClient* client = wh_client_create(comp, WH_CLIENT_X11);
+    if (!client)
+        return;
+
+    client->xwayland_surface = xsurface;
+    client->unmanaged = xsurface->override_redirect;
+    xsurface->data = client;
+
+    LISTEN(
+        &xsurface->events.associate,
+        &client->listeners.associate,
+        wh_xwayland_on_associate
+    );
+    LISTEN(
+        &xsurface->events.dissociate,
+        &client->listeners.dissociate,
+        wh_xwayland_on_dissociate
+    );
+    LISTEN(
+        &xsurface->events.destroy,
+        &client->listeners.destroy,
+        wh_xwayland_on_destroy
+    );
+    LISTEN(
+        &xsurface->events.request_configure,
+        &client->listeners.request_configure,
+        wh_xwayland_on_request_configure
+    );
+    LISTEN(
+        &xsurface->events.set_geometry,
+        &client->listeners.set_geometry,
+        wh_xwayland_on_set_geometry
+    );
+    LISTEN(
+        &xsurface->events.set_override_redirect,
+        &client->listeners.set_override_redirect,
+        wh_xwayland_on_set_override_redirect
+    );
+    LISTEN(
+        &xsurface->events.set_title,
+        &client->listeners.set_title,
+        wh_xwayland_on_set_title
+    );
+    LISTEN(
+        &xsurface->events.set_class,
+        &client->listeners.set_app_id,
+        wh_xwayland_on_set_class
+    );
+    LISTEN(
+        &xsurface->events.request_move,
+        &client->listeners.request_move,
+        wh_xwayland_on_request_move
+    );
+    LISTEN(
+        &xsurface->events.request_resize,
+        &client->listeners.request_resize,
+        wh_xwayland_on_request_resize
+    );
+
+    wh_log(DEBUG, "xwayland: new %s window", client->unmanaged ? "unmanaged"
+                                                               : "managed");
+}
+
+static void on_ready(struct wl_listener* listener, void*)
+{
+    WhaleCompositor* comp =
+        wl_container_of(listener, comp, xwayland.listeners.ready);
+
+    wlr_xwayland_set_seat(
+        comp->xwayland.wlr_xwayland, comp->default_seat->wlr_seat
+    );
+    wh_log(INFO, "xwayland: X server started");
+}
+
+void wh_xwayland_focus_changed(WhaleClient* old, WhaleClient* new)
+{
+    /* Still active while another seat has it focused */
+    if (old && old->type == WH_CLIENT_X11 && !old->focus_count)
+        wlr_xwayland_surface_activate(old->xwayland_surface, false);
+    if (new && new->type == WH_CLIENT_X11)
+        wlr_xwayland_surface_activate(new->xwayland_surface, true);
+}
+
+int wh_xwayland_reserve(WhaleCompositor* comp)
+{
+    WhaleXwayland* xwayland = &comp->xwayland;
+    wl_list_init(&xwayland->listeners.ready.link);
+    wl_list_init(&xwayland->listeners.new_surface.link);
+
+    xwayland->idle_timeout = WH_XWAYLAND_IDLE_TIMEOUT;
+    const char* timeout = getenv("WHALE_XWAYLAND_IDLE");
+    if (timeout)
+        xwayland->idle_timeout = atoi(timeout);
+
+    /* Only the display socket is made here, Xwayland itself is launched
+    when an X11 client first connects to it and exits once they are all
+    gone for idle_timeout. */
+    struct wlr_xwayland_server_options options = {
+        .lazy = true,
+        .enable_wm = true,
+        .terminate_delay = xwayland->idle_timeout,
+    };
+
+    xwayland->server = wlr_xwayland_server_create(comp->display, &options);
+    if (!xwayland->server)
+    {
+        wh_log(ERR, "xwayland: Failed to reserve an X11 display");
+        return -1;
+    }
+
+    setenv("DISPLAY", xwayland->server->display_name, 1);
+    wh_log(INFO, "DISPLAY: %s", xwayland->server->display_name);
+
+    return 0;
+}
+
+int wh_xwayland_init(WhaleCompositor* comp)
+{
+    WhaleXwayland* xwayland = &comp->xwayland;
+    if (!xwayland->server)
+        return -1;
+
+    xwayland->wlr_xwayland = wlr_xwayland_create_with_server(
+        comp->display, comp->compositor, xwayland->server
+    );
+    if (!xwayland->wlr_xwayland)
+    {
+        wh_log(ERR, "xwayland: Failed to create the window manager");
+        return -1;
+    }
+
+    LISTEN(
+        &xwayland->wlr_xwayland->events.ready,
+        &xwayland->listeners.ready,
+        on_ready
+    );
+    LISTEN(
+        &xwayland->wlr_xwayland->events.new_surface,
+        &xwayland->listeners.new_surface,
+        on_new_surface
+    );
+
+    return 0;
+}
+
+void wh_xwayland_finish(WhaleCompositor* comp)
+{
+    WhaleXwayland* xwayland = &comp->xwayland;
+
+    UNLISTEN(&xwayland->listeners.ready);
+    UNLISTEN(&xwayland->listeners.new_surface);
+    wl_list_init(&xwayland->listeners.ready.link);
+    wl_list_init(&xwayland->listeners.new_surface.link);
+
+    /* The server isn't owned by the window manager */
+    if (xwayland->wlr_xwayland)
+        wlr_xwayland_destroy(xwayland->wlr_xwayland);
+    if (xwayland->server)
+        wlr_xwayland_server_destroy(xwayland->server);
+
+    xwayland->wlr_xwayland = NULL;
+    xwayland->server = NULL;
+}